@@ -0,0 +1,129 @@
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "bench/bench.hpp"
+#include "src/main/dsp/adpcm.hpp"
+#include "src/main/sst.hpp"
+
+/*
+ * Batch decoder test. Encodes a mixed test signal into sector-sized chunks in
+ * each block format, lays them out with various strides (including the stride
+ * of a single channel within a series of stereo sectors) and checks that
+ * decodeSSTBatch() produces the same output as calling decodeSST() on each
+ * chunk. The test is built with and without DSP_NO_SIMD, so that both the
+ * vectorized and the scalar paths are covered.
+ */
+
+static const size_t BATCH_SIZES_[]{ 0, 1, 3, 17, 1000 };
+
+static const dsp::SSTBlockFormat FORMATS_[]{
+	dsp::SST_FORMAT_4BIT,
+	dsp::SST_FORMAT_3BIT,
+	dsp::SST_FORMAT_2BIT
+};
+
+using Chunk_ = dsp::SSTChunk<sst::BLOCKS_PER_SECTOR>;
+
+static bool runTest_(
+	dsp::SSTBlockFormat format,
+	size_t              numChunks,
+	size_t              padding
+) {
+	constexpr size_t numSamples = sst::SAMPLES_PER_SECTOR;
+
+	const size_t chunkLength =
+		dsp::getSSTChunkLength(sst::BLOCKS_PER_SECTOR, format);
+	const size_t stride      = chunkLength + padding;
+	const size_t outputSize  =
+		(numChunks * numSamples + 1) * sizeof(dsp::Sample);
+
+	// One extra chunk and sample are allocated so that the buffers are never
+	// empty and a write past the end of the output can be detected.
+	auto input    = new dsp::Sample[(numChunks + 1) * numSamples];
+	auto data     = new uint8_t[(numChunks + 1) * stride];
+	auto expected = new dsp::Sample[numChunks * numSamples + 1];
+	auto output   = new dsp::Sample[numChunks * numSamples + 1];
+
+	bench::generateTestSignal(input, numChunks * numSamples);
+	memset(data, 0xa5, (numChunks + 1) * stride);
+	memset(expected, 0x5a, outputSize);
+	memset(output, 0x5a, outputSize);
+
+	dsp::SSTEncoder encoder(dsp::SST_QUALITY_FAST, format);
+	Chunk_          chunk;
+
+	for (size_t i = 0; i < numChunks; i++) {
+		encoder.encode(chunk, &input[i * numSamples], numSamples);
+		memcpy(&data[i * stride], &chunk, chunkLength);
+		dsp::decodeSST(
+			&expected[i * numSamples],
+			*reinterpret_cast<const dsp::SSTChunkBase *>(&data[i * stride]),
+			sst::BLOCKS_PER_SECTOR,
+			1,
+			format
+		);
+	}
+
+	dsp::decodeSSTBatch(
+		output,
+		*reinterpret_cast<const dsp::SSTChunkBase *>(data),
+		numChunks,
+		sst::BLOCKS_PER_SECTOR,
+		stride,
+		numSamples,
+		format
+	);
+
+	const bool ok = !memcmp(output, expected, outputSize);
+
+	if (!ok)
+		printf(
+			"  %d-bit, %zu chunks, stride %zu: FAILED\n",
+			dsp::getSSTSampleBits(format),
+			numChunks,
+			stride
+		);
+
+	delete[] input;
+	delete[] data;
+	delete[] expected;
+	delete[] output;
+	return ok;
+}
+
+int main(void) {
+#ifdef DSP_NO_SIMD
+	printf("batch decoder: scalar build\n");
+#else
+	printf("batch decoder: vector build\n");
+#endif
+
+	int numTests = 0, numFailed = 0;
+
+	for (auto format : FORMATS_) {
+		const size_t chunkLength =
+			dsp::getSSTChunkLength(sst::BLOCKS_PER_SECTOR, format);
+
+		// Contiguous chunks, chunks with an odd amount of padding and one
+		// channel out of a series of stereo sectors.
+		const size_t paddings[]{ 0, 3, sizeof(sst::SSTSector) - chunkLength };
+
+		for (size_t numChunks : BATCH_SIZES_) {
+			for (size_t padding : paddings) {
+				numTests++;
+
+				if (!runTest_(format, numChunks, padding))
+					numFailed++;
+			}
+		}
+	}
+
+	printf(
+		"batch decoder: %d of %d tests passed\n",
+		numTests - numFailed,
+		numTests
+	);
+	return numFailed ? 1 : 0;
+}
@@ -0,0 +1,219 @@
+
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "src/main/dsp/dsp.hpp"
+#include "src/main/util/templates.hpp"
+#include "src/main/sst.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace bench {
+
+/* Timing */
+
+static inline uint64_t getTime(void) {
+	timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return uint64_t(time.tv_sec) * 1000000000 + uint64_t(time.tv_nsec);
+}
+
+// Returns the TSC on x86, or falls back to nanoseconds on other hosts.
+static inline uint64_t getCycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return getTime();
+#endif
+}
+
+/* Command line */
+
+// All benchmarks accept --quick, which shrinks the workload so they can be run
+// as smoke tests by CTest.
+static inline bool hasOption(int argc, const char **argv, const char *option) {
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], option))
+			return true;
+	}
+
+	return false;
+}
+
+/* Test data */
+
+// Simple xorshift generator, used instead of rand() so that the data (and
+// thus the results) is identical across hosts.
+class Random {
+private:
+	uint32_t state_;
+
+public:
+	inline Random(uint32_t seed = 1) :
+		state_(seed ? seed : 1) {}
+
+	inline uint32_t next(void) {
+		state_ ^= state_ << 13;
+		state_ ^= state_ >> 17;
+		state_ ^= state_ << 5;
+		return state_;
+	}
+	inline int nextInt(int low, int high) {
+		return low + int(next() % uint32_t(high - low + 1));
+	}
+};
+
+// Fills a buffer with equal parts of tones, white noise, a full scale square
+// wave and near-silence, which together exercise every filter and gain.
+static inline void generateTestSignal(
+	dsp::Sample *output,
+	size_t      numSamples,
+	size_t      stride = 1,
+	uint32_t    seed   = 1
+) {
+	Random random(seed);
+
+	for (size_t i = 0; i < numSamples; i++, output += stride) {
+		const double t = double(i) / 44100.0;
+		double       value;
+
+		switch ((i * 4) / numSamples) {
+			case 0:
+				value = 0
+					+ 12000.0 * sin(2.0 * M_PI *  220.0 * t)
+					+  6000.0 * sin(2.0 * M_PI * 3520.0 * t);
+				break;
+
+			case 1:
+				value = double(int16_t(random.next())) * 0.5;
+				break;
+
+			case 2:
+				value = ((i / 50) & 1) ? 32767.0 : -32768.0;
+				break;
+
+			default:
+				value = double(random.nextInt(-8, 8));
+				break;
+		}
+
+		*output = dsp::Sample(lrint(value));
+	}
+}
+
+// Writes a .sst file with the given number of stereo 4-bit variants, filled
+// with random sectors and laid out in groups of chunksPerGroup chunks. The
+// file has no waveform, metadata or silent runs.
+static inline bool writeTestSST(
+	const char *path,
+	size_t     numChunks,
+	size_t     numVariants,
+	size_t     chunksPerGroup = 1,
+	uint32_t   seed           = 1
+) {
+	auto file = fopen(path, "wb");
+
+	if (!file)
+		return false;
+
+	sst::SSTHeader header;
+
+	memset(&header, 0, sizeof(header));
+	header.info.magic          = sst::SST_MAGIC;
+	header.info.sampleRate     = 44100;
+	header.info.numChunks      = uint32_t(numChunks);
+	header.info.numVariants    = uint8_t(numVariants);
+	header.info.numChannels    = sst::NUM_CHANNELS;
+	header.info.chunksPerGroup = uint8_t(chunksPerGroup);
+
+	// The reader rejects strings that overlap the header info.
+	header.info.titleOffset  = sizeof(sst::SSTHeaderInfo);
+	header.info.artistOffset = sizeof(sst::SSTHeaderInfo);
+	header.info.albumOffset  = sizeof(sst::SSTHeaderInfo);
+	header.info.genreOffset  = sizeof(sst::SSTHeaderInfo);
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+	// As all variants have the same format, the layout does not affect the
+	// length of the file.
+	Random         random(seed);
+	sst::SSTSector sector;
+
+	for (size_t i = numChunks * numVariants; ok && i; i--) {
+		for (auto &byte : sector.data)
+			byte = uint8_t(random.next());
+
+		ok = fwrite(&sector, sizeof(sector), 1, file) == 1;
+	}
+
+	return !fclose(file) && ok;
+}
+
+// Sector source for sst::Sampler, which returns the same random sector for
+// every chunk and counts the reads issued. The sector can be flagged as silent
+// to measure the sampler alone, without any ADPCM decoding.
+class TestSectorSource {
+public:
+	sst::SSTSector sector;
+	uint8_t        flags;
+	int            lastChunk;
+	size_t         numReads;
+
+	inline TestSectorSource(uint8_t sectorFlags = 0, uint32_t seed = 1) :
+		flags(sectorFlags),
+		lastChunk(-1),
+		numReads(0)
+	{
+		Random random(seed);
+
+		for (auto &byte : sector.data)
+			byte = uint8_t(random.next());
+	}
+
+	static inline const sst::SSTSector *read(
+		int                  chunk,
+		sst::SSTSectorFormat &format,
+		void                 *arg
+	) {
+		auto source = reinterpret_cast<TestSectorSource *>(arg);
+
+		if (chunk < 0)
+			return nullptr;
+
+		memset(&format, 0, sizeof(format));
+		format.flags       = source->flags;
+		format.numChannels = sst::NUM_CHANNELS;
+
+		source->lastChunk = chunk;
+		source->numReads++;
+		return &source->sector;
+	}
+
+	inline void attach(sst::Sampler &sampler) {
+		sampler.setCallbacks(&read, nullptr, this);
+	}
+};
+
+// 32-bit FNV-1a, used to compare outputs across builds.
+static inline uint32_t hash(
+	const void *data,
+	size_t     length,
+	uint32_t   value = 0x811c9dc5
+) {
+	auto ptr = reinterpret_cast<const uint8_t *>(data);
+
+	for (; length; length--)
+		value = (value ^ *(ptr++)) * 0x01000193;
+
+	return value;
+}
+
+}
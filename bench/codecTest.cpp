@@ -0,0 +1,416 @@
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "bench/bench.hpp"
+#include "src/main/dsp/adpcm.hpp"
+#include "src/main/sst.hpp"
+
+/*
+ * ADPCM codec round-trip test. Encodes the test signal in every block format
+ * and quality preset, one sector-sized chunk at a time as the encoder script
+ * does, and checks that:
+ *
+ * - decodeSST() matches a reference decoder written directly from the format
+ *   description (bit-level unpacking and the filter equation in plain
+ *   arithmetic);
+ * - the filter state stored at the start of each chunk matches the last two
+ *   samples the reference decodes from the previous one, i.e. the encoder's
+ *   model of the decoder is exact and chunks can be decoded independently;
+ * - the SNR of the tone part of the signal is above a minimum for the format.
+ *
+ * The stereo and mono decoders are then checked against the same reference,
+ * for every combination of block formats, with and without mid/side coding
+ * (using mid and side signals whose sum and difference clip) and both in a
+ * single call and resumed every few blocks.
+ *
+ * The test is built with and without DSP_NO_SIMD.
+ */
+
+static constexpr size_t NUM_CHUNKS_  = 64;
+static constexpr size_t NUM_SAMPLES_ = NUM_CHUNKS_ * sst::SAMPLES_PER_SECTOR;
+
+static const dsp::SSTEncoderQuality QUALITIES_[]{
+	dsp::SST_QUALITY_DRAFT,
+	dsp::SST_QUALITY_FAST,
+	dsp::SST_QUALITY_NORMAL,
+	dsp::SST_QUALITY_BEST
+};
+
+static const char *const QUALITY_NAMES_[]{
+	"draft",
+	"fast",
+	"normal",
+	"best"
+};
+
+// Minimum SNR (in dB) of the tone part of the test signal for each format.
+static const struct {
+	dsp::SSTBlockFormat format;
+	double              minSNR;
+} FORMATS_[]{
+	{ dsp::SST_FORMAT_4BIT, 27.0 },
+	{ dsp::SST_FORMAT_3BIT, 21.0 },
+	{ dsp::SST_FORMAT_2BIT, 15.0 }
+};
+
+// Block counts for each call when testing resumed decoding.
+static const size_t SPLITS_[]{ 1, 3, 7, 20, 54 };
+
+using Chunk_ = dsp::SSTChunk<sst::BLOCKS_PER_SECTOR>;
+using Frame_ = dsp::Sample[sst::NUM_CHANNELS];
+
+/* Reference decoder */
+
+static const int REFERENCE_FILTERS_[16][2]{
+	{   0,    0 }, { 240,    0 }, { 460, -208 }, { 392, -220 },
+	{ 488, -240 }, { 120,    0 }, { 230, -104 }, { 196, -110 },
+	{ 244, -120 }, {  60,    0 }, { 115,  -52 }, {  98,  -55 },
+	{ 122,  -60 }, { 128, -240 }, {  60, -240 }, {  28, -240 }
+};
+
+static void decodeReference_(
+	dsp::Sample         *output,
+	const uint8_t       *chunk,
+	size_t              numBlocks,
+	dsp::SSTBlockFormat format
+) {
+	const int    sampleBits  = dsp::getSSTSampleBits(format);
+	const size_t blockLength = dsp::getSSTBlockLength(format);
+
+	int s1 = int16_t(chunk[0] | (chunk[1] << 8));
+	int s2 = int16_t(chunk[2] | (chunk[3] << 8));
+
+	auto block = &chunk[4];
+
+	for (size_t i = 0; i < numBlocks; i++, block += blockLength) {
+		const int gain = block[0] & 15;
+		const int a1   = REFERENCE_FILTERS_[block[0] >> 4][0];
+		const int a2   = REFERENCE_FILTERS_[block[0] >> 4][1];
+
+		for (size_t j = 0; j < dsp::SST_SAMPLES_PER_BLOCK; j++) {
+			// Samples are stored with an offset of half their range, packed LSB
+			// first.
+			int code = 0;
+
+			for (int k = 0; k < sampleBits; k++) {
+				const size_t bit = j * sampleBits + k;
+
+				code |= ((block[1 + bit / 8] >> (bit % 8)) & 1) << k;
+			}
+
+			const int value  = code - (1 << (sampleBits - 1));
+			const int sample = util::clamp(
+				(value * (256 << gain) + a1 * s1 + a2 * s2 + 128) >> 8,
+				INT16_MIN,
+				INT16_MAX
+			);
+
+			*(output++) = dsp::Sample(sample);
+			s2          = s1;
+			s1          = sample;
+		}
+	}
+}
+
+/* Tests */
+
+static bool runTest_(
+	const dsp::Sample      *input,
+	dsp::SSTBlockFormat    format,
+	dsp::SSTEncoderQuality quality,
+	double                 minSNR
+) {
+	constexpr size_t numSamples = sst::SAMPLES_PER_SECTOR;
+
+	auto chunks    = new Chunk_[NUM_CHUNKS_];
+	auto decoded   = new dsp::Sample[NUM_SAMPLES_];
+	auto reference = new dsp::Sample[NUM_SAMPLES_];
+
+	dsp::SSTEncoder encoder(quality, format);
+	bool            ok = true;
+
+	for (size_t i = 0; i < NUM_CHUNKS_; i++) {
+		const size_t offset = i * numSamples;
+
+		encoder.encode(chunks[i], &input[offset], numSamples);
+		dsp::decodeSST(
+			&decoded[offset],
+			chunks[i],
+			sst::BLOCKS_PER_SECTOR,
+			1,
+			format
+		);
+		decodeReference_(
+			&reference[offset],
+			reinterpret_cast<const uint8_t *>(&chunks[i]),
+			sst::BLOCKS_PER_SECTOR,
+			format
+		);
+
+		if (
+			i
+			&& (
+				(chunks[i].s1 != reference[offset - 1]) ||
+				(chunks[i].s2 != reference[offset - 2])
+			)
+		) {
+			printf("  chunk %zu: filter state does not match\n", i);
+			ok = false;
+		}
+	}
+
+	if (memcmp(decoded, reference, NUM_SAMPLES_ * sizeof(dsp::Sample))) {
+		printf("  decoder output does not match reference\n");
+		ok = false;
+	}
+
+	// The first quarter of the test signal is a pair of tones.
+	double signal = 0.0, error = 0.0;
+
+	for (size_t i = 0; i < NUM_SAMPLES_ / 4; i++) {
+		const double delta = double(reference[i]) - double(input[i]);
+
+		signal += double(input[i]) * double(input[i]);
+		error  += delta * delta;
+	}
+
+	const double snr = 10.0 * log10(signal / error);
+
+	if (snr < minSNR)
+		ok = false;
+
+	printf(
+		"  %d-bit %-6s: SNR %5.1f dB %s\n",
+		dsp::getSSTSampleBits(format),
+		QUALITY_NAMES_[quality],
+		snr,
+		ok ? "ok" : "FAILED"
+	);
+
+	delete[] chunks;
+	delete[] decoded;
+	delete[] reference;
+	return ok;
+}
+
+static bool runStereoTest_(
+	const dsp::Sample   *mid,
+	const dsp::Sample   *side,
+	dsp::SSTBlockFormat leftFormat,
+	dsp::SSTBlockFormat rightFormat,
+	bool                midSide
+) {
+	constexpr size_t numSamples = sst::SAMPLES_PER_SECTOR;
+	constexpr size_t numBlocks  = sst::BLOCKS_PER_SECTOR;
+
+	dsp::SSTEncoder leftEncoder(dsp::SST_QUALITY_FAST, leftFormat);
+	dsp::SSTEncoder rightEncoder(dsp::SST_QUALITY_FAST, rightFormat);
+
+	Chunk_      left, right;
+	dsp::Sample leftReference[numSamples], rightReference[numSamples];
+	Frame_      reference[numSamples], output[numSamples];
+
+	bool   ok         = true;
+	size_t numClipped = 0;
+
+	for (size_t i = 0; ok && (i < NUM_CHUNKS_); i++) {
+		const size_t offset = i * numSamples;
+
+		leftEncoder.encode(left,   &mid[offset],  numSamples);
+		rightEncoder.encode(right, &side[offset], numSamples);
+		decodeReference_(
+			leftReference,
+			reinterpret_cast<const uint8_t *>(&left),
+			numBlocks,
+			leftFormat
+		);
+		decodeReference_(
+			rightReference,
+			reinterpret_cast<const uint8_t *>(&right),
+			numBlocks,
+			rightFormat
+		);
+
+		for (size_t j = 0; j < numSamples; j++) {
+			const int l = leftReference[j], r = rightReference[j];
+
+			if (midSide) {
+				reference[j][0] = dsp::Sample(
+					util::clamp(l + r, INT16_MIN, INT16_MAX)
+				);
+				reference[j][1] = dsp::Sample(
+					util::clamp(l - r, INT16_MIN, INT16_MAX)
+				);
+
+				if ((l + r) != reference[j][0])
+					numClipped++;
+			} else {
+				reference[j][0] = dsp::Sample(l);
+				reference[j][1] = dsp::Sample(r);
+			}
+		}
+
+		// Decode the chunk in one go, then again split into calls of a few
+		// blocks each carrying over the history.
+		memset(output, 0, sizeof(output));
+		dsp::decodeSSTStereo(
+			output[0],
+			left,
+			right,
+			numBlocks,
+			midSide,
+			leftFormat,
+			rightFormat
+		);
+		ok = !memcmp(output, reference, sizeof(output));
+
+		for (size_t split : SPLITS_) {
+			dsp::Sample history[]{ left.s2, right.s2, left.s1, right.s1 };
+
+			memset(output, 0, sizeof(output));
+
+			for (size_t j = 0; j < numBlocks; j += split) {
+				const size_t length = util::min(split, numBlocks - j);
+
+				dsp::decodeSSTStereo(
+					output[j * dsp::SST_SAMPLES_PER_BLOCK],
+					left.getBlock(j, leftFormat),
+					right.getBlock(j, rightFormat),
+					length,
+					history,
+					midSide,
+					leftFormat,
+					rightFormat
+				);
+			}
+
+			ok = ok && !memcmp(output, reference, sizeof(output));
+		}
+	}
+
+	// Make sure the clipping path was actually exercised.
+	if (midSide && !numClipped)
+		ok = false;
+
+	printf(
+		"  stereo %d/%d-bit %-9s: %s\n",
+		dsp::getSSTSampleBits(leftFormat),
+		dsp::getSSTSampleBits(rightFormat),
+		midSide ? "mid/side" : "left/right",
+		ok ? "ok" : "FAILED"
+	);
+	return ok;
+}
+
+static bool runMonoTest_(const dsp::Sample *input, dsp::SSTBlockFormat format) {
+	constexpr size_t numSamples = sst::SAMPLES_PER_SECTOR;
+	constexpr size_t numBlocks  = sst::BLOCKS_PER_SECTOR;
+
+	dsp::SSTEncoder encoder(dsp::SST_QUALITY_FAST, format);
+
+	Chunk_      chunk;
+	dsp::Sample reference[numSamples];
+	Frame_      output[numSamples];
+
+	bool ok = true;
+
+	for (size_t i = 0; ok && (i < NUM_CHUNKS_); i++) {
+		encoder.encode(chunk, &input[i * numSamples], numSamples);
+		decodeReference_(
+			reference,
+			reinterpret_cast<const uint8_t *>(&chunk),
+			numBlocks,
+			format
+		);
+
+		for (size_t split : SPLITS_) {
+			dsp::Sample history[]{ chunk.s2, chunk.s2, chunk.s1, chunk.s1 };
+
+			memset(output, 0, sizeof(output));
+
+			for (size_t j = 0; j < numBlocks; j += split)
+				dsp::decodeSSTMono(
+					output[j * dsp::SST_SAMPLES_PER_BLOCK],
+					chunk.getBlock(j, format),
+					util::min(split, numBlocks - j),
+					history,
+					format
+				);
+
+			for (size_t j = 0; j < numSamples; j++) {
+				if (
+					(output[j][0] != reference[j]) ||
+					(output[j][1] != reference[j])
+				)
+					ok = false;
+			}
+		}
+	}
+
+	printf(
+		"  mono %d-bit: %s\n",
+		dsp::getSSTSampleBits(format),
+		ok ? "ok" : "FAILED"
+	);
+	return ok;
+}
+
+int main(void) {
+#ifdef DSP_NO_SIMD
+	printf("codec: scalar build\n");
+#else
+	printf("codec: vector build\n");
+#endif
+
+	auto input = new dsp::Sample[NUM_SAMPLES_];
+	auto side  = new dsp::Sample[NUM_SAMPLES_];
+
+	// The square wave sections of both signals are identical, so the sum of
+	// mid and side clips while their difference is near zero.
+	bench::generateTestSignal(input, NUM_SAMPLES_);
+	bench::generateTestSignal(side,  NUM_SAMPLES_, 1, 2);
+
+	int numTests = 0, numFailed = 0;
+
+	for (auto &format : FORMATS_) {
+		for (auto quality : QUALITIES_) {
+			numTests++;
+
+			if (!runTest_(input, format.format, quality, format.minSNR))
+				numFailed++;
+		}
+	}
+
+	for (auto &leftFormat : FORMATS_) {
+		for (auto &rightFormat : FORMATS_) {
+			for (int midSide = 0; midSide < 2; midSide++) {
+				numTests++;
+
+				if (!runStereoTest_(
+					input,
+					side,
+					leftFormat.format,
+					rightFormat.format,
+					midSide
+				))
+					numFailed++;
+			}
+		}
+	}
+
+	for (auto &format : FORMATS_) {
+		numTests++;
+
+		if (!runMonoTest_(input, format.format))
+			numFailed++;
+	}
+
+	printf("codec: %d of %d tests passed\n", numTests - numFailed, numTests);
+
+	delete[] input;
+	delete[] side;
+	return numFailed ? 1 : 0;
+}
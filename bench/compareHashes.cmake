@@ -0,0 +1,25 @@
+# Runs two builds of the same benchmark with --quick and fails unless both
+# print the same output hash.
+
+foreach(build FIRST SECOND)
+	execute_process(
+		COMMAND         "${${build}}" --quick
+		OUTPUT_VARIABLE output
+		RESULT_VARIABLE result
+	)
+
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "${${build}} failed (${result})")
+	endif()
+	if(NOT output MATCHES "output hash: ([0-9a-f]+)")
+		message(FATAL_ERROR "${${build}} did not print a hash")
+	endif()
+
+	set(hash${build} "${CMAKE_MATCH_1}")
+endforeach()
+
+if(NOT hashFIRST STREQUAL hashSECOND)
+	message(FATAL_ERROR "Hash mismatch: ${hashFIRST} vs. ${hashSECOND}")
+endif()
+
+message(STATUS "Output hash: ${hashFIRST}")
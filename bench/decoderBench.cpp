@@ -0,0 +1,94 @@
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "bench/bench.hpp"
+#include "src/main/dsp/adpcm.hpp"
+#include "src/main/sst.hpp"
+
+/*
+ * Sector decoding benchmark. Decodes random stereo sectors into interleaved
+ * frames, either with two strided decodeSST() calls (one per channel) or with
+ * a single decodeSSTStereo() call, and reports the best of several runs per
+ * frame. The benchmark fails if the two paths produce different output.
+ */
+
+static constexpr size_t NUM_RUNS_ = 5;
+
+using Frame_ = dsp::Sample[sst::NUM_CHANNELS];
+
+static void decodeTwoCalls_(Frame_ *output, const sst::SSTSector &sector) {
+	for (size_t ch = 0; ch < sst::NUM_CHANNELS; ch++)
+		dsp::decodeSST(&output[0][ch], sector.channels[ch], sst::NUM_CHANNELS);
+}
+
+static void decodeStereo_(Frame_ *output, const sst::SSTSector &sector) {
+	dsp::decodeSSTStereo(output[0], sector.channels[0], sector.channels[1]);
+}
+
+static void runBenchmark_(
+	const char           *name,
+	void                 (*decode)(Frame_ *, const sst::SSTSector &),
+	Frame_               *output,
+	const sst::SSTSector *sectors,
+	size_t               numSectors
+) {
+	uint64_t bestTime = UINT64_MAX, bestCycles = UINT64_MAX;
+
+	for (size_t run = 0; run < NUM_RUNS_; run++) {
+		const uint64_t startTime   = bench::getTime();
+		const uint64_t startCycles = bench::getCycles();
+
+		for (size_t i = 0; i < numSectors; i++)
+			decode(&output[i * sst::SAMPLES_PER_SECTOR], sectors[i]);
+
+		bestCycles = util::min(bestCycles, bench::getCycles() - startCycles);
+		bestTime   = util::min(bestTime,   bench::getTime()   - startTime);
+	}
+
+	const double numFrames = double(numSectors * sst::SAMPLES_PER_SECTOR);
+
+	printf(
+		"  %-18s %6.2f us/sector %5.2f ns/frame %5.1f cycles/frame\n",
+		name,
+		double(bestTime) / double(numSectors) / 1e3,
+		double(bestTime)   / numFrames,
+		double(bestCycles) / numFrames
+	);
+}
+
+int main(int argc, const char **argv) {
+	const bool   quick      = bench::hasOption(argc, argv, "--quick");
+	const size_t numSectors = quick ? 16 : 4096;
+	const size_t numFrames  = numSectors * sst::SAMPLES_PER_SECTOR;
+
+	auto sectors = new sst::SSTSector[numSectors];
+	auto output1 = new Frame_[numFrames];
+	auto output2 = new Frame_[numFrames];
+
+	// Random data is valid ADPCM, and exercises every filter and gain.
+	bench::Random random;
+
+	for (size_t i = 0; i < numSectors; i++) {
+		for (auto &byte : sectors[i].data)
+			byte = uint8_t(random.next());
+	}
+
+	printf("decoder: %zu random sectors\n", numSectors);
+	runBenchmark_(
+		"decodeSST() x2", decodeTwoCalls_, output1, sectors, numSectors
+	);
+	runBenchmark_(
+		"decodeSSTStereo()", decodeStereo_, output2, sectors, numSectors
+	);
+
+	const bool match = !memcmp(output1, output2, numFrames * sizeof(Frame_));
+
+	printf("outputs %s\n", match ? "match" : "DIFFER");
+
+	delete[] sectors;
+	delete[] output1;
+	delete[] output2;
+	return match ? 0 : 1;
+}
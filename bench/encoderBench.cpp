@@ -0,0 +1,85 @@
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench/bench.hpp"
+#include "src/main/dsp/adpcm.hpp"
+#include "src/main/sst.hpp"
+
+/*
+ * SSTEncoder throughput benchmark. Encodes a mixed test signal one sector at a
+ * time in each block format and reports the best of several runs in blocks per
+ * second, along with a hash of the encoded data. The benchmark is built twice,
+ * with and without DSP_NO_SIMD, and CTest checks that both builds produce the
+ * same hash.
+ */
+
+static constexpr size_t NUM_RUNS_ = 3;
+
+using Chunk_ = dsp::SSTChunk<sst::BLOCKS_PER_SECTOR>;
+
+static const dsp::SSTBlockFormat FORMATS_[]{
+	dsp::SST_FORMAT_4BIT,
+	dsp::SST_FORMAT_3BIT,
+	dsp::SST_FORMAT_2BIT
+};
+
+int main(int argc, const char **argv) {
+	const bool   quick      = bench::hasOption(argc, argv, "--quick");
+	const size_t numSectors = quick ? 16 : 1024;
+	const size_t numSamples = numSectors * sst::SAMPLES_PER_SECTOR;
+
+	auto input  = new dsp::Sample[numSamples];
+	auto output = new Chunk_[numSectors];
+
+	bench::generateTestSignal(input, numSamples);
+
+#ifdef DSP_NO_SIMD
+	printf("encoder: scalar build\n");
+#else
+	printf("encoder: vector build\n");
+#endif
+
+	uint32_t hash = 0x811c9dc5;
+
+	for (auto format : FORMATS_) {
+		uint64_t bestTime = UINT64_MAX;
+
+		for (size_t run = 0; run < NUM_RUNS_; run++) {
+			dsp::SSTEncoder encoder(dsp::SST_QUALITY_BEST, format);
+			const uint64_t  start = bench::getTime();
+
+			for (size_t i = 0; i < numSectors; i++)
+				encoder.encode(
+					output[i],
+					&input[i * sst::SAMPLES_PER_SECTOR],
+					sst::SAMPLES_PER_SECTOR
+				);
+
+			bestTime = util::min(bestTime, bench::getTime() - start);
+		}
+
+		const size_t numBlocks = numSectors * sst::BLOCKS_PER_SECTOR;
+
+		printf(
+			"  %d-bit: %8.0f blocks/s\n",
+			dsp::getSSTSampleBits(format),
+			double(numBlocks) * 1e9 / double(bestTime)
+		);
+
+		// Only the bytes actually used by the format are hashed.
+		for (size_t i = 0; i < numSectors; i++)
+			hash = bench::hash(
+				&output[i],
+				dsp::getSSTChunkLength(sst::BLOCKS_PER_SECTOR, format),
+				hash
+			);
+	}
+
+	printf("output hash: %08x\n", hash);
+
+	delete[] input;
+	delete[] output;
+	return 0;
+}
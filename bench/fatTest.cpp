@@ -0,0 +1,831 @@
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "bench/bench.hpp"
+#include "src/main/util/fat.hpp"
+
+/*
+ * FAT16/FAT32 extent resolver test. Builds disk images in memory (with and
+ * without an MBR) using a minimal FAT writer that is independent of the
+ * resolver, then checks that every file resolves to extents whose blocks match
+ * its contents, both directly and through ExtentFile. The images cover:
+ * - the fixed FAT16 root directory and fragmented FAT32 root cluster chains;
+ * - subdirectories spanning several fragmented clusters;
+ * - long names (including non-ASCII ones and names filling the last entry),
+ *   as well as long names with bad checksums or broken sequences, which must
+ *   only be reachable through their short names;
+ * - fragmented files, whose consecutive clusters must be merged into single
+ *   extents, and files with more than MAX_FILE_EXTENTS fragments.
+ */
+
+static constexpr char MOUNT_POINT_[] = "/fattest";
+
+/* On-disk structures */
+
+struct [[gnu::packed]] BPB_ {
+public:
+	uint8_t  jump[3];
+	char     oemName[8];
+	uint16_t blockLength;
+	uint8_t  blocksPerCluster;
+	uint16_t numReservedBlocks;
+	uint8_t  numFATs;
+	uint16_t numRootEntries, numBlocks16;
+	uint8_t  mediaType;
+	uint16_t fatLength16, blocksPerTrack, numHeads;
+	uint32_t numHiddenBlocks, numBlocks32;
+	uint32_t fatLength32;
+	uint16_t flags, version;
+	uint32_t rootCluster;
+};
+
+struct [[gnu::packed]] DirEntry_ {
+public:
+	char     name[11];
+	uint8_t  attributes, reserved[8];
+	uint16_t clusterHigh, modifyTime, modifyDate, clusterLow;
+	uint32_t length;
+};
+
+struct [[gnu::packed]] LFNEntry_ {
+public:
+	uint8_t  sequence;
+	uint16_t name1[5];
+	uint8_t  attributes, type, checksum;
+	uint16_t name2[6];
+	uint16_t cluster;
+	uint16_t name3[2];
+};
+
+static constexpr uint8_t ATTR_DIRECTORY_ = 1 << 4;
+static constexpr uint8_t ATTR_ARCHIVE_   = 1 << 5;
+static constexpr uint8_t ATTR_LFN_       = 0x0f;
+
+/* Image writer */
+
+class MemoryBlockDevice_ : public util::BlockDevice {
+public:
+	std::vector<uint8_t> data;
+
+	inline uint8_t *getBlock(uint32_t lba) {
+		return &data[size_t(lba) * util::BLOCK_LENGTH];
+	}
+	bool readBlocks(void *output, uint32_t lba, size_t numBlocks) override {
+		const size_t offset = size_t(lba) * util::BLOCK_LENGTH;
+		const size_t length = numBlocks * util::BLOCK_LENGTH;
+
+		if ((offset + length) > data.size())
+			return false;
+
+		memcpy(output, &data[offset], length);
+		return true;
+	}
+};
+
+class TestImage_ {
+public:
+	MemoryBlockDevice_    device;
+	std::vector<uint32_t> fat;
+
+	bool     isFAT32;
+	uint32_t baseLBA, numBlocks, blocksPerCluster, nextCluster;
+	uint32_t fatLBA, fatLength, rootLBA, numRootEntries, dataLBA;
+	uint32_t rootCluster;
+
+	TestImage_(
+		bool     fat32,
+		uint32_t totalBlocks,
+		uint32_t clusterBlocks,
+		uint32_t partitionLBA
+	);
+
+	inline size_t getClusterLength(void) const {
+		return blocksPerCluster * util::BLOCK_LENGTH;
+	}
+	inline uint32_t getClusterLBA(uint32_t cluster) const {
+		return dataLBA + (cluster - 2) * blocksPerCluster;
+	}
+
+	// Allocates a chain of clusters, leaving gap free clusters after every
+	// runLength ones in order to fragment it.
+	std::vector<uint32_t> allocate(
+		size_t count,
+		size_t runLength = SIZE_MAX,
+		size_t gap       = 0
+	);
+	void write(
+		const std::vector<uint32_t> &chain,
+		const void                  *data,
+		size_t                      length
+	);
+	void finish(void);
+};
+
+TestImage_::TestImage_(
+	bool     fat32,
+	uint32_t totalBlocks,
+	uint32_t clusterBlocks,
+	uint32_t partitionLBA
+) :
+	isFAT32(fat32),
+	baseLBA(partitionLBA),
+	numBlocks(totalBlocks - partitionLBA),
+	blocksPerCluster(clusterBlocks),
+	nextCluster(2),
+	rootCluster(0)
+{
+	const uint32_t numReserved = fat32 ? 32 : 4;
+	const uint32_t entryLength = fat32 ? 4 : 2;
+
+	numRootEntries = fat32 ? 0 : 512;
+
+	const uint32_t numRootBlocks =
+		numRootEntries * sizeof(DirEntry_) / util::BLOCK_LENGTH;
+	uint32_t       numClusters;
+
+	// The FAT's length depends on the number of clusters and vice versa.
+	for (fatLength = 1;;) {
+		const uint32_t dataLength =
+			numBlocks - numReserved - 2 * fatLength - numRootBlocks;
+		numClusters               = dataLength / blocksPerCluster;
+
+		const uint32_t required =
+			((numClusters + 2) * entryLength + util::BLOCK_LENGTH - 1)
+			/ util::BLOCK_LENGTH;
+
+		if (required <= fatLength)
+			break;
+
+		fatLength = required;
+	}
+
+	fatLBA  = baseLBA + numReserved;
+	rootLBA = fatLBA  + 2 * fatLength;
+	dataLBA = rootLBA + numRootBlocks;
+
+	device.data.assign(size_t(totalBlocks) * util::BLOCK_LENGTH, 0);
+	fat.assign(numClusters + 2, 0);
+	fat[0] = fat32 ? 0x0ffffff8 : 0xfff8;
+	fat[1] = fat32 ? 0x0fffffff : 0xffff;
+}
+
+std::vector<uint32_t> TestImage_::allocate(
+	size_t count,
+	size_t runLength,
+	size_t gap
+) {
+	std::vector<uint32_t> chain;
+
+	for (size_t i = 0; i < count; i++) {
+		if (i && !(i % runLength))
+			nextCluster += gap;
+
+		chain.push_back(nextCluster++);
+	}
+
+	for (size_t i = 0; i < count; i++)
+		fat[chain[i]] = ((i + 1) < count)
+			? chain[i + 1]
+			: (isFAT32 ? 0x0fffffff : 0xffff);
+
+	return chain;
+}
+
+void TestImage_::write(
+	const std::vector<uint32_t> &chain,
+	const void                  *data,
+	size_t                      length
+) {
+	auto ptr = reinterpret_cast<const uint8_t *>(data);
+
+	for (uint32_t cluster : chain) {
+		const size_t chunkLength = util::min(length, getClusterLength());
+
+		memcpy(device.getBlock(getClusterLBA(cluster)), ptr, chunkLength);
+		ptr    += chunkLength;
+		length -= chunkLength;
+	}
+}
+
+void TestImage_::finish(void) {
+	for (int i = 0; i < 2; i++) {
+		auto ptr = device.getBlock(fatLBA + i * fatLength);
+
+		for (uint32_t entry : fat) {
+			memcpy(ptr, &entry, isFAT32 ? 4 : 2);
+			ptr += isFAT32 ? 4 : 2;
+		}
+	}
+
+	auto block = device.getBlock(baseLBA);
+	auto bpb   = reinterpret_cast<BPB_ *>(block);
+
+	bpb->jump[0]           = 0xeb;
+	bpb->jump[1]           = 0x58;
+	bpb->jump[2]           = 0x90;
+	bpb->blockLength       = util::BLOCK_LENGTH;
+	bpb->blocksPerCluster  = uint8_t(blocksPerCluster);
+	bpb->numReservedBlocks = uint16_t(fatLBA - baseLBA);
+	bpb->numFATs           = 2;
+	bpb->numRootEntries    = uint16_t(numRootEntries);
+	bpb->mediaType         = 0xf8;
+	bpb->numHiddenBlocks   = baseLBA;
+	memcpy(bpb->oemName, "FATTEST ", 8);
+
+	if (numBlocks < 0x10000)
+		bpb->numBlocks16 = uint16_t(numBlocks);
+	else
+		bpb->numBlocks32 = numBlocks;
+
+	if (isFAT32) {
+		bpb->fatLength32 = fatLength;
+		bpb->rootCluster = rootCluster;
+	} else {
+		bpb->fatLength16 = uint16_t(fatLength);
+	}
+
+	block[510] = 0x55;
+	block[511] = 0xaa;
+
+	// Add an MBR with a single partition if the volume does not start at the
+	// beginning of the image.
+	if (baseLBA) {
+		auto mbr = device.getBlock(0);
+
+		mbr[446 + 4] = isFAT32 ? 0x0c : 0x06;
+		memcpy(&mbr[446 + 8],  &baseLBA,   4);
+		memcpy(&mbr[446 + 12], &numBlocks, 4);
+		mbr[510] = 0x55;
+		mbr[511] = 0xaa;
+	}
+}
+
+/* Directory writer */
+
+enum LongNameFlag_ {
+	LFN_VALID         = 0,
+	LFN_BAD_CHECKSUM  = 1, // All entries have the wrong checksum
+	LFN_MIX_CHECKSUM  = 2, // Only the last entry has the wrong checksum
+	LFN_SKIP_SEQUENCE = 3  // The second entry is missing
+};
+
+// Directories reserve space for a fixed number of entries up front, so that
+// their clusters are known before any children are added. The root directory
+// of FAT16 volumes is written to its fixed area instead.
+class TestDirectory_ {
+public:
+	TestImage_            &image;
+	std::vector<uint32_t> chain;
+	std::vector<uint8_t>  entries;
+
+	TestDirectory_(
+		TestImage_ &image,
+		size_t     numEntries,
+		bool       isRoot,
+		uint32_t   parentCluster = 0
+	);
+
+	inline uint32_t getCluster(void) const {
+		return chain.empty() ? 0 : chain[0];
+	}
+
+	void addEntry(
+		const char *shortName,
+		uint8_t    attributes,
+		uint32_t   cluster,
+		uint32_t   length
+	);
+	void addLongName(
+		const std::u16string &name,
+		const char           *shortName,
+		LongNameFlag_        flag = LFN_VALID
+	);
+	void addDeletedEntry(const char *shortName);
+	void finish(void);
+};
+
+TestDirectory_::TestDirectory_(
+	TestImage_ &image,
+	size_t     numEntries,
+	bool       isRoot,
+	uint32_t   parentCluster
+) :
+	image(image)
+{
+	if (!isRoot || image.isFAT32) {
+		// Directory clusters are fragmented as well, so that the resolver has
+		// to follow their chains.
+		const size_t length    = numEntries * sizeof(DirEntry_);
+		const size_t numChunks =
+			(length + image.getClusterLength() - 1) / image.getClusterLength();
+
+		chain = image.allocate(numChunks, 2, 1);
+	}
+	if (isRoot) {
+		image.rootCluster = getCluster();
+		return;
+	}
+
+	addEntry(".          ", ATTR_DIRECTORY_, getCluster(),  0);
+	addEntry("..         ", ATTR_DIRECTORY_, parentCluster, 0);
+}
+
+void TestDirectory_::addEntry(
+	const char *shortName,
+	uint8_t    attributes,
+	uint32_t   cluster,
+	uint32_t   length
+) {
+	DirEntry_ entry;
+
+	memset(&entry, 0, sizeof(entry));
+	memcpy(entry.name, shortName, sizeof(entry.name));
+	entry.attributes  = attributes;
+	entry.clusterHigh = uint16_t(cluster >> 16);
+	entry.clusterLow  = uint16_t(cluster);
+	entry.length      = length;
+
+	auto ptr = reinterpret_cast<const uint8_t *>(&entry);
+
+	entries.insert(entries.end(), ptr, ptr + sizeof(entry));
+}
+
+void TestDirectory_::addLongName(
+	const std::u16string &name,
+	const char           *shortName,
+	LongNameFlag_        flag
+) {
+	uint8_t checksum = 0;
+
+	for (int i = 0; i < 11; i++)
+		checksum = uint8_t(
+			((checksum & 1) << 7) + (checksum >> 1) + uint8_t(shortName[i])
+		);
+
+	if (flag == LFN_BAD_CHECKSUM)
+		checksum ^= 0x5a;
+
+	// Names are null terminated and padded with 0xffff, unless they fill the
+	// last entry.
+	std::u16string units = name;
+
+	if (units.size() % 13) {
+		units.push_back(0);
+
+		while (units.size() % 13)
+			units.push_back(0xffff);
+	}
+
+	const int numEntries = int(units.size() / 13);
+
+	for (int i = numEntries; i > 0; i--) {
+		if ((flag == LFN_SKIP_SEQUENCE) && (i == 2))
+			continue;
+
+		LFNEntry_ entry;
+		auto      chars = &units[(i - 1) * 13];
+
+		memset(&entry, 0, sizeof(entry));
+		entry.sequence   = uint8_t(i | ((i == numEntries) ? 0x40 : 0));
+		entry.attributes = ATTR_LFN_;
+		entry.checksum   = checksum;
+
+		if ((flag == LFN_MIX_CHECKSUM) && (i == 1))
+			entry.checksum ^= 0x5a;
+		memcpy(entry.name1, &chars[0],  sizeof(entry.name1));
+		memcpy(entry.name2, &chars[5],  sizeof(entry.name2));
+		memcpy(entry.name3, &chars[11], sizeof(entry.name3));
+
+		auto ptr = reinterpret_cast<const uint8_t *>(&entry);
+
+		entries.insert(entries.end(), ptr, ptr + sizeof(entry));
+	}
+}
+
+void TestDirectory_::addDeletedEntry(const char *shortName) {
+	addEntry(shortName, ATTR_ARCHIVE_, 0, 0);
+	entries[entries.size() - sizeof(DirEntry_)] = 0xe5;
+}
+
+void TestDirectory_::finish(void) {
+	if (chain.empty()) {
+		const size_t maxLength = image.numRootEntries * sizeof(DirEntry_);
+
+		memcpy(
+			image.device.getBlock(image.rootLBA),
+			entries.data(),
+			util::min(entries.size(), maxLength)
+		);
+	} else {
+		image.write(chain, entries.data(), entries.size());
+	}
+}
+
+/* Test cases */
+
+struct TestFile_ {
+public:
+	std::string          path;
+	std::vector<uint8_t> data;
+	size_t               numExtents;
+};
+
+class FATTest_ {
+private:
+	TestImage_             image_;
+	std::vector<TestFile_> files_;
+	bench::Random          random_;
+	int                    numFailures_;
+
+	void fail_(const char *format, const char *path);
+
+public:
+	inline FATTest_(bool fat32, uint32_t partitionLBA) :
+		image_(
+			fat32,
+			(fat32 ? 68000 : 16384) + partitionLBA,
+			fat32 ? 1 : 2,
+			partitionLBA
+		),
+		numFailures_(0)
+	{}
+
+	inline int getNumFailures(void) const {
+		return numFailures_;
+	}
+
+	void addFile(
+		TestDirectory_       &dir,
+		const char           *path,
+		const std::u16string &longName,
+		const char           *shortName,
+		size_t               length,
+		size_t               runLength = SIZE_MAX,
+		LongNameFlag_        flag      = LFN_VALID
+	);
+	void build(void);
+	void checkFiles(util::FATVolume &volume);
+	void checkLookups(util::FATVolume &volume);
+	void checkExtentFile(util::FATVolume &volume);
+	void run(void);
+};
+
+void FATTest_::fail_(const char *format, const char *path) {
+	printf("  FAILED: ");
+	printf(format, path);
+	printf("\n");
+	numFailures_++;
+}
+
+void FATTest_::addFile(
+	TestDirectory_       &dir,
+	const char           *path,
+	const std::u16string &longName,
+	const char           *shortName,
+	size_t               length,
+	size_t               runLength,
+	LongNameFlag_        flag
+) {
+	TestFile_ file;
+
+	file.path = path;
+	file.data.resize(length);
+
+	for (auto &byte : file.data)
+		byte = uint8_t(random_.next());
+
+	const size_t numClusters =
+		(length + image_.getClusterLength() - 1) / image_.getClusterLength();
+	auto         chain       = image_.allocate(numClusters, runLength, 1);
+
+	image_.write(chain, file.data.data(), length);
+
+	// Count the runs of consecutive clusters, which the resolver is expected
+	// to merge into a single extent each.
+	file.numExtents = 0;
+
+	for (size_t i = 0; i < chain.size(); i++) {
+		if (!i || (chain[i] != (chain[i - 1] + 1)))
+			file.numExtents++;
+	}
+
+	if (!longName.empty())
+		dir.addLongName(longName, shortName, flag);
+
+	dir.addEntry(shortName, ATTR_ARCHIVE_, chain[0], uint32_t(length));
+	files_.push_back(file);
+}
+
+void FATTest_::build(void) {
+	// The FAT32 root directory spans several clusters, while the FAT16 one
+	// fits in its fixed area.
+	TestDirectory_ root(image_, 200, true);
+
+	for (int i = 0; i < 40; i++) {
+		char           path[64], shortName[12];
+		std::u16string longName = u"Track ";
+
+		snprintf(path, sizeof(path), "/Track %02d - Some Title.sst", i);
+		snprintf(shortName, sizeof(shortName), "TRACK~%02dSST", i);
+		longName += char16_t('0' + i / 10);
+		longName += char16_t('0' + i % 10);
+		longName += u" - Some Title.sst";
+
+		addFile(root, path, longName, shortName, 700 + i * 131);
+	}
+
+	TestDirectory_ music(image_, 160, false, 0);
+	TestDirectory_ deep(image_, 8, false, music.getCluster());
+
+	root.addEntry("MUSIC      ", ATTR_DIRECTORY_, music.getCluster(), 0);
+	music.addEntry("DEEP       ", ATTR_DIRECTORY_, deep.getCluster(), 0);
+
+	for (int i = 0; i < 30; i++) {
+		char           path[64], shortName[12];
+		std::u16string longName = u"Filler ";
+
+		snprintf(path, sizeof(path), "/MUSIC/Filler %02d.sst", i);
+		snprintf(shortName, sizeof(shortName), "FILLER%02dSST", i);
+		longName += char16_t('0' + i / 10);
+		longName += char16_t('0' + i % 10);
+		longName += u".sst";
+
+		addFile(music, path, longName, shortName, 3000);
+	}
+
+	addFile(
+		music,
+		"/music/Ünïcödé \U0001f3b5 mix.sst",
+		u"Ünïcödé \U0001f3b5 mix.sst",
+		"NCD~1   SST",
+		20000
+	);
+	addFile(
+		music, "/music/ABCDEFGHIJKLM", u"ABCDEFGHIJKLM", "ABCDEF~1   ", 5000
+	);
+
+	// Fragmented files, split into runs of 4 clusters and single clusters
+	// respectively. The latter hit the extent limit exactly or exceed it.
+	const size_t clusterLength = image_.getClusterLength();
+
+	addFile(
+		music,
+		"/music/fragmented.sst",
+		u"fragmented.sst",
+		"FRAGME~1SST",
+		40 * clusterLength - 100,
+		4
+	);
+	addFile(
+		music,
+		"/music/exactly32.sst",
+		u"exactly32.sst",
+		"EXACTL~1SST",
+		32 * clusterLength,
+		1
+	);
+	addFile(
+		music,
+		"/music/overflow.sst",
+		u"overflow.sst",
+		"OVERFL~1SST",
+		33 * clusterLength,
+		1
+	);
+
+	// Long names whose checksum or sequence is broken must be ignored, leaving
+	// the entries only reachable by their short names.
+	addFile(
+		music,
+		"/music/BADCHE~1.SST",
+		u"bad checksum.sst",
+		"BADCHE~1SST",
+		1500,
+		SIZE_MAX,
+		LFN_BAD_CHECKSUM
+	);
+	addFile(
+		music,
+		"/music/BADMIX~1.SST",
+		u"mixed checksum.sst",
+		"BADMIX~1SST",
+		1500,
+		SIZE_MAX,
+		LFN_MIX_CHECKSUM
+	);
+	addFile(
+		music,
+		"/music/BADSEQ~1.SST",
+		u"a long name with a missing middle entry.sst",
+		"BADSEQ~1SST",
+		1500,
+		SIZE_MAX,
+		LFN_SKIP_SEQUENCE
+	);
+
+	// A deleted entry preceded by a valid long name must not be matched, nor
+	// leak its name onto the following entry.
+	music.addLongName(u"deleted.sst", "DELETE~1SST");
+	music.addDeletedEntry("DELETE~1SST");
+	addFile(music, "/music/AFTERDEL.SST", u"", "AFTERDELSST", 1000);
+
+	addFile(
+		deep,
+		"/Music/Deep/nested file.sst",
+		u"nested file.sst",
+		"NESTED~1SST",
+		9000
+	);
+
+	root.finish();
+	music.finish();
+	deep.finish();
+	image_.finish();
+}
+
+void FATTest_::checkFiles(util::FATVolume &volume) {
+	util::FATExtent extents[util::MAX_FILE_EXTENTS];
+	uint8_t         block[util::BLOCK_LENGTH];
+
+	for (auto &file : files_) {
+		const char *path       = file.path.c_str();
+		size_t     length      = 0;
+		size_t     numExtents  = volume.resolve(
+			extents,
+			util::MAX_FILE_EXTENTS,
+			length,
+			path
+		);
+
+		if (file.numExtents > util::MAX_FILE_EXTENTS) {
+			if (numExtents)
+				fail_("%s: resolved despite too many fragments", path);
+
+			continue;
+		}
+		if (numExtents != file.numExtents) {
+			fail_("%s: wrong number of extents", path);
+			continue;
+		}
+		if (length != file.data.size()) {
+			fail_("%s: wrong length", path);
+			continue;
+		}
+
+		// Read back the file's contents through the extents.
+		size_t offset = 0;
+
+		for (size_t i = 0; i < numExtents; i++) {
+			for (uint32_t j = 0; j < extents[i].numBlocks; j++) {
+				if (!image_.device.readBlocks(block, extents[i].lba + j, 1)) {
+					fail_("%s: extent out of bounds", path);
+					break;
+				}
+
+				const size_t chunkLength =
+					util::min(util::BLOCK_LENGTH, length - offset);
+
+				if (memcmp(block, &file.data[offset], chunkLength)) {
+					fail_("%s: data mismatch", path);
+					break;
+				}
+
+				offset += chunkLength;
+			}
+		}
+	}
+}
+
+void FATTest_::checkLookups(util::FATVolume &volume) {
+	static const char *const MISSING_PATHS_[]{
+		"/music/bad checksum.sst",
+		"/music/mixed checksum.sst",
+		"/music/a long name with a missing middle entry.sst",
+		"/music/deleted.sst",
+		"/music/nonexistent.sst",
+		"/music/fragmented.sst/file",
+		"/music",
+		"/music/deep",
+		"/"
+	};
+	static const char *const ALIAS_PATHS_[]{
+		"/TRACK~07.SST",
+		"/music/../Track 07 - Some Title.sst",
+		"//MUSIC///deep/../../track 07 - SOME TITLE.SST"
+	};
+
+	util::FATExtent extents[util::MAX_FILE_EXTENTS];
+	size_t          length;
+
+	for (auto path : MISSING_PATHS_) {
+		if (volume.resolve(extents, util::MAX_FILE_EXTENTS, length, path))
+			fail_("%s: resolved a missing file or directory", path);
+	}
+
+	// Alternate spellings (short names, case, redundant separators and ".."
+	// entries) must all lead to the same file.
+	for (auto path : ALIAS_PATHS_) {
+		if (
+			!volume.resolve(extents, util::MAX_FILE_EXTENTS, length, path) ||
+			(length != files_[7].data.size())
+		)
+			fail_("%s: alias not resolved", path);
+	}
+}
+
+void FATTest_::checkExtentFile(util::FATVolume &volume) {
+	util::ExtentFile file;
+
+	file.setVolume(volume, MOUNT_POINT_);
+
+	for (auto &testFile : files_) {
+		auto path = std::string(MOUNT_POINT_) + testFile.path;
+
+		// Overly fragmented files fall back to stdio, which will fail to open
+		// them as the mount point does not exist.
+		if (!file.open(path.c_str())) {
+			if (testFile.numExtents <= util::MAX_FILE_EXTENTS)
+				fail_("%s: ExtentFile::open() failed", testFile.path.c_str());
+
+			continue;
+		}
+		if (!file.isRaw()) {
+			fail_("%s: ExtentFile fell back to stdio", testFile.path.c_str());
+			continue;
+		}
+
+		// Issue reads of random lengths at random (mostly unaligned) offsets.
+		const size_t length = testFile.data.size();
+		uint8_t      buffer[4096];
+
+		for (int i = 0; i < 64; i++) {
+			const size_t offset      = random_.next() % length;
+			const size_t chunkLength = util::min(
+				size_t(random_.next() % sizeof(buffer)) + 1,
+				length - offset
+			);
+
+			if (
+				!file.read(buffer, chunkLength, offset) ||
+				memcmp(buffer, &testFile.data[offset], chunkLength)
+			) {
+				fail_("%s: ExtentFile::read() mismatch", testFile.path.c_str());
+				break;
+			}
+		}
+
+		if (file.read(buffer, 2, length - 1))
+			fail_("%s: read past the end succeeded", testFile.path.c_str());
+
+		file.close();
+	}
+}
+
+void FATTest_::run(void) {
+	build();
+
+	util::FATVolume volume;
+
+	if (!volume.mount(image_.device)) {
+		fail_("%s: mount failed", image_.isFAT32 ? "FAT32" : "FAT16");
+		return;
+	}
+
+	checkFiles(volume);
+	checkLookups(volume);
+	checkExtentFile(volume);
+}
+
+int main(void) {
+	static const struct {
+		bool     fat32;
+		uint32_t partitionLBA;
+	} CONFIGS_[]{
+		{ false,    0 },
+		{ false,   63 },
+		{ true,     0 },
+		{ true,  2048 }
+	};
+
+	int numFailures = 0;
+
+	for (auto &config : CONFIGS_) {
+		printf(
+			"fat: %s, %s\n",
+			config.fat32 ? "FAT32" : "FAT16",
+			config.partitionLBA ? "MBR" : "no MBR"
+		);
+
+		FATTest_ test(config.fat32, config.partitionLBA);
+
+		test.run();
+		numFailures += test.getNumFailures();
+	}
+
+	printf("%d failures\n", numFailures);
+	return numFailures ? 1 : 0;
+}
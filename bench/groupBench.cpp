@@ -0,0 +1,160 @@
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+#include "bench/bench.hpp"
+#include "src/main/util/file.hpp"
+#include "src/main/sst.hpp"
+
+/*
+ * Variant-grouped layout benchmark. Writes a synthetic 5-variant .sst file for
+ * each group length (K), evicts it from the page cache and streams it through
+ * sst::Reader::readBatch() in 4-chunk batches (as issued by the stream task),
+ * switching to another variant every few chunks. Reports the average time per
+ * chunk and the median latency of the first batch read after each switch.
+ *
+ * Eviction relies on posix_fadvise(POSIX_FADV_DONTNEED), which has no effect on
+ * tmpfs; the benchmark should be run from a directory on a real disk.
+ */
+
+static constexpr size_t NUM_VARIANTS_   = 5;
+static constexpr int    BATCH_LENGTH_   = 4;
+static constexpr int    SWITCH_PERIOD_  = 50;
+static constexpr char   DEFAULT_PATH_[] = "groupBench.sst";
+
+static const int GROUP_LENGTHS_[]{ 1, 4, 8, 16, 32 };
+
+static bool evictFile_(const char *path) {
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return false;
+
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+	return true;
+}
+
+static bool runBenchmark_(
+	util::File &file,
+	const char *path,
+	int        numChunks,
+	double     &chunkTime,
+	double     &switchTime
+) {
+	if (!evictFile_(path))
+		return false;
+
+	sst::Reader reader;
+
+	reader.setBackend(file);
+
+	if (!reader.open(path))
+		return false;
+
+	const int numSwitches = numChunks / SWITCH_PERIOD_;
+	auto      times       = new uint64_t[numSwitches + 1];
+	int       switchIndex = 0;
+
+	sst::SSTSector       batch[BATCH_LENGTH_];
+	sst::SSTSectorFormat format;
+	bool                 ok = true;
+
+	const uint64_t start = bench::getTime();
+
+	for (int chunk = 0; ok && (chunk < numChunks);) {
+		// Time the first read following each variant switch separately.
+		const bool     switched  = !(chunk % SWITCH_PERIOD_) && chunk;
+		const uint64_t readStart = bench::getTime();
+
+		if (switched)
+			reader.setVariant((reader.getVariant() + 1) % NUM_VARIANTS_);
+
+		const int length = util::min(
+			BATCH_LENGTH_,
+			SWITCH_PERIOD_ - (chunk % SWITCH_PERIOD_)
+		);
+		const int numRead = reader.readBatch(
+			batch[0].data,
+			format,
+			chunk,
+			length
+		);
+
+		if (switched)
+			times[switchIndex++] = bench::getTime() - readStart;
+
+		ok     = numRead > 0;
+		chunk += numRead;
+	}
+
+	chunkTime = double(bench::getTime() - start) / double(numChunks) / 1e3;
+
+	std::sort(times, times + switchIndex);
+	switchTime = switchIndex ? (double(times[switchIndex / 2]) / 1e3) : 0.0;
+
+	delete[] times;
+	return ok;
+}
+
+int main(int argc, const char **argv) {
+	const bool quick     = bench::hasOption(argc, argv, "--quick");
+	const int  numChunks = quick ? 200 : 3000;
+
+	util::StdioFile stdioFile;
+	util::POSIXFile posixFile;
+
+	printf(
+		"groups: %d chunks x %zu variants, %d-chunk batches, "
+		"variant switch every %d chunks\n",
+		numChunks,
+		NUM_VARIANTS_,
+		BATCH_LENGTH_,
+		SWITCH_PERIOD_
+	);
+	printf("   K  stdio us/chunk  pread us/chunk  pread switch p50\n");
+
+	bool ok = true;
+
+	for (int groupLength : GROUP_LENGTHS_) {
+		ok = bench::writeTestSST(
+			DEFAULT_PATH_,
+			numChunks,
+			NUM_VARIANTS_,
+			groupLength
+		);
+
+		if (!ok) {
+			fprintf(stderr, "could not write %s\n", DEFAULT_PATH_);
+			break;
+		}
+
+		double stdioChunk, stdioSwitch, posixChunk, posixSwitch;
+
+		ok = true
+			&& runBenchmark_(
+				stdioFile, DEFAULT_PATH_, numChunks, stdioChunk, stdioSwitch
+			)
+			&& runBenchmark_(
+				posixFile, DEFAULT_PATH_, numChunks, posixChunk, posixSwitch
+			);
+
+		if (!ok)
+			break;
+
+		printf(
+			"  %2d  %14.1f  %14.1f  %13.1f us\n",
+			groupLength,
+			stdioChunk,
+			posixChunk,
+			posixSwitch
+		);
+	}
+
+	unlink(DEFAULT_PATH_);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,264 @@
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench/bench.hpp"
+#include "src/main/dsp/adpcm.hpp"
+#include "src/main/sst.hpp"
+
+/*
+ * Sampler interpolation kernel benchmark. This file is built once per kernel
+ * (with SST_SAMPLER_KERNEL set accordingly) and reports:
+ *
+ * - the cost in CPU cycles per output frame when playing silent sectors at a
+ *   fractional speed, which excludes ADPCM decoding;
+ * - the SNR of the sampler's output when playing back ADPCM encoded tones at
+ *   several speeds, against an ideal (128-tap windowed sinc) interpolation of
+ *   the same decoded samples. This measures the kernel's aliasing and imaging
+ *   error on top of the codec's, not the codec's own noise.
+ *
+ * The benchmark fails if 1:1 playback does not reproduce the decoded samples
+ * exactly.
+ */
+
+static constexpr size_t NUM_RUNS_       = 5;
+static constexpr size_t BUFFER_SIZE_    = 256;
+static constexpr size_t NUM_SECTORS_    = 64;
+static constexpr int    FIRST_CHUNK_    = 4;
+static constexpr int    REFERENCE_TAPS_ = 128;
+static constexpr double SAMPLE_RATE_    = 44100.0;
+static constexpr double CYCLES_SPEED_   = 1.37;
+
+static const double TONES_[]{ 1000.0, 9000.0, 15000.0 };
+static const double SPEEDS_[]{ 1.37, 0.91, -0.73 };
+
+static const char *const KERNEL_NAMES_[]{
+	"linear (2 taps)",
+	"cubic Hermite (4 taps)",
+	"windowed sinc (8 taps)"
+};
+
+static constexpr size_t NUM_SAMPLES_ =
+	NUM_SECTORS_ * sst::SAMPLES_PER_SECTOR;
+
+using Frame_ = dsp::Sample[sst::NUM_CHANNELS];
+
+/* Test signal */
+
+// Mono sectors holding an encoded tone, along with the decoded samples the
+// sampler is expected to interpolate between.
+class ToneSource_ {
+public:
+	sst::SSTSector sectors[NUM_SECTORS_];
+	dsp::Sample    decoded[NUM_SAMPLES_];
+
+	void generate(double frequency) {
+		auto input = new dsp::Sample[NUM_SAMPLES_];
+
+		for (size_t i = 0; i < NUM_SAMPLES_; i++)
+			input[i] = dsp::Sample(lrint(
+				16000.0 * sin(2.0 * M_PI * frequency * double(i) / SAMPLE_RATE_)
+			));
+
+		dsp::SSTEncoder encoder(dsp::SST_QUALITY_BEST, dsp::SST_FORMAT_4BIT);
+
+		for (size_t i = 0; i < NUM_SECTORS_; i++) {
+			const size_t offset = i * sst::SAMPLES_PER_SECTOR;
+
+			memset(&sectors[i], 0, sizeof(sst::SSTSector));
+			encoder.encode(
+				sectors[i].channels[0],
+				&input[offset],
+				sst::SAMPLES_PER_SECTOR
+			);
+			dsp::decodeSST(&decoded[offset], sectors[i].channels[0]);
+		}
+
+		delete[] input;
+	}
+
+	static const sst::SSTSector *read(
+		int                  chunk,
+		sst::SSTSectorFormat &format,
+		void                 *arg
+	) {
+		auto source = reinterpret_cast<ToneSource_ *>(arg);
+
+		if ((chunk < 0) || (chunk >= int(NUM_SECTORS_)))
+			return nullptr;
+
+		memset(&format, 0, sizeof(format));
+		format.numChannels     = 1;
+		format.blockFormats[0] = dsp::SST_FORMAT_4BIT;
+		return &source->sectors[chunk];
+	}
+
+	// Blackman-windowed sinc interpolation in double precision, long enough
+	// for its own error to be well below that of any kernel under test.
+	double interpolate(double position) const {
+		constexpr int halfLength = REFERENCE_TAPS_ / 2;
+
+		const int first = int(floor(position)) - halfLength + 1;
+		const int last  = int(floor(position)) + halfLength;
+
+		double value = 0.0;
+
+		for (int i = first; i <= last; i++) {
+			const double x = position - double(i);
+			const double a = M_PI * x;
+			const double w = M_PI * x / double(halfLength);
+
+			const double sinc   = (x == 0.0) ? 1.0 : (sin(a) / a);
+			const double window = 0.42 + 0.5 * cos(w) + 0.08 * cos(2.0 * w);
+
+			value += double(decoded[i]) * sinc * window;
+		}
+
+		return value;
+	}
+};
+
+/* Benchmarks */
+
+static double measureCycles_(size_t numBuffers) {
+	bench::TestSectorSource source(sst::SST_FLAG_SILENT);
+	sst::Sampler            sampler;
+	Frame_                  output[BUFFER_SIZE_];
+
+	source.attach(sampler);
+	sampler.allocate(4);
+
+	const int step      = int(CYCLES_SPEED_ * sst::SAMPLE_OFFSET_UNIT);
+	uint64_t  bestTotal = UINT64_MAX;
+
+	for (size_t run = 0; run < NUM_RUNS_; run++) {
+		int64_t position = int64_t(1000 * sst::SAMPLES_PER_SECTOR)
+			<< sst::SAMPLE_OFFSET_BITS;
+
+		sampler.flush();
+		const uint64_t start = bench::getCycles();
+
+		for (size_t i = 0; i < numBuffers; i++)
+			position = sampler.process(
+				output[0],
+				position,
+				step,
+				BUFFER_SIZE_
+			);
+
+		bestTotal = util::min(bestTotal, bench::getCycles() - start);
+	}
+
+	return double(bestTotal) / double(numBuffers * BUFFER_SIZE_);
+}
+
+static double measureSNR_(
+	ToneSource_ &source,
+	double      speed,
+	size_t      numBuffers
+) {
+	sst::Sampler sampler;
+	Frame_       output[BUFFER_SIZE_];
+
+	sampler.setCallbacks(&ToneSource_::read, nullptr, &source);
+	sampler.allocate(4);
+
+	// Play forwards from the start or backwards from the end of the tone, at
+	// an offset that is not a multiple of the step.
+	const int     step     = int(speed * sst::SAMPLE_OFFSET_UNIT);
+	const int64_t length   = int64_t(NUM_SECTORS_ - 2 * FIRST_CHUNK_)
+		* int64_t(sst::SAMPLES_PER_SECTOR) << sst::SAMPLE_OFFSET_BITS;
+	const int64_t first    = int64_t(FIRST_CHUNK_ * sst::SAMPLES_PER_SECTOR)
+		<< sst::SAMPLE_OFFSET_BITS;
+	int64_t       position = first + ((step > 0) ? 0 : length) + 777;
+
+	numBuffers = util::min(
+		numBuffers,
+		size_t(length / (int64_t(abs(step)) * BUFFER_SIZE_))
+	);
+
+	double signal = 0.0, error = 0.0;
+
+	for (size_t i = 0; i < numBuffers; i++) {
+		sampler.process(output[0], position, step, BUFFER_SIZE_);
+
+		for (size_t j = 0; j < BUFFER_SIZE_; j++, position += step) {
+			const double reference = source.interpolate(
+				double(position) / double(sst::SAMPLE_OFFSET_UNIT)
+			);
+			const double delta     = double(output[j][0]) - reference;
+
+			signal += reference * reference;
+			error  += delta * delta;
+		}
+	}
+
+	return 10.0 * log10(signal / error);
+}
+
+static bool checkIdentity_(ToneSource_ &source) {
+	sst::Sampler sampler;
+	Frame_       output[BUFFER_SIZE_];
+
+	sampler.setCallbacks(&ToneSource_::read, nullptr, &source);
+	sampler.allocate(4);
+
+	for (size_t i = 0; i < NUM_SAMPLES_ / BUFFER_SIZE_; i++) {
+		sampler.process(
+			output[0],
+			int64_t(i * BUFFER_SIZE_) << sst::SAMPLE_OFFSET_BITS,
+			sst::SAMPLE_OFFSET_UNIT,
+			BUFFER_SIZE_
+		);
+
+		for (size_t j = 0; j < BUFFER_SIZE_; j++) {
+			const auto sample = source.decoded[i * BUFFER_SIZE_ + j];
+
+			if ((output[j][0] != sample) || (output[j][1] != sample))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, const char **argv) {
+	const bool   quick      = bench::hasOption(argc, argv, "--quick");
+	const size_t numBuffers = quick ? 20 : 20000;
+
+	printf("kernel: %s\n", KERNEL_NAMES_[sst::SAMPLER_KERNEL]);
+	printf(
+		"  %5.1f cycles/frame at x%.2f (silent sectors)\n",
+		measureCycles_(numBuffers),
+		CYCLES_SPEED_
+	);
+	printf("  SNR (dB)");
+
+	for (double speed : SPEEDS_)
+		printf("   x%5.2f", speed);
+
+	printf("\n");
+
+	auto source = new ToneSource_;
+	bool ok     = true;
+
+	for (double tone : TONES_) {
+		source->generate(tone);
+		ok = ok && checkIdentity_(*source);
+
+		printf("  %5.0f Hz", tone);
+
+		for (double speed : SPEEDS_)
+			printf(" %8.1f", measureSNR_(*source, speed, numBuffers));
+
+		printf("\n");
+	}
+
+	printf("1:1 playback %s\n", ok ? "matches decoder" : "DIFFERS");
+
+	delete source;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,207 @@
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "bench/bench.hpp"
+#include "src/main/sst.hpp"
+
+/*
+ * Sampler loop wrapping test. Plays loops of various lengths (with fractional
+ * end points) at several forward and reverse speeds, starting inside, before
+ * and after the loop, and checks that:
+ *
+ * - the position returned after each buffer matches a per-sample reference,
+ *   which wraps the position as soon as it crosses the boundary in the
+ *   direction of playback;
+ * - rendering a buffer in one call produces the same output as rendering it
+ *   one sample at a time, i.e. the loop wraps (and the crossfade starts) at
+ *   the exact sample regardless of where buffers are split;
+ * - playing without a loop is unaffected by a loop previously being set.
+ */
+
+static constexpr size_t BUFFER_SIZE_ = 256;
+static constexpr size_t NUM_BUFFERS_ = 200;
+static constexpr int    LOOP_CHUNK_  = 100;
+
+static const double LOOP_LENGTHS_[]{ 85.0, 301.5, 1377.25, 4000.75 };
+static const double SPEEDS_[]{ 1.0, 2.5, 0.73, -1.0, -1.37, -0.5 };
+
+// Where playback starts relative to the loop.
+enum StartPosition_ {
+	START_INSIDE = 0,
+	START_BEFORE = 1,
+	START_AFTER  = 2
+};
+
+static const char *const START_NAMES_[]{
+	"inside",
+	"before",
+	"after"
+};
+
+using Frame_ = dsp::Sample[sst::NUM_CHANNELS];
+
+static int64_t wrapReference_(
+	int64_t position,
+	int     step,
+	int64_t loopStart,
+	int64_t loopEnd
+) {
+	const int64_t loopLength = loopEnd - loopStart;
+
+	while ((step > 0) && (position >= loopEnd))
+		position -= loopLength;
+	while ((step < 0) && (position < loopStart))
+		position += loopLength;
+
+	return position;
+}
+
+static bool runTest_(
+	bench::TestSectorSource &source,
+	double                  loopLength,
+	double                  speed,
+	StartPosition_          start
+) {
+	constexpr int64_t unit = sst::SAMPLE_OFFSET_UNIT;
+
+	const int64_t loopStart = (
+		int64_t(LOOP_CHUNK_ * sst::SAMPLES_PER_SECTOR) + 123
+	) * unit;
+	const int64_t loopEnd   = loopStart + int64_t(loopLength * double(unit));
+	const int     step      = int(speed * double(unit));
+
+	int64_t position;
+
+	switch (start) {
+		case START_BEFORE:
+			position = loopStart - 500 * unit;
+			break;
+
+		case START_AFTER:
+			position = loopEnd + 500 * unit;
+			break;
+
+		default:
+			position = loopStart + (loopEnd - loopStart) / 3;
+	}
+
+	sst::Sampler sampler, splitSampler;
+	Frame_       output[BUFFER_SIZE_], splitOutput[BUFFER_SIZE_];
+
+	source.attach(sampler);
+	source.attach(splitSampler);
+	sampler.allocate(4);
+	splitSampler.allocate(4);
+	sampler.setLoop(loopStart, loopEnd);
+	splitSampler.setLoop(loopStart, loopEnd);
+
+	// The reference only wraps positions past the boundary in the direction
+	// of playback, both initially and after each sample.
+	int64_t reference     = wrapReference_(position, step, loopStart, loopEnd);
+	int64_t splitPosition = position;
+
+	for (size_t i = 0; i < NUM_BUFFERS_; i++) {
+		position = sampler.process(output[0], position, step, BUFFER_SIZE_);
+
+		for (size_t j = 0; j < BUFFER_SIZE_; j++) {
+			splitPosition = splitSampler.process(
+				splitOutput[j],
+				splitPosition,
+				step,
+				1
+			);
+			reference     = wrapReference_(
+				reference + step,
+				step,
+				loopStart,
+				loopEnd
+			);
+		}
+
+		const bool ok = true
+			&& (position == reference)
+			&& (splitPosition == reference)
+			&& !memcmp(output, splitOutput, sizeof(output));
+
+		if (!ok) {
+			printf(
+				"  loop %.2f x%.2f from %s: FAILED at buffer %zu "
+				"(position %lld, expected %lld)\n",
+				loopLength,
+				speed,
+				START_NAMES_[start],
+				i,
+				(long long) position,
+				(long long) reference
+			);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool checkNoLoop_(bench::TestSectorSource &source) {
+	sst::Sampler sampler, loopedSampler;
+	Frame_       output[BUFFER_SIZE_], loopedOutput[BUFFER_SIZE_];
+
+	source.attach(sampler);
+	source.attach(loopedSampler);
+	sampler.allocate(4);
+	loopedSampler.allocate(4);
+
+	const int64_t first = int64_t(LOOP_CHUNK_ * sst::SAMPLES_PER_SECTOR)
+		<< sst::SAMPLE_OFFSET_BITS;
+	const int     step  = int(1.37 * sst::SAMPLE_OFFSET_UNIT);
+
+	loopedSampler.setLoop(first, first + step * 100);
+	loopedSampler.clearLoop();
+
+	int64_t position = first, loopedPosition = first;
+
+	for (size_t i = 0; i < NUM_BUFFERS_; i++) {
+		position       = sampler.process(
+			output[0], position, step, BUFFER_SIZE_
+		);
+		loopedPosition = loopedSampler.process(
+			loopedOutput[0], loopedPosition, step, BUFFER_SIZE_
+		);
+
+		if (
+			(position != loopedPosition)
+			|| memcmp(output, loopedOutput, sizeof(output))
+		) {
+			printf("  no loop: FAILED at buffer %zu\n", i);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main(void) {
+	bench::TestSectorSource source;
+
+	int numTests = 0, numFailed = 0;
+
+	for (double loopLength : LOOP_LENGTHS_) {
+		for (double speed : SPEEDS_) {
+			for (int i = START_INSIDE; i <= START_AFTER; i++) {
+				numTests++;
+
+				if (!runTest_(source, loopLength, speed, StartPosition_(i)))
+					numFailed++;
+			}
+		}
+	}
+
+	numTests++;
+
+	if (!checkNoLoop_(source))
+		numFailed++;
+
+	printf("loop: %d of %d tests passed\n", numTests - numFailed, numTests);
+	return numFailed ? 1 : 0;
+}
@@ -0,0 +1,157 @@
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include "bench/bench.hpp"
+#include "src/main/util/file.hpp"
+#include "src/main/sst.hpp"
+
+/*
+ * sst::Reader file backend benchmark. Writes a synthetic 5-variant .sst file,
+ * then times individual Reader::read() calls through each backend with the
+ * file in the page cache, using three access patterns: sequential playback, a
+ * short loop and a random walk of a few chunks around the playhead (scratch).
+ * Reports median and 99th percentile latency, as well as throughput.
+ */
+
+static constexpr size_t NUM_VARIANTS_   = 5;
+static constexpr int    LOOP_LENGTH_    = 8;
+static constexpr int    SCRATCH_RANGE_  = 3;
+static constexpr char   DEFAULT_PATH_[] = "readerBench.sst";
+
+enum Pattern_ {
+	PATTERN_SEQUENTIAL = 0,
+	PATTERN_LOOP       = 1,
+	PATTERN_SCRATCH    = 2
+};
+
+static const char *const PATTERN_NAMES_[]{
+	"sequential",
+	"looping",
+	"scratch"
+};
+
+static int getNextChunk_(
+	Pattern_      pattern,
+	int           chunk,
+	int           numChunks,
+	bench::Random &random
+) {
+	switch (pattern) {
+		case PATTERN_SEQUENTIAL:
+			chunk++;
+			break;
+
+		case PATTERN_LOOP:
+			chunk = (chunk + 1) % LOOP_LENGTH_;
+			break;
+
+		case PATTERN_SCRATCH:
+			chunk += random.nextInt(-SCRATCH_RANGE_, SCRATCH_RANGE_);
+			break;
+	}
+
+	return (chunk + numChunks) % numChunks;
+}
+
+static bool runBenchmark_(
+	const char *name,
+	util::File &file,
+	const char *path,
+	Pattern_   pattern,
+	int        numChunks,
+	size_t     numReads
+) {
+	sst::Reader reader;
+
+	reader.setBackend(file);
+
+	if (!reader.open(path))
+		return false;
+
+	auto times = new uint64_t[numReads];
+
+	sst::SSTSector       sector;
+	sst::SSTSectorFormat format;
+	bench::Random        random;
+
+	int  chunk = numChunks / 2;
+	bool ok    = true;
+
+	const uint64_t start = bench::getTime();
+
+	for (size_t i = 0; ok && (i < numReads); i++) {
+		const uint64_t readStart = bench::getTime();
+
+		ok       = reader.read(sector, format, chunk);
+		times[i] = bench::getTime() - readStart;
+		chunk    = getNextChunk_(pattern, chunk, numChunks, random);
+	}
+
+	const uint64_t totalTime = bench::getTime() - start;
+
+	std::sort(times, times + numReads);
+	printf(
+		"  %-7s %-10s %7llu ns %7llu ns %8.0f MB/s\n",
+		name,
+		PATTERN_NAMES_[pattern],
+		(unsigned long long) times[numReads / 2],
+		(unsigned long long) times[numReads * 99 / 100],
+		double(numReads * sizeof(sector)) * 1e3 / double(totalTime)
+	);
+
+	delete[] times;
+	return ok;
+}
+
+int main(int argc, const char **argv) {
+	const bool   quick     = bench::hasOption(argc, argv, "--quick");
+	const int    numChunks = quick ? 256 : 6000;
+	const size_t numReads  = quick ? 1000 : 20000;
+
+	if (!bench::writeTestSST(DEFAULT_PATH_, numChunks, NUM_VARIANTS_)) {
+		fprintf(stderr, "could not write %s\n", DEFAULT_PATH_);
+		return 1;
+	}
+
+	util::StdioFile  stdioFile;
+	util::POSIXFile  posixFile;
+	util::MappedFile mappedFile;
+
+	const struct {
+		const char *name;
+		util::File &file;
+	} backends[]{
+		{ "stdio", stdioFile  },
+		{ "pread", posixFile  },
+		{ "mmap",  mappedFile }
+	};
+
+	printf(
+		"reader: %d chunks x %zu variants, %zu reads per run\n",
+		numChunks,
+		NUM_VARIANTS_,
+		numReads
+	);
+	printf("  backend pattern         p50        p99   throughput\n");
+
+	bool ok = true;
+
+	for (auto &backend : backends) {
+		for (int i = PATTERN_SEQUENTIAL; ok && (i <= PATTERN_SCRATCH); i++)
+			ok = runBenchmark_(
+				backend.name,
+				backend.file,
+				DEFAULT_PATH_,
+				Pattern_(i),
+				numChunks,
+				numReads
+			);
+	}
+
+	unlink(DEFAULT_PATH_);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "bench/bench.hpp"
+#include "src/main/sst.hpp"
+
+/*
+ * Sampler playback benchmark. Plays the same sector over and over at a slightly
+ * fractional speed, one 256-sample buffer at a time as the audio task does, and
+ * reports the best of several runs per output sample, both from silent sectors
+ * (sampler only) and from ADPCM sectors (including decoding).
+ *
+ * It then checks that positions several hours into a track, which no longer
+ * fit in 32 bits, still load the right chunk and produce the same output as the
+ * same offset near the start of the track.
+ */
+
+static constexpr size_t NUM_RUNS_    = 7;
+static constexpr size_t BUFFER_SIZE_ = 256;
+static constexpr double SPEED_       = 1.0137;
+static constexpr double LONG_HOURS_  = 3.0;
+
+using Frame_ = dsp::Sample[sst::NUM_CHANNELS];
+
+static double runBenchmark_(
+	bench::TestSectorSource &source,
+	int                     step,
+	size_t                  numBuffers
+) {
+	sst::Sampler sampler;
+	Frame_       output[BUFFER_SIZE_];
+
+	source.attach(sampler);
+	sampler.allocate(2);
+
+	uint64_t bestTime = UINT64_MAX;
+
+	for (size_t run = 0; run < NUM_RUNS_; run++) {
+		int64_t position = 0;
+
+		sampler.flush();
+		const uint64_t start = bench::getTime();
+
+		for (size_t i = 0; i < numBuffers; i++)
+			position = sampler.process(
+				output[0],
+				position,
+				step,
+				BUFFER_SIZE_
+			);
+
+		bestTime = util::min(bestTime, bench::getTime() - start);
+	}
+
+	return double(bestTime) / double(numBuffers * BUFFER_SIZE_);
+}
+
+static bool checkLongPosition_(int step) {
+	bench::TestSectorSource source;
+	sst::Sampler            sampler;
+	Frame_                  shortOutput[BUFFER_SIZE_];
+	Frame_                  longOutput[BUFFER_SIZE_];
+
+	source.attach(sampler);
+	sampler.allocate(2);
+
+	// Both positions share the same offset within the sector, and all sectors
+	// are identical.
+	const int64_t longChunk = int64_t(
+		LONG_HOURS_ * 3600.0 * 44100.0 / double(sst::SAMPLES_PER_SECTOR)
+	);
+	const int64_t sectorLength =
+		int64_t(sst::SAMPLES_PER_SECTOR) << sst::SAMPLE_OFFSET_BITS;
+	const int64_t shortPosition =
+		3 * sectorLength + sst::SAMPLE_OFFSET_UNIT / 3;
+	const int64_t longPosition  = shortPosition + longChunk * sectorLength;
+
+	sampler.process(shortOutput[0], shortPosition, step, BUFFER_SIZE_);
+	sampler.flush();
+
+	const int64_t endPosition =
+		sampler.process(longOutput[0], longPosition, step, BUFFER_SIZE_);
+	const int64_t expectedChunk = (endPosition >> sst::SAMPLE_OFFSET_BITS)
+		/ int64_t(sst::SAMPLES_PER_SECTOR);
+
+	const bool ok = true
+		&& (endPosition == longPosition + int64_t(step) * int64_t(BUFFER_SIZE_))
+		&& (source.lastChunk >= longChunk)
+		&& (source.lastChunk <= expectedChunk + 1)
+		&& !memcmp(shortOutput, longOutput, sizeof(shortOutput));
+
+	printf(
+		"position %.1f hours in (chunk %lld): %s\n",
+		LONG_HOURS_,
+		(long long) longChunk,
+		ok ? "ok" : "FAILED"
+	);
+	return ok;
+}
+
+int main(int argc, const char **argv) {
+	const bool   quick      = bench::hasOption(argc, argv, "--quick");
+	const size_t numBuffers = quick ? 100 : 40000;
+	const int    step       = int(SPEED_ * sst::SAMPLE_OFFSET_UNIT);
+
+	bench::TestSectorSource silentSource(sst::SST_FLAG_SILENT);
+	bench::TestSectorSource adpcmSource;
+
+	printf(
+		"sampler: %zu buffers of %zu samples at x%.4f\n",
+		numBuffers,
+		BUFFER_SIZE_,
+		SPEED_
+	);
+	printf(
+		"  silent sectors: %5.2f ns/sample\n",
+		runBenchmark_(silentSource, step, numBuffers)
+	);
+	printf(
+		"  ADPCM sectors:  %5.2f ns/sample\n",
+		runBenchmark_(adpcmSource, step, numBuffers)
+	);
+
+	return checkLongPosition_(step) ? 0 : 1;
+}
@@ -0,0 +1,181 @@
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "bench/bench.hpp"
+#include "src/main/sst.hpp"
+
+/*
+ * Sampler cache sizing benchmark. Replays synthetic per-buffer speed traces
+ * through sst::Sampler, feeding back the returned position as the audio task
+ * does, and reports the number of cache misses (i.e. sectors pulled from the
+ * queue and decoded) and the time per output sample for several cache sizes,
+ * along with the RAM each size takes up per deck.
+ *
+ * All traces start one minute into the track:
+ * - play:   normal playback.
+ * - loop:   playback of a loop spanning three sectors (2.2 sectors long, with
+ *           an unaligned start), handled by the sampler.
+ * - cue:    normal playback, jumping to one of three cue points 0.3 s apart
+ *           every 20 buffers (~120 ms) in turn.
+ * - scr0.3: a 2 Hz scratch moving back and forth by 0.3 s.
+ * - scr1.3: a wider 1.5 Hz scratch moving by 1.3 s, with some jitter.
+ */
+
+static constexpr size_t NUM_RUNS_    = 3;
+static constexpr size_t BUFFER_SIZE_ = 256;
+static constexpr double SAMPLE_RATE_ = 44100.0;
+static constexpr double START_TIME_  = 60.0;
+
+static const size_t CACHE_SIZES_[]{ 2, 3, 4, 8, 16 };
+
+enum Trace_ {
+	TRACE_PLAY     = 0,
+	TRACE_LOOP     = 1,
+	TRACE_CUE      = 2,
+	TRACE_SCRATCH1 = 3,
+	TRACE_SCRATCH2 = 4
+};
+
+static const char *const TRACE_NAMES_[]{
+	"play",
+	"loop",
+	"cue",
+	"scr0.3",
+	"scr1.3"
+};
+
+using Frame_ = dsp::Sample[sst::NUM_CHANNELS];
+
+static inline int64_t toPosition_(double time) {
+	return int64_t(time * SAMPLE_RATE_ * sst::SAMPLE_OFFSET_UNIT);
+}
+
+static int getStep_(Trace_ trace, double time) {
+	double speed;
+
+	// The peak displacement of a sinusoidal speed curve with amplitude A and
+	// frequency f is A / (2 * pi * f) seconds.
+	switch (trace) {
+		case TRACE_SCRATCH1:
+			speed = 0.3 * 2.0 * M_PI * 2.0 * cos(2.0 * M_PI * 2.0 * time);
+			break;
+
+		case TRACE_SCRATCH2:
+			speed = 0
+				+ 1.3 * 2.0 * M_PI * 1.5 * sin(2.0 * M_PI * 1.5 * time)
+				+ 2.0 * sin(2.0 * M_PI * 7.0 * time);
+			break;
+
+		default:
+			speed = 1.0;
+	}
+
+	return int(lrint(speed * sst::SAMPLE_OFFSET_UNIT));
+}
+
+static void runTrace_(
+	Trace_                  trace,
+	size_t                  numEntries,
+	size_t                  numBuffers,
+	bench::TestSectorSource &source,
+	uint32_t                &misses,
+	double                  &sampleTime
+) {
+	sst::Sampler sampler;
+	Frame_       output[BUFFER_SIZE_];
+
+	source.attach(sampler);
+	sampler.allocate(numEntries);
+
+	if (trace == TRACE_LOOP) {
+		const int64_t start  = toPosition_(START_TIME_ + 500.0 / SAMPLE_RATE_);
+		const int64_t length = int64_t(
+			2.2 * sst::SAMPLES_PER_SECTOR * sst::SAMPLE_OFFSET_UNIT
+		);
+
+		sampler.setLoop(start, start + length);
+	}
+
+	uint64_t bestTime = UINT64_MAX;
+
+	for (size_t run = 0; run < NUM_RUNS_; run++) {
+		int64_t position = toPosition_(START_TIME_);
+
+		sampler.flush();
+		sampler.resetStats();
+		const uint64_t start = bench::getTime();
+
+		for (size_t i = 0; i < numBuffers; i++) {
+			const double time = double(i * BUFFER_SIZE_) / SAMPLE_RATE_;
+
+			if ((trace == TRACE_CUE) && !(i % 20))
+				position = toPosition_(START_TIME_ + 0.3 * double((i / 20) % 3));
+
+			position = sampler.process(
+				output[0],
+				position,
+				getStep_(trace, time),
+				BUFFER_SIZE_
+			);
+		}
+
+		bestTime = util::min(bestTime, bench::getTime() - start);
+	}
+
+	misses     = sampler.getStats().misses;
+	sampleTime = double(bestTime) / double(numBuffers * BUFFER_SIZE_);
+}
+
+int main(int argc, const char **argv) {
+	const bool   quick      = bench::hasOption(argc, argv, "--quick");
+	const size_t numBuffers = quick ? 500 : 20000;
+
+	bench::TestSectorSource source;
+
+	printf(
+		"replay: %zu buffers of %zu samples, misses and ns/sample per cache "
+		"size\n",
+		numBuffers,
+		BUFFER_SIZE_
+	);
+	printf("  trace ");
+
+	for (size_t numEntries : CACHE_SIZES_)
+		printf("        N=%-2zu", numEntries);
+
+	printf("\n");
+
+	for (int i = TRACE_PLAY; i <= TRACE_SCRATCH2; i++) {
+		printf("  %-6s", TRACE_NAMES_[i]);
+
+		for (size_t numEntries : CACHE_SIZES_) {
+			uint32_t misses;
+			double   sampleTime;
+
+			runTrace_(
+				Trace_(i),
+				numEntries,
+				numBuffers,
+				source,
+				misses,
+				sampleTime
+			);
+			printf(" %6u %4.1f", misses, sampleTime);
+		}
+
+		printf("\n");
+	}
+
+	printf("  KB/deck");
+
+	for (size_t numEntries : CACHE_SIZES_)
+		printf(
+			" %11.1f",
+			double(numEntries * sizeof(sst::SamplerCacheEntry)) / 1024.0
+		);
+
+	printf("\n");
+	return 0;
+}
@@ -0,0 +1,98 @@
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "bench/bench.hpp"
+#include "src/main/sst.hpp"
+
+/*
+ * Sampler run loop benchmark. Plays back at a range of typical steps, covering
+ * the 1:1 copy path, integer steps, fractional steps and reverse playback, and
+ * reports the best of several runs in CPU cycles per 256-sample buffer. Silent
+ * sectors measure the run loop alone, while ADPCM sectors include the cost of
+ * decoding.
+ */
+
+static constexpr size_t NUM_RUNS_    = 5;
+static constexpr size_t BUFFER_SIZE_ = 256;
+
+using Frame_ = dsp::Sample[sst::NUM_CHANNELS];
+
+static const struct {
+	const char *name;
+	double     speed;
+	int        offset;
+} STEP_CASES_[]{
+	{ "1:1 aligned",    1.0,    0                           },
+	{ "1:1 fractional", 1.0,    sst::SAMPLE_OFFSET_UNIT / 3 },
+	{ "2x",             2.0,    0                           },
+	{ "-1x",            -1.0,   0                           },
+	{ "1.0137x",        1.0137, 0                           },
+	{ "0.92x",          0.92,   0                           },
+	{ "-1.37x",         -1.37,  0                           },
+	{ "4x fractional",  4.0,    sst::SAMPLE_OFFSET_UNIT / 5 }
+};
+
+static uint64_t runBenchmark_(
+	bench::TestSectorSource &source,
+	double                  speed,
+	int                     offset,
+	size_t                  numBuffers
+) {
+	sst::Sampler sampler;
+	Frame_       output[BUFFER_SIZE_];
+
+	source.attach(sampler);
+	sampler.allocate(4);
+
+	const int step      = int(speed * sst::SAMPLE_OFFSET_UNIT);
+	uint64_t  bestTotal = UINT64_MAX;
+
+	for (size_t run = 0; run < NUM_RUNS_; run++) {
+		// Start far enough into the track for reverse playback not to reach
+		// its beginning.
+		int64_t position = offset + (
+			int64_t(10000 * sst::SAMPLES_PER_SECTOR) << sst::SAMPLE_OFFSET_BITS
+		);
+
+		sampler.flush();
+		const uint64_t start = bench::getCycles();
+
+		for (size_t i = 0; i < numBuffers; i++)
+			position = sampler.process(
+				output[0],
+				position,
+				step,
+				BUFFER_SIZE_
+			);
+
+		bestTotal = util::min(bestTotal, bench::getCycles() - start);
+	}
+
+	return bestTotal / numBuffers;
+}
+
+int main(int argc, const char **argv) {
+	const bool   quick      = bench::hasOption(argc, argv, "--quick");
+	const size_t numBuffers = quick ? 100 : 20000;
+
+	bench::TestSectorSource silentSource(sst::SST_FLAG_SILENT);
+	bench::TestSectorSource adpcmSource;
+
+	printf("steps: cycles per %zu-sample buffer\n", BUFFER_SIZE_);
+	printf("  step            silent   ADPCM\n");
+
+	for (auto &stepCase : STEP_CASES_)
+		printf(
+			"  %-14s %7llu %7llu\n",
+			stepCase.name,
+			(unsigned long long) runBenchmark_(
+				silentSource, stepCase.speed, stepCase.offset, numBuffers
+			),
+			(unsigned long long) runBenchmark_(
+				adpcmSource, stepCase.speed, stepCase.offset, numBuffers
+			)
+		);
+
+	return 0;
+}
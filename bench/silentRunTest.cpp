@@ -0,0 +1,327 @@
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench/bench.hpp"
+#include "src/main/sst.hpp"
+
+/*
+ * Silent run and chunk group layout test. Writes .sst files with elided runs
+ * of silent chunks in various places (at the first chunk, at the last chunk,
+ * back to back), with several group lengths (including one that leaves a
+ * shorter last group) and with variants of different sector lengths. Each
+ * stored sector is tagged with its chunk and variant index; the test checks
+ * that every chunk read through Reader::read() and Reader::readBatch() is
+ * either flagged as silent or holds the sector it was written as. Invalid
+ * silent run maps are also checked to be rejected by validateSilentRuns().
+ */
+
+static constexpr char   DEFAULT_PATH_[] = "silentRunTest.sst";
+static constexpr size_t NUM_CHUNKS_     = 40;
+static constexpr size_t MAX_RUNS_       = 4;
+static constexpr int    MAX_BATCH_      = 16;
+
+static const size_t GROUP_LENGTHS_[]{ 1, 4, 7, 40 };
+
+struct LayoutCase_ {
+public:
+	const char       *name;
+	size_t           numRuns;
+	sst::SSTChunkRun runs[MAX_RUNS_];
+};
+
+static const LayoutCase_ LAYOUT_CASES_[]{
+	{ "no runs",       0, {} },
+	{ "first chunk",   1, { { 0, 3 } } },
+	{ "last chunk",    1, { { NUM_CHUNKS_ - 2, 2 } } },
+	{ "single chunks", 3, { { 0, 1 }, { 20, 1 }, { NUM_CHUNKS_ - 1, 1 } } },
+	{ "adjacent",      3, { { 5, 2 }, { 7, 3 }, { 10, 1 } } },
+	{ "mixed",         4, { { 0, 2 }, { 9, 5 }, { 14, 1 }, { 33, 7 } } }
+};
+
+// Variants alternate between 4-bit stereo and a smaller 3/2-bit layout, so
+// that each variant's sectors have a different offset within a row.
+static constexpr size_t NUM_VARIANTS_ = 3;
+
+static const dsp::SSTBlockFormat VARIANT_FORMATS_[][sst::NUM_CHANNELS]{
+	{ dsp::SST_FORMAT_4BIT, dsp::SST_FORMAT_4BIT },
+	{ dsp::SST_FORMAT_3BIT, dsp::SST_FORMAT_2BIT },
+	{ dsp::SST_FORMAT_2BIT, dsp::SST_FORMAT_4BIT }
+};
+
+/* Test file */
+
+static bool isSilent_(const LayoutCase_ &layout, size_t chunk) {
+	for (size_t i = 0; i < layout.numRuns; i++) {
+		auto &run = layout.runs[i];
+
+		if ((chunk >= run.start) && (chunk < (run.start + run.length)))
+			return true;
+	}
+
+	return false;
+}
+
+static size_t getSectorLength_(int variant) {
+	size_t length = 0;
+
+	for (auto format : VARIANT_FORMATS_[variant])
+		length += dsp::getSSTChunkLength(sst::BLOCKS_PER_SECTOR, format);
+
+	return length;
+}
+
+static void fillSector_(uint8_t *output, size_t chunk, int variant) {
+	const size_t length = getSectorLength_(variant);
+
+	for (size_t i = 0; i < length; i++)
+		output[i] = uint8_t(chunk * 31 + variant * 97 + i);
+
+	output[0] = uint8_t(chunk);
+	output[1] = uint8_t(variant);
+}
+
+static void fillHeader_(
+	sst::SSTHeader    &header,
+	const LayoutCase_ &layout,
+	size_t            chunksPerGroup
+) {
+	memset(&header, 0, sizeof(header));
+	header.info.magic          = sst::SST_MAGIC;
+	header.info.sampleRate     = 44100;
+	header.info.numChunks      = NUM_CHUNKS_;
+	header.info.numVariants    = NUM_VARIANTS_;
+	header.info.numChannels    = sst::NUM_CHANNELS;
+	header.info.chunksPerGroup = uint8_t(chunksPerGroup);
+	header.info.numSilentRuns  = uint8_t(layout.numRuns);
+
+	for (size_t i = 0; i < NUM_VARIANTS_; i++) {
+		for (size_t j = 0; j < sst::NUM_CHANNELS; j++)
+			header.info.blockFormats[i][j] = VARIANT_FORMATS_[i][j];
+	}
+
+	for (size_t i = 0; i < layout.numRuns; i++)
+		header.info.silentRuns[i] = layout.runs[i];
+
+	header.info.titleOffset  = sizeof(sst::SSTHeaderInfo);
+	header.info.artistOffset = sizeof(sst::SSTHeaderInfo);
+	header.info.albumOffset  = sizeof(sst::SSTHeaderInfo);
+	header.info.genreOffset  = sizeof(sst::SSTHeaderInfo);
+}
+
+// Writes the stored chunks in groups of chunksPerGroup, with the sectors of
+// each variant back to back within a group, as described in sst.hpp.
+static bool writeFile_(const LayoutCase_ &layout, size_t chunksPerGroup) {
+	auto file = fopen(DEFAULT_PATH_, "wb");
+
+	if (!file)
+		return false;
+
+	sst::SSTHeader header;
+	fillHeader_(header, layout, chunksPerGroup);
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+	size_t storedChunks[NUM_CHUNKS_], numStoredChunks = 0;
+
+	for (size_t i = 0; i < NUM_CHUNKS_; i++) {
+		if (!isSilent_(layout, i))
+			storedChunks[numStoredChunks++] = i;
+	}
+
+	sst::SSTSector sector;
+
+	for (size_t i = 0; i < numStoredChunks; i += chunksPerGroup) {
+		const size_t groupEnd = util::min(i + chunksPerGroup, numStoredChunks);
+
+		for (size_t j = 0; j < NUM_VARIANTS_; j++) {
+			for (size_t k = i; ok && (k < groupEnd); k++) {
+				fillSector_(sector.data, storedChunks[k], j);
+				ok = fwrite(
+					sector.data,
+					getSectorLength_(j),
+					1,
+					file
+				) == 1;
+			}
+		}
+	}
+
+	return !fclose(file) && ok;
+}
+
+/* Tests */
+
+static bool checkSector_(
+	const uint8_t              *data,
+	const sst::SSTSectorFormat &format,
+	const LayoutCase_          &layout,
+	size_t                     chunk,
+	int                        variant
+) {
+	const bool silent = format.flags & sst::SST_FLAG_SILENT;
+
+	if (silent != isSilent_(layout, chunk))
+		return false;
+	if (silent)
+		return true;
+
+	uint8_t expected[sizeof(sst::SSTSector)];
+	fillSector_(expected, chunk, variant);
+
+	return true
+		&& (format.getLength() == getSectorLength_(variant))
+		&& !memcmp(data, expected, getSectorLength_(variant));
+}
+
+static bool runTest_(const LayoutCase_ &layout, size_t chunksPerGroup) {
+	if (!writeFile_(layout, chunksPerGroup)) {
+		printf("  could not write %s\n", DEFAULT_PATH_);
+		return false;
+	}
+
+	sst::Reader reader;
+
+	if (!reader.open(DEFAULT_PATH_)) {
+		printf(
+			"  %s, groups of %zu: FAILED to open\n",
+			layout.name,
+			chunksPerGroup
+		);
+		return false;
+	}
+
+	auto batch = new sst::SSTSector[MAX_BATCH_];
+	bool ok    = true;
+
+	for (int variant = 0; ok && (variant < int(NUM_VARIANTS_)); variant++) {
+		reader.setVariant(variant);
+
+		for (size_t chunk = 0; ok && (chunk < NUM_CHUNKS_); chunk++) {
+			sst::SSTSector       sector;
+			sst::SSTSectorFormat format;
+
+			if (
+				!reader.read(sector, format, int(chunk)) ||
+				!checkSector_(sector.data, format, layout, chunk, variant)
+			) {
+				printf(
+					"  %s, groups of %zu: FAILED at chunk %zu, variant %d\n",
+					layout.name,
+					chunksPerGroup,
+					chunk,
+					variant
+				);
+				ok = false;
+				break;
+			}
+
+			// Batches may stop early (e.g. at the end of a group), but must
+			// never extend into a silent run.
+			auto      data    = reinterpret_cast<uint8_t *>(batch);
+			const int numRead = reader.readBatch(
+				data,
+				format,
+				int(chunk),
+				MAX_BATCH_
+			);
+			const bool silent = format.flags & sst::SST_FLAG_SILENT;
+
+			if ((numRead < 1) || (silent && (numRead != 1)))
+				ok = false;
+
+			for (int i = 0; ok && (i < numRead); i++) {
+				ok = checkSector_(
+					&data[i * format.getLength()],
+					format,
+					layout,
+					chunk + i,
+					variant
+				);
+			}
+
+			if (!ok)
+				printf(
+					"  %s, groups of %zu: batch FAILED at chunk %zu, "
+					"variant %d\n",
+					layout.name,
+					chunksPerGroup,
+					chunk,
+					variant
+				);
+		}
+	}
+
+	// Chunks past the end of the track must not be returned at all.
+	sst::SSTSector       sector;
+	sst::SSTSectorFormat format;
+
+	if (reader.read(sector, format, NUM_CHUNKS_)) {
+		printf("  %s: chunk past the end returned\n", layout.name);
+		ok = false;
+	}
+
+	reader.close();
+	delete[] batch;
+	return ok;
+}
+
+static bool checkInvalidRuns_(void) {
+	const LayoutCase_ invalidCases[]{
+		{ "overlapping", 2, { { 4, 4 }, { 6, 2 } } },
+		{ "unsorted",    2, { { 10, 1 }, { 5, 1 } } },
+		{ "past end",    1, { { NUM_CHUNKS_ - 1, 2 } } },
+		{ "start wraps", 1, { { UINT32_MAX - 3, 8 } } },
+		{ "too long",    1, { { 0, NUM_CHUNKS_ + 1 } } }
+	};
+
+	sst::SSTHeader header;
+	bool           ok = true;
+
+	for (auto &layout : invalidCases) {
+		fillHeader_(header, layout, 1);
+
+		if (header.validateSilentRuns()) {
+			printf("  invalid runs (%s) accepted\n", layout.name);
+			ok = false;
+		}
+	}
+
+	fillHeader_(header, LAYOUT_CASES_[0], 1);
+	header.info.numSilentRuns = sst::SST_MAX_SILENT_RUNS + 1;
+
+	if (header.validateSilentRuns()) {
+		printf("  invalid run count accepted\n");
+		ok = false;
+	}
+
+	return ok;
+}
+
+int main(void) {
+	int numTests = 0, numFailed = 0;
+
+	for (auto &layout : LAYOUT_CASES_) {
+		for (size_t chunksPerGroup : GROUP_LENGTHS_) {
+			numTests++;
+
+			if (!runTest_(layout, chunksPerGroup))
+				numFailed++;
+		}
+	}
+
+	numTests++;
+
+	if (!checkInvalidRuns_())
+		numFailed++;
+
+	unlink(DEFAULT_PATH_);
+	printf(
+		"silent runs: %d of %d tests passed\n",
+		numTests - numFailed,
+		numTests
+	);
+	return numFailed ? 1 : 0;
+}
@@ -22,15 +22,15 @@ namespace defs {
 #define DRAM_ATTR
 
 #define ESP_LOGV(tag, format, ...) \
-	fprintf(stderr, "[V] " tag ": " format "\n" __VA_OPT__(,) __VA_ARGS__)
+	fprintf(stderr, "[V] %s: " format "\n", tag __VA_OPT__(,) __VA_ARGS__)
 #define ESP_LOGD(tag, format, ...) \
-	fprintf(stderr, "[D] " tag ": " format "\n" __VA_OPT__(,) __VA_ARGS__)
+	fprintf(stderr, "[D] %s: " format "\n", tag __VA_OPT__(,) __VA_ARGS__)
 #define ESP_LOGI(tag, format, ...) \
-	fprintf(stderr, "[I] " tag ": " format "\n" __VA_OPT__(,) __VA_ARGS__)
+	fprintf(stderr, "[I] %s: " format "\n", tag __VA_OPT__(,) __VA_ARGS__)
 #define ESP_LOGE(tag, format, ...) \
-	fprintf(stderr, "[E] " tag ": " format "\n" __VA_OPT__(,) __VA_ARGS__)
+	fprintf(stderr, "[E] %s: " format "\n", tag __VA_OPT__(,) __VA_ARGS__)
 #define ESP_LOGW(tag, format, ...) \
-	fprintf(stderr, "[W] " tag ": " format "\n" __VA_OPT__(,) __VA_ARGS__)
+	fprintf(stderr, "[W] %s: " format "\n", tag __VA_OPT__(,) __VA_ARGS__)
 
 #endif
 
@@ -2,7 +2,9 @@
 #include <stdint.h>
 #include <string.h>
 #include "driver/sdmmc_host.h"
+#include "esp_err.h"
 #include "esp_vfs_fat.h"
+#include "sdmmc_cmd.h"
 #include "src/main/drivers/storage.hpp"
 #include "src/main/defs.hpp"
 
@@ -81,6 +83,13 @@ bool StorageDriver::init(const char *mountPoint) {
 	ESP_LOGI(TAG_, "SD capacity: %llu MB", capacity / 0x100000);
 	ESP_LOGI(TAG_, "SD speed:    %d MHz",  card_->real_freq_khz / 1000);
 	ESP_LOGI(TAG_, "Mount point: %s",      mountPoint);
+
+	// Mount the FAT volume a second time (read-only) for use by the raw extent
+	// file backend. This is not fatal, as files can still be accessed through
+	// the VFS.
+	if (!volume_.mount(*this))
+		ESP_LOGW(TAG_, "could not parse FAT volume, raw reads disabled");
+
 	return true;
 }
 
@@ -88,8 +97,31 @@ void StorageDriver::release(void) {
 	if (!card_)
 		return;
 
+	volume_.unmount();
 	esp_vfs_fat_sdcard_unmount(mountPoint_, card_);
 	card_ = nullptr;
 }
 
+bool StorageDriver::readBlocks(void *output, uint32_t lba, size_t numBlocks) {
+	if (!card_)
+		return false;
+
+	// Note that the SDMMC driver falls back to reading one block at a time
+	// through a bounce buffer if the output buffer is not DMA-capable and
+	// 32-bit aligned.
+	const auto error = sdmmc_read_sectors(card_, output, lba, numBlocks);
+
+	if (error != ESP_OK) {
+		ESP_LOGE(
+			TAG_,
+			"could not read %u blocks from LBA %u",
+			unsigned(numBlocks),
+			unsigned(lba)
+		);
+		return false;
+	}
+
+	return true;
+}
+
 }
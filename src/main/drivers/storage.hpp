@@ -1,16 +1,20 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
 #include "driver/sdmmc_types.h"
+#include "src/main/util/fat.hpp"
 
 namespace drivers {
 
 /* SD card initialization */
 
-class StorageDriver {
+class StorageDriver : public util::BlockDevice {
 private:
-	sdmmc_card_t *card_;
-	char         mountPoint_[16];
+	sdmmc_card_t    *card_;
+	char            mountPoint_[16];
+	util::FATVolume volume_;
 
 	inline StorageDriver(void) :
 		card_(nullptr)
@@ -20,9 +24,17 @@ private:
 	}
 
 public:
+	inline const char *getMountPoint(void) const {
+		return mountPoint_;
+	}
+	inline util::FATVolume &getVolume(void) {
+		return volume_;
+	}
+
 	static StorageDriver &instance(void);
 	bool init(const char *mountPoint);
 	void release(void);
+	bool readBlocks(void *output, uint32_t lba, size_t numBlocks) override;
 };
 
 }
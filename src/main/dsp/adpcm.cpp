@@ -1,11 +1,18 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 #include "src/main/dsp/adpcm.hpp"
 #include "src/main/dsp/dsp.hpp"
 #include "src/main/util/templates.hpp"
 #include "src/main/defs.hpp"
 
+// The vectorized code paths are only built for the host. Defining DSP_NO_SIMD
+// disables them, so that they can be benchmarked against the scalar code.
+#if !defined(ESP_PLATFORM) && !defined(DSP_NO_SIMD)
+#define DSP_USE_SIMD
+#endif
+
 namespace dsp {
 
 /* Filter coefficient table */
@@ -32,13 +39,21 @@ DRAM_ATTR static const int16_t ADPCM_FILTER_COEFFS_[][2]{
 	{  28, -240 }
 };
 
-static constexpr int ADPCM_FILTER_BITS_ = 8;
-static constexpr int ADPCM_FILTER_BIAS_ = 1 << (ADPCM_FILTER_BITS_ - 1);
+static constexpr size_t NUM_FILTERS_       =
+	util::countOf(ADPCM_FILTER_COEFFS_);
+static constexpr int    ADPCM_FILTER_BITS_ = 8;
+static constexpr int    ADPCM_FILTER_BIAS_ = 1 << (ADPCM_FILTER_BITS_ - 1);
 
 [[gnu::always_inline]] static inline int clampSample_(int value) {
 	return util::clamp(value, INT16_MIN, INT16_MAX);
 }
 
+[[gnu::always_inline]] static inline int getMaxGain_(int sampleBits) {
+	// The gain estimate is clamped so that the highest gain tried by the
+	// encoder (estimate + 1) still fits in the 4-bit header field.
+	return 15 - sampleBits;
+}
+
 /* 12-byte .sst ADPCM encoder */
 
 /*
@@ -56,6 +71,9 @@ IRAM_ATTR int SSTEncoder::estimateBlockGain_(
 	// approximation of the encoder is used here.
 	auto filter = ADPCM_FILTER_COEFFS_[filterIndex];
 
+	const int sampleBits = getSSTSampleBits(format_);
+	const int maxValue   = (1 << (sampleBits - 1)) - 1;
+
 	const int a1 = filter[0], a2 = filter[1];
 	int       s1 = s1_,       s2 = s2_;
 
@@ -82,12 +100,12 @@ IRAM_ATTR int SSTEncoder::estimateBlockGain_(
 
 	int shift = 0;
 
-	while ((posPeak >> shift) > 7)
+	while ((posPeak >> shift) > maxValue)
 		shift++;
-	while ((negPeak >> shift) < -8)
+	while ((negPeak >> shift) < (-maxValue - 1))
 		shift++;
 
-	return util::clamp(shift, 1, 11);
+	return util::clamp(shift, 1, getMaxGain_(sampleBits));
 }
 
 IRAM_ATTR int64_t SSTEncoder::tryEncodeBlock_(
@@ -97,17 +115,22 @@ IRAM_ATTR int64_t SSTEncoder::tryEncodeBlock_(
 	int          filterIndex,
 	size_t       inputStride
 ) {
-	output.blocks[0].header  = uint8_t(gain        & 15);
-	output.blocks[0].header |= uint8_t(filterIndex & 15) << 4;
-
-	auto ptr    = output.blocks[0].samples;
+	// Blocks in any format are assembled in the space of a 4-bit block, which
+	// is the largest one.
+	auto ptr    = reinterpret_cast<uint8_t *>(output.blocks);
 	auto filter = ADPCM_FILTER_COEFFS_[filterIndex];
 
+	*(ptr++) = uint8_t((gain & 15) | ((filterIndex & 15) << 4));
+
 	const int a1 = filter[0], a2 = filter[1];
 	int       s1 = s1_,       s2 = s2_;
 
+	const int sampleBits = getSSTSampleBits(format_);
+	const int maxValue   = (1 << (sampleBits - 1)) - 1;
+
 	const int actualGain = gain + ADPCM_FILTER_BITS_;
-	int       lastNibble = -1;
+	uint32_t  bitBuffer  = 0;
+	int       bitLength  = 0;
 	int64_t   totalError = 0;
 
 	for (int i = SST_SAMPLES_PER_BLOCK; i > 0; i--) {
@@ -124,15 +147,14 @@ IRAM_ATTR int64_t SSTEncoder::tryEncodeBlock_(
 		encoded    -= residual;
 		encoded    += 1 << (actualGain - 1);
 		encoded   >>= actualGain;
-		encoded     = util::clamp(encoded, -8, 7);
+		encoded     = util::clamp(encoded, -maxValue - 1, maxValue);
 
-		const int nibble = encoded + 8;
+		bitBuffer |= uint32_t(encoded + maxValue + 1) << bitLength;
+		bitLength += sampleBits;
 
-		if (lastNibble < 0) {
-			lastNibble = nibble;
-		} else {
-			*(ptr++)   = lastNibble | (nibble << 4);
-			lastNibble = -1;
+		for (; bitLength >= 8; bitLength -= 8) {
+			*(ptr++)    = uint8_t(bitBuffer);
+			bitBuffer >>= 8;
 		}
 
 		// Simulate the sample being decoded back in order to measure the error.
@@ -148,32 +170,355 @@ IRAM_ATTR int64_t SSTEncoder::tryEncodeBlock_(
 		s1 = decoded;
 	}
 
+	if (bitLength)
+		*ptr = uint8_t(bitBuffer);
+
 	output.s1 = int16_t(s1);
 	output.s2 = int16_t(s2);
 	return totalError;
 }
 
+#ifdef DSP_USE_SIMD
+
+/*
+ * Vectorized candidate search. When building for the host, multiple filters are
+ * evaluated at once by assigning each one to a SIMD lane. GCC's vector
+ * extensions are used in order to let the compiler lower this code to SSE4.1 or
+ * AVX2 instructions depending on the target, or to plain scalar code as a
+ * fallback. The results are bit-exact with the scalar encoder.
+ *
+ * The number of lanes is matched to the native vector width, as the compiler
+ * will otherwise fall back to scalar code for per-lane variable shifts.
+ */
+
+#if defined(__AVX512F__)
+static constexpr size_t NUM_LANES_ = 16;
+#elif defined(__AVX2__)
+static constexpr size_t NUM_LANES_ = 8;
+#else
+static constexpr size_t NUM_LANES_ = 4;
+#endif
+
+using FilterLanes_      =
+	int32_t  [[gnu::vector_size(NUM_LANES_ * sizeof(int32_t))]];
+using UnsignedLanes_    =
+	uint32_t [[gnu::vector_size(NUM_LANES_ * sizeof(uint32_t))]];
+
+template<typename T> static inline void clampLanes_(
+	T   &value,
+	int low,
+	int high
+) {
+	value = (value < low)  ? T{} + low  : value;
+	value = (value > high) ? T{} + high : value;
+}
+
+static inline void getFilterLanes_(
+	FilterLanes_ &a1,
+	FilterLanes_ &a2,
+	size_t       firstFilter
+) {
+	for (size_t i = 0; i < NUM_LANES_; i++) {
+		a1[i] = ADPCM_FILTER_COEFFS_[firstFilter + i][0];
+		a2[i] = ADPCM_FILTER_COEFFS_[firstFilter + i][1];
+	}
+}
+
+static void estimateBlockGainLanes_(
+	FilterLanes_ &output,
+	const Sample *samples,
+	size_t       firstFilter,
+	int          sampleBits,
+	int          initialS1,
+	int          initialS2
+) {
+	// Same as SSTEncoder::estimateBlockGain_(), but for multiple filters.
+	FilterLanes_ a1, a2;
+	getFilterLanes_(a1, a2, firstFilter);
+
+	FilterLanes_ s1      = FilterLanes_{} + initialS1;
+	FilterLanes_ s2      = FilterLanes_{} + initialS2;
+	FilterLanes_ posPeak = {}, negPeak = {};
+
+	for (size_t i = 0; i < SST_SAMPLES_PER_BLOCK; i++) {
+		const int sample = samples[i];
+
+		FilterLanes_ encoded = FilterLanes_{} + (sample << ADPCM_FILTER_BITS_);
+		encoded             -= a1 * s1;
+		encoded             -= a2 * s2;
+		encoded             -= ADPCM_FILTER_BIAS_;
+		encoded            >>= ADPCM_FILTER_BITS_;
+
+		posPeak = (encoded > posPeak) ? encoded : posPeak;
+		negPeak = (encoded < negPeak) ? encoded : negPeak;
+
+		s2 = s1;
+		s1 = encoded;
+	}
+
+	// As the peaks only shrink when shifted, counting how many of the shift
+	// amounts up to the maximum gain leave them out of range yields the same
+	// result as the scalar search loop.
+	const int maxValue = (1 << (sampleBits - 1)) - 1;
+	const int maxGain  = getMaxGain_(sampleBits);
+
+	output = FilterLanes_{};
+
+	for (int i = 0; i < maxGain; i++)
+		output -= ((posPeak >> i) > maxValue) | ((negPeak >> i) < -maxValue - 1);
+
+	clampLanes_(output, 1, maxGain);
+}
+
+static void tryEncodeBlockLanes_(
+	int64_t            *output,
+	const Sample       *samples,
+	size_t             firstFilter,
+	const FilterLanes_ &gains,
+	int                sampleBits,
+	int                initialS1,
+	int                initialS2
+) {
+	// Same as SSTEncoder::tryEncodeBlock_(), but for multiple filters. Only the
+	// error is computed; the winning combination is then re-encoded using the
+	// scalar implementation.
+	FilterLanes_ a1, a2;
+	getFilterLanes_(a1, a2, firstFilter);
+
+	const FilterLanes_ actualGain = gains + ADPCM_FILTER_BITS_;
+	const FilterLanes_ rounding   = 1 << (actualGain - 1);
+	const int          maxValue   = (1 << (sampleBits - 1)) - 1;
+
+	FilterLanes_   s1       = FilterLanes_{} + initialS1;
+	FilterLanes_   s2       = FilterLanes_{} + initialS2;
+	UnsignedLanes_ errorLow = {}, errorHigh = {};
+
+	for (size_t i = 0; i < SST_SAMPLES_PER_BLOCK; i++) {
+		const int sample = samples[i];
+
+		FilterLanes_ residual = a1 * s1;
+		residual             += a2 * s2;
+		residual             += ADPCM_FILTER_BIAS_;
+
+		FilterLanes_ encoded = (sample << ADPCM_FILTER_BITS_) - residual;
+		encoded             += rounding;
+		encoded            >>= actualGain;
+		clampLanes_(encoded, -maxValue - 1, maxValue);
+
+		FilterLanes_ decoded = encoded << actualGain;
+		decoded             += residual;
+		decoded            >>= ADPCM_FILTER_BITS_;
+		clampLanes_(decoded, INT16_MIN, INT16_MAX);
+
+		// The squared error always fits in 32 bits when treated as unsigned.
+		// Rather than widening each lane to 64 bits, the sum is split into two
+		// 32-bit halves with manual carry propagation.
+		auto error = UnsignedLanes_(sample - decoded);
+		error     *= error;
+		errorLow  += error;
+		errorHigh -= errorLow < error;
+
+		s2 = s1;
+		s1 = decoded;
+	}
+
+	for (size_t i = 0; i < NUM_LANES_; i++)
+		output[i] = (int64_t(errorHigh[i]) << 32) | int64_t(errorLow[i]);
+}
+
+static void searchFilterLanes_(
+	int          &bestFilter,
+	int          &bestGain,
+	const Sample *samples,
+	int          sampleBits,
+	int          initialS1,
+	int          initialS2
+) {
+	// Bruteforce 32 possible combinations of filter index and gain, trying the
+	// same gain offset for a group of filters at a time.
+	int     gainOffsets[NUM_FILTERS_];
+	int64_t errors[2][NUM_FILTERS_];
+
+	for (size_t i = 0; i < NUM_FILTERS_; i += NUM_LANES_) {
+		FilterLanes_ gains;
+
+		estimateBlockGainLanes_(
+			gains,
+			samples,
+			i,
+			sampleBits,
+			initialS1,
+			initialS2
+		);
+
+		for (size_t j = 0; j < NUM_LANES_; j++)
+			gainOffsets[i + j] = gains[j];
+
+		for (int j = 0; j < 2; j++)
+			tryEncodeBlockLanes_(
+				&errors[j][i],
+				samples,
+				i,
+				gains + j - 1,
+				sampleBits,
+				initialS1,
+				initialS2
+			);
+	}
+
+	int64_t bestError = INT64_MAX;
+
+	for (size_t i = 0; i < NUM_FILTERS_; i++) {
+		for (int j = 0; j < 2; j++) {
+			if (errors[j][i] < bestError) {
+				bestError  = errors[j][i];
+				bestGain   = j - 1 + gainOffsets[i];
+				bestFilter = i;
+			}
+		}
+	}
+}
+
+#endif
+
+/*
+ * Filter pre-ranking for faster quality presets. The energy of the residual each
+ * filter would leave (ignoring quantization) is derived from the block's
+ * short-term covariance, so that only the most promising filters have to be
+ * trial encoded.
+ */
+
+DRAM_ATTR static const uint8_t QUALITY_FILTER_COUNTS_[]{
+	1,           // SST_QUALITY_DRAFT
+	2,           // SST_QUALITY_FAST
+	4,           // SST_QUALITY_NORMAL
+	NUM_FILTERS_ // SST_QUALITY_BEST
+};
+
+IRAM_ATTR static void rankFilters_(
+	uint8_t      *output,
+	size_t       numFilters,
+	const Sample *input,
+	int          s1,
+	int          s2,
+	size_t       inputStride
+) {
+	int64_t c00 = 0, c01 = 0, c02 = 0;
+	int64_t c11 = 0, c12 = 0, c22 = 0;
+
+	for (int i = SST_SAMPLES_PER_BLOCK; i > 0; i--) {
+		const int sample = *input;
+		input           += inputStride;
+
+		c00 += sample * sample;
+		c01 += sample * s1;
+		c02 += sample * s2;
+		c11 += s1     * s1;
+		c12 += s1     * s2;
+		c22 += s2     * s2;
+
+		s2 = s1;
+		s1 = sample;
+	}
+
+	// sum((x[n] * 256 - a1 * x[n - 1] - a2 * x[n - 2]) ^ 2) can be expanded
+	// into a quadratic form of the coefficients and the covariance terms.
+	int64_t errors[NUM_FILTERS_];
+
+	for (size_t i = 0; i < NUM_FILTERS_; i++) {
+		const int64_t a1 = ADPCM_FILTER_COEFFS_[i][0];
+		const int64_t a2 = ADPCM_FILTER_COEFFS_[i][1];
+
+		int64_t error = c00 << (ADPCM_FILTER_BITS_ * 2);
+		error        -= (a1 * c01 + a2 * c02) << (ADPCM_FILTER_BITS_ + 1);
+		error        += a1 * a1 * c11;
+		error        += a1 * a2 * c12 * 2;
+		error        += a2 * a2 * c22;
+
+		errors[i] = error;
+	}
+
+	// Perform a partial selection sort to find the best filters.
+	uint16_t selected = 0;
+
+	for (; numFilters > 0; numFilters--) {
+		int64_t bestError = INT64_MAX;
+		int     best      = 0;
+
+		for (size_t i = 0; i < NUM_FILTERS_; i++) {
+			if ((selected >> i) & 1)
+				continue;
+
+			if (errors[i] < bestError) {
+				bestError = errors[i];
+				best      = i;
+			}
+		}
+
+		selected   |= 1 << best;
+		*(output++) = uint8_t(best);
+	}
+}
+
 IRAM_ATTR void SSTEncoder::encodeBlock_(
-	SSTBlock     &output,
+	uint8_t      *output,
 	const Sample *input,
 	size_t       inputStride
 ) {
-	// Bruteforce 48 possible combinations of filter index and gain in order to
-	// find the one that produces the lowest noise floor.
-	SSTChunk<1> encodes[util::countOf(ADPCM_FILTER_COEFFS_)][3];
+	uint8_t      filters[NUM_FILTERS_];
+	const size_t numFilters = QUALITY_FILTER_COUNTS_[quality_];
+
+	if (numFilters < NUM_FILTERS_) {
+		rankFilters_(filters, numFilters, input, s1_, s2_, inputStride);
+	} else {
+#ifdef DSP_USE_SIMD
+		Sample samples[SST_SAMPLES_PER_BLOCK];
+
+		for (auto &sample : samples) {
+			sample = *input;
+			input += inputStride;
+		}
+
+		int         bestFilter = 0, bestGain = 0;
+		SSTChunk<1> encode;
+
+		searchFilterLanes_(
+			bestFilter,
+			bestGain,
+			samples,
+			getSSTSampleBits(format_),
+			s1_,
+			s2_
+		);
+		tryEncodeBlock_(encode, samples, bestGain, bestFilter);
+		memcpy(output, encode.blocks, getSSTBlockLength(format_));
+
+		s1_ = encode.s1;
+		s2_ = encode.s2;
+		return;
+#else
+		for (size_t i = 0; i < NUM_FILTERS_; i++)
+			filters[i] = uint8_t(i);
+#endif
+	}
+
+	// Bruteforce all combinations of the selected filters and 2 gain values in
+	// order to find the one that produces the lowest noise floor.
+	SSTChunk<1> encodes[NUM_FILTERS_][2];
 
 	int64_t bestError  = INT64_MAX;
 	auto    bestEncode = &encodes[0][0];
 
-	for (size_t i = 0; i < util::countOf(ADPCM_FILTER_COEFFS_); i++) {
-		const int gainOffset = estimateBlockGain_(input, i, inputStride);
+	for (size_t i = 0; i < numFilters; i++) {
+		const int gainOffset =
+			estimateBlockGain_(input, filters[i], inputStride);
 
 		for (int j = 0; j < 2; j++) {
 			auto error = tryEncodeBlock_(
 				encodes[i][j],
 				input,
 				j - 1 + gainOffset,
-				i,
+				filters[i],
 				inputStride
 			);
 
@@ -184,15 +529,15 @@ IRAM_ATTR void SSTEncoder::encodeBlock_(
 		}
 	}
 
-	util::copy(output, bestEncode->blocks[0]);
+	memcpy(output, bestEncode->blocks, getSSTBlockLength(format_));
 
 	s1_ = bestEncode->s1;
 	s2_ = bestEncode->s2;
 }
 
-IRAM_ATTR void SSTEncoder::reset(void) {
-	s1_ = 0;
-	s2_ = 0;
+IRAM_ATTR void SSTEncoder::reset(Sample s1, Sample s2) {
+	s1_ = s1;
+	s2_ = s2;
 }
 
 IRAM_ATTR size_t SSTEncoder::encode(
@@ -201,8 +546,9 @@ IRAM_ATTR size_t SSTEncoder::encode(
 	size_t       numSamples,
 	size_t       inputStride
 ) {
-	auto         block     = output.getBlocks();
-	const size_t numBlocks =
+	auto         block       = reinterpret_cast<uint8_t *>(output.getBlocks());
+	const size_t blockLength = getSSTBlockLength(format_);
+	const size_t numBlocks   =
 		(numSamples + SST_SAMPLES_PER_BLOCK - 1) / SST_SAMPLES_PER_BLOCK;
 
 	// Before doing any encoding, dump the filter's current state so that the
@@ -222,9 +568,11 @@ IRAM_ATTR size_t SSTEncoder::encode(
 				input   += inputStride;
 			}
 
-			encodeBlock_(*(block++), buffer);
+			encodeBlock_(block, buffer);
+			block += blockLength;
 		} else {
-			encodeBlock_(*(block++), input, inputStride);
+			encodeBlock_(block, input, inputStride);
+			block += blockLength;
 
 			numSamples -= SST_SAMPLES_PER_BLOCK;
 			input      += inputStride * SST_SAMPLES_PER_BLOCK;
@@ -236,18 +584,91 @@ IRAM_ATTR size_t SSTEncoder::encode(
 
 /* 12-byte .sst ADPCM decoder */
 
+[[gnu::always_inline]] static inline int decodeSample_(
+	int value,
+	int gain,
+	int a1,
+	int a2,
+	int &s1,
+	int &s2
+) {
+	int sample = value << gain;
+	sample    += a1 * s1;
+	sample    += a2 * s2;
+	sample    += ADPCM_FILTER_BIAS_;
+	sample   >>= ADPCM_FILTER_BITS_;
+	sample     = clampSample_(sample);
+
+	s2 = s1;
+	s1 = sample;
+	return sample;
+}
+
+IRAM_ATTR static void unpackBlock_(
+	int8_t         *output,
+	const uint8_t  *input,
+	SSTBlockFormat format
+) {
+	// Extract the samples of a block in any format (skipping its header) as
+	// signed values.
+	const int sampleBits = getSSTSampleBits(format);
+	const int mask       = (1 << sampleBits) - 1;
+	const int offset     = 1 << (sampleBits - 1);
+
+	uint32_t bitBuffer = 0;
+	int      bitLength = 0;
+
+	input++;
+
+	for (int i = SST_SAMPLES_PER_BLOCK; i > 0; i--) {
+		if (bitLength < sampleBits) {
+			bitBuffer |= uint32_t(*(input++)) << bitLength;
+			bitLength += 8;
+		}
+
+		*(output++) = int8_t(int(bitBuffer & mask) - offset);
+		bitBuffer >>= sampleBits;
+		bitLength  -= sampleBits;
+	}
+}
+
 IRAM_ATTR size_t decodeSST(
 	Sample             *output,
 	const SSTChunkBase &input,
 	size_t             numBlocks,
-	size_t             outputStride
+	size_t             outputStride,
+	SSTBlockFormat     format
 ) {
 	const size_t numSamples = numBlocks * SST_SAMPLES_PER_BLOCK;
 
-	auto block = input.getBlocks();
-
 	int s1 = input.s1, s2 = input.s2;
 
+	if (format != SST_FORMAT_4BIT) {
+		auto         block       = input.getBlock(0, format);
+		const size_t blockLength = getSSTBlockLength(format);
+
+		for (; numBlocks > 0; numBlocks--, block += blockLength) {
+			auto header = reinterpret_cast<const SSTBlock *>(block);
+			auto filter = ADPCM_FILTER_COEFFS_[header->getFilterIndex()];
+
+			const int a1 = filter[0], a2 = filter[1];
+
+			const int gain = header->getGain() + ADPCM_FILTER_BITS_;
+
+			int8_t values[SST_SAMPLES_PER_BLOCK];
+			unpackBlock_(values, block, format);
+
+			for (int value : values) {
+				*output = Sample(decodeSample_(value, gain, a1, a2, s1, s2));
+				output += outputStride;
+			}
+		}
+
+		return numSamples;
+	}
+
+	auto block = input.getBlocks();
+
 	for (; numBlocks > 0; numBlocks--, block++) {
 		auto ptr    = block->samples;
 		auto filter = ADPCM_FILTER_COEFFS_[block->getFilterIndex()];
@@ -257,41 +678,392 @@ IRAM_ATTR size_t decodeSST(
 		const int gain = block->getGain() + ADPCM_FILTER_BITS_;
 
 		for (int i = SST_SAMPLES_PER_BLOCK; i > 0; i -= 2) {
-			const int nibble1 = int(*ptr & 15) - 8;
-			const int nibble2 = int(*ptr >> 4) - 8;
-			ptr++;
-
-			int sample1 = nibble1 << gain;
-			sample1    += a1 * s1;
-			sample1    += a2 * s2;
-			sample1    += ADPCM_FILTER_BIAS_;
-			sample1   >>= ADPCM_FILTER_BITS_;
-			sample1     = clampSample_(sample1);
+			const int value  = *(ptr++);
+			const int value1 = (value & 15) - 8;
+			const int value2 = (value >> 4) - 8;
 
-			*output = Sample(sample1);
+			*output = Sample(decodeSample_(value1, gain, a1, a2, s1, s2));
 			output += outputStride;
+			*output = Sample(decodeSample_(value2, gain, a1, a2, s1, s2));
+			output += outputStride;
+		}
+	}
 
-			s2 = s1;
-			s1 = sample1;
+	return numSamples;
+}
 
-			int sample2 = nibble2 << gain;
-			sample2    += a1 * s1;
-			sample2    += a2 * s2;
-			sample2    += ADPCM_FILTER_BIAS_;
-			sample2   >>= ADPCM_FILTER_BITS_;
-			sample2     = clampSample_(sample2);
+template<bool MID_SIDE> [[gnu::always_inline]] static inline void storeFrame_(
+	Sample *output,
+	int    left,
+	int    right
+) {
+	if (MID_SIDE) {
+		output[0] = Sample(clampSample_(left + right));
+		output[1] = Sample(clampSample_(left - right));
+	} else {
+		output[0] = Sample(left);
+		output[1] = Sample(right);
+	}
+}
 
-			*output = Sample(sample2);
-			output += outputStride;
+template<bool MID_SIDE> [[gnu::always_inline]] static inline size_t
+decodeSSTStereo_(
+	Sample         *output,
+	const SSTBlock *left,
+	const SSTBlock *right,
+	size_t         numBlocks,
+	Sample         *history
+) {
+	// Decoding both channels in the same loop halves the loop overhead, gives
+	// the CPU two independent dependency chains to interleave and turns the
+	// strided stores of two separate passes into a single sequential one. In
+	// mid/side mode the left and right chunks hold the mid and side channels
+	// respectively, which are converted back on the fly.
+	const size_t numSamples = numBlocks * SST_SAMPLES_PER_BLOCK;
 
-			s2 = s1;
-			s1 = sample2;
+	int l1 = history[2], l2 = history[0];
+	int r1 = history[3], r2 = history[1];
+
+	for (; numBlocks > 0; numBlocks--, left++, right++) {
+		auto leftPtr     = left->samples;
+		auto rightPtr    = right->samples;
+		auto leftFilter  = ADPCM_FILTER_COEFFS_[left->getFilterIndex()];
+		auto rightFilter = ADPCM_FILTER_COEFFS_[right->getFilterIndex()];
+
+		const int la1 = leftFilter[0],  la2 = leftFilter[1];
+		const int ra1 = rightFilter[0], ra2 = rightFilter[1];
+
+		const int leftGain  = left->getGain()  + ADPCM_FILTER_BITS_;
+		const int rightGain = right->getGain() + ADPCM_FILTER_BITS_;
+
+		for (int i = SST_SAMPLES_PER_BLOCK; i > 0; i -= 2) {
+			const int leftValue   = *(leftPtr++);
+			const int rightValue  = *(rightPtr++);
+			const int leftValue1  = (leftValue  & 15) - 8;
+			const int leftValue2  = (leftValue  >> 4) - 8;
+			const int rightValue1 = (rightValue & 15) - 8;
+			const int rightValue2 = (rightValue >> 4) - 8;
+
+			storeFrame_<MID_SIDE>(
+				&output[0],
+				decodeSample_(leftValue1,  leftGain,  la1, la2, l1, l2),
+				decodeSample_(rightValue1, rightGain, ra1, ra2, r1, r2)
+			);
+			storeFrame_<MID_SIDE>(
+				&output[2],
+				decodeSample_(leftValue2,  leftGain,  la1, la2, l1, l2),
+				decodeSample_(rightValue2, rightGain, ra1, ra2, r1, r2)
+			);
+			output += 4;
+		}
+	}
+
+	history[0] = Sample(l2);
+	history[1] = Sample(r2);
+	history[2] = Sample(l1);
+	history[3] = Sample(r1);
+	return numSamples;
+}
+
+template<bool MID_SIDE> [[gnu::always_inline]] static inline size_t
+decodePackedSSTStereo_(
+	Sample         *output,
+	const uint8_t  *left,
+	const uint8_t  *right,
+	size_t         numBlocks,
+	Sample         *history,
+	SSTBlockFormat leftFormat,
+	SSTBlockFormat rightFormat
+) {
+	// Slower path for reduced-bitrate blocks, which unpacks each block into a
+	// temporary buffer first.
+	const size_t numSamples       = numBlocks * SST_SAMPLES_PER_BLOCK;
+	const size_t leftBlockLength  = getSSTBlockLength(leftFormat);
+	const size_t rightBlockLength = getSSTBlockLength(rightFormat);
+
+	int l1 = history[2], l2 = history[0];
+	int r1 = history[3], r2 = history[1];
+
+	for (
+		; numBlocks > 0;
+		numBlocks--, left += leftBlockLength, right += rightBlockLength
+	) {
+		auto leftHeader  = reinterpret_cast<const SSTBlock *>(left);
+		auto rightHeader = reinterpret_cast<const SSTBlock *>(right);
+		auto leftFilter  = ADPCM_FILTER_COEFFS_[leftHeader->getFilterIndex()];
+		auto rightFilter = ADPCM_FILTER_COEFFS_[rightHeader->getFilterIndex()];
+
+		const int la1 = leftFilter[0],  la2 = leftFilter[1];
+		const int ra1 = rightFilter[0], ra2 = rightFilter[1];
+
+		const int leftGain  = leftHeader->getGain()  + ADPCM_FILTER_BITS_;
+		const int rightGain = rightHeader->getGain() + ADPCM_FILTER_BITS_;
+
+		int8_t leftValues[SST_SAMPLES_PER_BLOCK];
+		int8_t rightValues[SST_SAMPLES_PER_BLOCK];
+
+		unpackBlock_(leftValues,  left,  leftFormat);
+		unpackBlock_(rightValues, right, rightFormat);
+
+		for (size_t i = 0; i < SST_SAMPLES_PER_BLOCK; i++) {
+			storeFrame_<MID_SIDE>(
+				output,
+				decodeSample_(leftValues[i],  leftGain,  la1, la2, l1, l2),
+				decodeSample_(rightValues[i], rightGain, ra1, ra2, r1, r2)
+			);
+			output += 2;
+		}
+	}
+
+	history[0] = Sample(l2);
+	history[1] = Sample(r2);
+	history[2] = Sample(l1);
+	history[3] = Sample(r1);
+	return numSamples;
+}
+
+IRAM_ATTR size_t decodeSSTStereo(
+	Sample         *output,
+	const uint8_t  *left,
+	const uint8_t  *right,
+	size_t         numBlocks,
+	Sample         *history,
+	bool           midSide,
+	SSTBlockFormat leftFormat,
+	SSTBlockFormat rightFormat
+) {
+	if ((leftFormat != SST_FORMAT_4BIT) || (rightFormat != SST_FORMAT_4BIT)) {
+		if (midSide)
+			return decodePackedSSTStereo_<true>(
+				output,
+				left,
+				right,
+				numBlocks,
+				history,
+				leftFormat,
+				rightFormat
+			);
+		else
+			return decodePackedSSTStereo_<false>(
+				output,
+				left,
+				right,
+				numBlocks,
+				history,
+				leftFormat,
+				rightFormat
+			);
+	}
+
+	auto leftBlocks  = reinterpret_cast<const SSTBlock *>(left);
+	auto rightBlocks = reinterpret_cast<const SSTBlock *>(right);
+
+	if (midSide)
+		return decodeSSTStereo_<true>(
+			output,
+			leftBlocks,
+			rightBlocks,
+			numBlocks,
+			history
+		);
+	else
+		return decodeSSTStereo_<false>(
+			output,
+			leftBlocks,
+			rightBlocks,
+			numBlocks,
+			history
+		);
+}
+
+IRAM_ATTR size_t decodeSSTStereo(
+	Sample             *output,
+	const SSTChunkBase &left,
+	const SSTChunkBase &right,
+	size_t             numBlocks,
+	bool               midSide,
+	SSTBlockFormat     leftFormat,
+	SSTBlockFormat     rightFormat
+) {
+	Sample history[]{ left.s2, right.s2, left.s1, right.s1 };
+
+	return decodeSSTStereo(
+		output,
+		left.getBlock(0, leftFormat),
+		right.getBlock(0, rightFormat),
+		numBlocks,
+		history,
+		midSide,
+		leftFormat,
+		rightFormat
+	);
+}
+
+IRAM_ATTR size_t decodeSSTMono(
+	Sample         *output,
+	const uint8_t  *input,
+	size_t         numBlocks,
+	Sample         *history,
+	SSTBlockFormat format
+) {
+	// Mono chunks are decoded once and written to both channels, rather than
+	// decoding the same chunk twice through decodeSSTStereo().
+	const size_t numSamples  = numBlocks * SST_SAMPLES_PER_BLOCK;
+	const size_t blockLength = getSSTBlockLength(format);
+
+	int s1 = history[2], s2 = history[0];
+
+	for (; numBlocks > 0; numBlocks--, input += blockLength) {
+		auto header = reinterpret_cast<const SSTBlock *>(input);
+		auto filter = ADPCM_FILTER_COEFFS_[header->getFilterIndex()];
+
+		const int a1 = filter[0], a2 = filter[1];
+
+		const int gain = header->getGain() + ADPCM_FILTER_BITS_;
+
+		int8_t values[SST_SAMPLES_PER_BLOCK];
+
+		if (format == SST_FORMAT_4BIT) {
+			auto ptr = header->samples;
+
+			for (size_t i = 0; i < SST_SAMPLES_PER_BLOCK; i += 2) {
+				const int value = *(ptr++);
+				values[i + 0]   = int8_t((value & 15) - 8);
+				values[i + 1]   = int8_t((value >> 4) - 8);
+			}
+		} else {
+			unpackBlock_(values, input, format);
+		}
+
+		for (int value : values) {
+			const int sample = decodeSample_(value, gain, a1, a2, s1, s2);
+
+			output[0] = Sample(sample);
+			output[1] = Sample(sample);
+			output   += 2;
 		}
 	}
 
+	history[0] = Sample(s2);
+	history[1] = Sample(s2);
+	history[2] = Sample(s1);
+	history[3] = Sample(s1);
 	return numSamples;
 }
 
+#ifdef DSP_USE_SIMD
+
+/*
+ * Vectorized batch decoding. As the filter state does not carry over from one
+ * chunk to the next, multiple chunks can be decoded in parallel by assigning
+ * each one to a SIMD lane. Blocks are transposed into lane order, decoded using
+ * the same arithmetic as decodeSample_() and transposed back.
+ */
+
+static void decodeSSTLanes_(
+	Sample        *output,
+	const uint8_t *input,
+	size_t        numBlocks,
+	size_t        inputStride,
+	size_t        outputStride
+) {
+	const SSTBlock *blocks[NUM_LANES_];
+	FilterLanes_   s1, s2;
+
+	for (size_t i = 0; i < NUM_LANES_; i++) {
+		auto chunk = reinterpret_cast<const SSTChunkBase *>(input);
+		input     += inputStride;
+
+		blocks[i] = chunk->getBlocks();
+		s1[i]     = chunk->s1;
+		s2[i]     = chunk->s2;
+	}
+
+	for (; numBlocks > 0; numBlocks--) {
+		FilterLanes_ a1, a2, gain;
+		FilterLanes_ values[sizeof(SSTBlock::samples)];
+
+		for (size_t i = 0; i < NUM_LANES_; i++) {
+			auto block  = blocks[i]++;
+			auto filter = ADPCM_FILTER_COEFFS_[block->getFilterIndex()];
+
+			a1[i]   = filter[0];
+			a2[i]   = filter[1];
+			gain[i] = block->getGain() + ADPCM_FILTER_BITS_;
+
+			for (size_t j = 0; j < util::countOf(values); j++)
+				values[j][i] = block->samples[j];
+		}
+
+		FilterLanes_ decoded[SST_SAMPLES_PER_BLOCK];
+		auto         ptr = decoded;
+
+		for (auto &value : values) {
+			for (int shift = 0; shift < 8; shift += 4) {
+				FilterLanes_ sample = (((value >> shift) & 15) - 8) << gain;
+				sample             += a1 * s1;
+				sample             += a2 * s2;
+				sample             += ADPCM_FILTER_BIAS_;
+				sample            >>= ADPCM_FILTER_BITS_;
+				clampLanes_(sample, INT16_MIN, INT16_MAX);
+
+				*(ptr++) = sample;
+				s2       = s1;
+				s1       = sample;
+			}
+		}
+
+		for (size_t i = 0; i < NUM_LANES_; i++) {
+			auto dest = &output[i * outputStride];
+
+			for (auto &sample : decoded)
+				*(dest++) = Sample(sample[i]);
+		}
+
+		output += SST_SAMPLES_PER_BLOCK;
+	}
+}
+
+#endif
+
+IRAM_ATTR size_t decodeSSTBatch(
+	Sample             *output,
+	const SSTChunkBase &input,
+	size_t             numChunks,
+	size_t             numBlocks,
+	size_t             inputStride,
+	size_t             outputStride,
+	SSTBlockFormat     format
+) {
+	auto ptr = reinterpret_cast<const uint8_t *>(&input);
+
+#ifdef DSP_USE_SIMD
+	if (format == SST_FORMAT_4BIT) {
+		for (; numChunks >= NUM_LANES_; numChunks -= NUM_LANES_) {
+			decodeSSTLanes_(output, ptr, numBlocks, inputStride, outputStride);
+
+			ptr    += inputStride  * NUM_LANES_;
+			output += outputStride * NUM_LANES_;
+		}
+	}
+#endif
+
+	for (; numChunks > 0; numChunks--) {
+		decodeSST(
+			output,
+			*reinterpret_cast<const SSTChunkBase *>(ptr),
+			numBlocks,
+			1,
+			format
+		);
+
+		ptr    += inputStride;
+		output += outputStride;
+	}
+
+	return numBlocks * SST_SAMPLES_PER_BLOCK;
+}
+
 /* 16-byte BRR ADPCM decoder (unused) */
 
 DRAM_ATTR static const int8_t SIGN_EXTENSION_LUT_[]{
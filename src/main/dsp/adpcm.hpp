@@ -22,6 +22,23 @@ public:
 	}
 };
 
+static constexpr size_t SST_SAMPLES_PER_BLOCK = sizeof(SSTBlock::samples) * 2;
+
+// Reduced-bitrate blocks use the same header as SSTBlock, followed by samples
+// packed LSB first into 9 (3-bit) or 6 (2-bit) bytes rather than 11.
+enum SSTBlockFormat : uint8_t {
+	SST_FORMAT_4BIT = 0,
+	SST_FORMAT_3BIT = 1,
+	SST_FORMAT_2BIT = 2
+};
+
+static constexpr inline int getSSTSampleBits(SSTBlockFormat format) {
+	return 4 - format;
+}
+static constexpr inline size_t getSSTBlockLength(SSTBlockFormat format) {
+	return 1 + (SST_SAMPLES_PER_BLOCK * getSSTSampleBits(format) + 7) / 8;
+}
+
 class [[gnu::packed]] SSTChunkBase {
 public:
 	int16_t s1, s2;
@@ -32,18 +49,40 @@ public:
 	inline SSTBlock *getBlocks(void) {
 		return reinterpret_cast<SSTBlock *>(&this[1]);
 	}
+	inline const uint8_t *getBlock(
+		size_t         index,
+		SSTBlockFormat format = SST_FORMAT_4BIT
+	) const {
+		return
+			reinterpret_cast<const uint8_t *>(&this[1]) +
+			index * getSSTBlockLength(format);
+	}
 };
 
+static constexpr inline size_t getSSTChunkLength(
+	size_t         numBlocks,
+	SSTBlockFormat format = SST_FORMAT_4BIT
+) {
+	return sizeof(SSTChunkBase) + numBlocks * getSSTBlockLength(format);
+}
+
 template<size_t N> class [[gnu::packed]] SSTChunk : public SSTChunkBase {
 public:
 	SSTBlock blocks[N];
 };
 
-static constexpr size_t SST_SAMPLES_PER_BLOCK = sizeof(SSTBlock::samples) * 2;
+enum SSTEncoderQuality : uint8_t {
+	SST_QUALITY_DRAFT  = 0,
+	SST_QUALITY_FAST   = 1,
+	SST_QUALITY_NORMAL = 2,
+	SST_QUALITY_BEST   = 3
+};
 
 class SSTEncoder {
 private:
-	Sample s1_, s2_;
+	Sample            s1_, s2_;
+	SSTEncoderQuality quality_;
+	SSTBlockFormat    format_;
 
 	int estimateBlockGain_(
 		const Sample *input,
@@ -58,17 +97,32 @@ private:
 		size_t       inputStride = 1
 	);
 	void encodeBlock_(
-		SSTBlock     &output,
+		uint8_t      *output,
 		const Sample *input,
 		size_t       inputStride = 1
 	);
 
 public:
-	inline SSTEncoder(void) {
+	inline SSTEncoder(
+		SSTEncoderQuality quality = SST_QUALITY_BEST,
+		SSTBlockFormat    format  = SST_FORMAT_4BIT
+	) :
+		quality_(quality),
+		format_(format)
+	{
 		reset();
 	}
+	inline void setQuality(SSTEncoderQuality quality) {
+		quality_ = quality;
+	}
+	inline void setFormat(SSTBlockFormat format) {
+		format_ = format;
+	}
 
-	void reset(void);
+	// The filter state may be seeded with the two source samples preceding the
+	// data to be encoded (s1 being the most recent one), allowing each chunk to
+	// be encoded independently of the previous ones.
+	void reset(Sample s1 = 0, Sample s2 = 0);
 	size_t encode(
 		SSTChunkBase &output,
 		const Sample *input,
@@ -81,7 +135,8 @@ size_t decodeSST(
 	Sample             *output,
 	const SSTChunkBase &input,
 	size_t             numBlocks,
-	size_t             outputStride = 1
+	size_t             outputStride = 1,
+	SSTBlockFormat     format       = SST_FORMAT_4BIT
 );
 
 template<size_t N> static inline size_t decodeSST(
@@ -92,6 +147,67 @@ template<size_t N> static inline size_t decodeSST(
 	return decodeSST(output, input, N, outputStride);
 }
 
+// Decodes two chunks in lockstep into a buffer of interleaved stereo frames.
+// The output is identical to calling decodeSST() on each chunk with
+// outputStride = 2. If midSide is set, the chunks are assumed to contain mid
+// and side channels rather than left and right and converted accordingly. The
+// first overload resumes decoding from arbitrary blocks, taking the filter
+// state from the given history (two frames, oldest first) and updating it once
+// done.
+size_t decodeSSTStereo(
+	Sample         *output,
+	const uint8_t  *left,
+	const uint8_t  *right,
+	size_t         numBlocks,
+	Sample         *history,
+	bool           midSide     = false,
+	SSTBlockFormat leftFormat  = SST_FORMAT_4BIT,
+	SSTBlockFormat rightFormat = SST_FORMAT_4BIT
+);
+size_t decodeSSTStereo(
+	Sample             *output,
+	const SSTChunkBase &left,
+	const SSTChunkBase &right,
+	size_t             numBlocks,
+	bool               midSide     = false,
+	SSTBlockFormat     leftFormat  = SST_FORMAT_4BIT,
+	SSTBlockFormat     rightFormat = SST_FORMAT_4BIT
+);
+
+template<size_t N> static inline size_t decodeSSTStereo(
+	Sample            *output,
+	const SSTChunk<N> &left,
+	const SSTChunk<N> &right,
+	bool              midSide = false
+) {
+	return decodeSSTStereo(output, left, right, N, midSide);
+}
+
+// Decodes a single chunk into a buffer of stereo frames, duplicating each sample
+// into both channels. Decoding is resumable in the same way as
+// decodeSSTStereo(), using the same history layout.
+size_t decodeSSTMono(
+	Sample         *output,
+	const uint8_t  *input,
+	size_t         numBlocks,
+	Sample         *history,
+	SSTBlockFormat format = SST_FORMAT_4BIT
+);
+
+// Decodes multiple chunks of the same length, spaced inputStride bytes apart in
+// memory, into separate buffers spaced outputStride samples apart. On the host
+// 4-bit chunks are decoded in parallel using SIMD instructions; the output is
+// identical to calling decodeSST() on each chunk.
+size_t decodeSSTBatch(
+	Sample             *output,
+	const SSTChunkBase &input,
+	size_t             numChunks,
+	size_t             numBlocks,
+	size_t             inputStride,
+	size_t             outputStride,
+	SSTBlockFormat     format = SST_FORMAT_4BIT
+);
+
 /* 16-byte BRR ADPCM decoder (unused) */
 
 class [[gnu::packed]] BRRBlock {
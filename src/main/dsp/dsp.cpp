@@ -3,6 +3,7 @@
 #include <math.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 #include "src/main/util/templates.hpp"
 #include "src/main/dsp/dsp.hpp"
 #include "src/main/defs.hpp"
@@ -67,11 +68,20 @@ IRAM_ATTR void Gain::process(
 	}
 }
 
-IRAM_ATTR void Mixer::configure(float gain1, float gain2) {
+IRAM_ATTR void Mixer::configure(
+	float gain1,
+	float gain2,
+	float trim1,
+	float trim2
+) {
+	// Coefficients of up to 2x cannot overflow the 32-bit accumulator, even
+	// when both inputs are at full scale.
 	gain1 = util::clamp(gain1, 0.0f, 1.0f);
 	gain1 = sinf(gain1 * (float(M_PI) / 2.0f));
+	gain1 = util::clamp(trim1, 0.0f, 2.0f) * gain1;
 	gain2 = util::clamp(gain2, 0.0f, 1.0f);
 	gain2 = sinf(gain2 * (float(M_PI) / 2.0f));
+	gain2 = util::clamp(trim2, 0.0f, 2.0f) * gain2;
 
 	a1_ = int32_t(float(GAIN_UNIT_) * gain1 + 0.5f);
 	a2_ = int32_t(float(GAIN_UNIT_) * gain2 + 0.5f);
@@ -418,14 +428,39 @@ IRAM_ATTR void WaveformEncoder::reset(void) {
 	accumulator_ = 0;
 	currentPeak_ = 0;
 	lastNibble_  = -1;
+
+	lowFilter_.reset();
+	midLowFilter_.reset();
+	midHighFilter_.reset();
+	highFilter_.reset();
+	filterRate_   = 0;
+	windowLength_ = 0;
+
+	for (int i = 0; i < NUM_WAVEFORM_BANDS; i++) {
+		bandEnergies_[i]    = 0.0f;
+		lastBandNibbles_[i] = 0;
+	}
+}
+
+static int encodeBandLevel_(float energy, int windowLength) {
+	if ((energy <= 0.0f) || !windowLength)
+		return 0;
+
+	// 20 * log10(32768) = 90.309 dB
+	const float level = 10.0f * log10f(energy / float(windowLength)) - 90.309f;
+	const int   steps =
+		int((level - WAVEFORM_BAND_FLOOR) / WAVEFORM_BAND_STEP + 0.5f);
+
+	return util::clamp(steps, 0, 15);
 }
 
 IRAM_ATTR size_t WaveformEncoder::encode(
-	uint8_t      *output,
-	const Sample *input,
-	int          sampleRate,
-	size_t       numSamples,
-	size_t       inputStride
+	uint8_t        *output,
+	const Sample   *input,
+	int            sampleRate,
+	size_t         numSamples,
+	size_t         inputStride,
+	uint8_t *const *bandOutputs
 ) {
 	auto ptr = output;
 
@@ -433,11 +468,25 @@ IRAM_ATTR size_t WaveformEncoder::encode(
 	int currentPeak = currentPeak_;
 	int lastNibble  = lastNibble_;
 
+	if (bandOutputs && (sampleRate != filterRate_)) {
+		const float nyquist = float(sampleRate) / 2.0f;
+
+		const float lowCutoff  = WAVEFORM_LOW_CUTOFF  / nyquist;
+		const float highCutoff = WAVEFORM_HIGH_CUTOFF / nyquist;
+
+		// The mid band's filters are named after the edges they form.
+		lowFilter_.configure(FILTER_LOWPASS, lowCutoff, float(M_SQRT1_2));
+		midLowFilter_.configure(FILTER_HIGHPASS, lowCutoff, float(M_SQRT1_2));
+		midHighFilter_.configure(FILTER_LOWPASS, highCutoff, float(M_SQRT1_2));
+		highFilter_.configure(FILTER_HIGHPASS, highCutoff, float(M_SQRT1_2));
+		filterRate_ = sampleRate;
+	}
+
 	for (; numSamples > 0; numSamples--) {
 		// Dither the block size (i.e. how many input samples are used to
 		// compute each waveform sample) over time. This is the same DDA
 		// algorithm used in the bitcrusher.
-		accumulator += WAVEFORM_SAMPLE_RATE;
+		accumulator += outputRate_;
 
 		if (accumulator >= sampleRate) {
 			accumulator -= sampleRate;
@@ -446,6 +495,25 @@ IRAM_ATTR size_t WaveformEncoder::encode(
 			nibble      = util::clamp(nibble, 0, WAVEFORM_RANGE - 1);
 			currentPeak = 0;
 
+			if (bandOutputs) {
+				const size_t offset = ptr - output;
+
+				for (int i = 0; i < NUM_WAVEFORM_BANDS; i++) {
+					const int bandNibble =
+						encodeBandLevel_(bandEnergies_[i], windowLength_);
+
+					if (lastNibble < 0)
+						lastBandNibbles_[i] = bandNibble;
+					else
+						bandOutputs[i][offset] =
+							lastBandNibbles_[i] | (bandNibble << 4);
+
+					bandEnergies_[i] = 0.0f;
+				}
+
+				windowLength_ = 0;
+			}
+
 			if (lastNibble < 0) {
 				lastNibble = nibble;
 			} else {
@@ -454,10 +522,26 @@ IRAM_ATTR size_t WaveformEncoder::encode(
 			}
 		}
 
-		// Find the peak in each block.
 		int sample = *input;
 		input     += inputStride;
 
+		// Accumulate the energy of each band. The mid band is filtered
+		// separately rather than derived from the other two, as subtracting
+		// them would leave phase shifted content from around the cutoffs in it.
+		if (bandOutputs) {
+			const float value = float(sample);
+			const float low   = lowFilter_.update(value);
+			const float mid   =
+				midHighFilter_.update(midLowFilter_.update(value));
+			const float high  = highFilter_.update(value);
+
+			bandEnergies_[WAVEFORM_BAND_LOW]  += low  * low;
+			bandEnergies_[WAVEFORM_BAND_MID]  += mid  * mid;
+			bandEnergies_[WAVEFORM_BAND_HIGH] += high * high;
+			windowLength_++;
+		}
+
+		// Find the peak in each block.
 		if (sample < 0)
 			sample = -sample;
 		if (sample > currentPeak)
@@ -470,4 +554,32 @@ IRAM_ATTR size_t WaveformEncoder::encode(
 	return ptr - output;
 }
 
+IRAM_ATTR size_t resampleWaveform(
+	uint8_t       *output,
+	const uint8_t *input,
+	size_t        inputLength,
+	size_t        outputLength
+) {
+	if (!inputLength)
+		outputLength = 0;
+
+	memset(output, 0, (outputLength + 1) / 2);
+
+	for (size_t i = 0; i < outputLength; i++) {
+		// Each output sample covers at least one input sample, even if the
+		// input is shorter than the output.
+		size_t start = (i * inputLength) / outputLength;
+		size_t end   = ((i + 1) * inputLength) / outputLength;
+		end          = util::max(end, start + 1);
+		int    peak  = 0;
+
+		for (; start < end; start++)
+			peak = util::max(peak, getWaveformSample(input, start));
+
+		output[i / 2] |= peak << ((i % 2) * 4);
+	}
+
+	return outputLength;
+}
+
 }
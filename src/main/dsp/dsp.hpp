@@ -62,7 +62,14 @@ public:
 		configure(0.5f, 0.5f);
 	}
 
-	void configure(float gain1, float gain2);
+	// The trims are linear gains applied on top of the (sine shaped) volumes
+	// and can be used to boost either input by up to 6 dB.
+	void configure(
+		float gain1,
+		float gain2,
+		float trim1 = 1.0f,
+		float trim2 = 1.0f
+	);
 	void process(
 		Sample       *output,
 		const Sample *input1,
@@ -182,25 +189,72 @@ public:
 static constexpr int     WAVEFORM_SAMPLE_RATE = 32;
 static constexpr uint8_t WAVEFORM_RANGE       = 12;
 
+// The encoder can optionally split its input into three bands and output the
+// RMS level of each alongside the peak waveform, as separate streams in the
+// same 4-bit format. Each step is 3 dB, with 15 corresponding to full scale and
+// 0 to -45 dBFS or less. The low and high bands are isolated by Butterworth
+// lowpass and highpass filters, while the mid band uses both in series as a
+// bandpass filter, so that all bands share the same edges.
+static constexpr int   NUM_WAVEFORM_BANDS   = 3;
+static constexpr float WAVEFORM_LOW_CUTOFF  =  250.0f;
+static constexpr float WAVEFORM_HIGH_CUTOFF = 2500.0f;
+static constexpr float WAVEFORM_BAND_FLOOR  =  -45.0f;
+static constexpr float WAVEFORM_BAND_STEP   =    3.0f;
+
+enum WaveformBand {
+	WAVEFORM_BAND_LOW  = 0,
+	WAVEFORM_BAND_MID  = 1,
+	WAVEFORM_BAND_HIGH = 2
+};
+
+// Waveform samples are packed two per byte, low nibble first.
+static inline int getWaveformSample(const uint8_t *data, size_t index) {
+	return (data[index / 2] >> ((index % 2) * 4)) & 15;
+}
+
 class WaveformEncoder {
 private:
-	int    accumulator_;
+	int    outputRate_, accumulator_;
 	Sample currentPeak_;
 	int8_t lastNibble_;
 
+	FloatBiquadFilter lowFilter_, midLowFilter_, midHighFilter_, highFilter_;
+	int               filterRate_, windowLength_;
+	float             bandEnergies_[NUM_WAVEFORM_BANDS];
+	uint8_t           lastBandNibbles_[NUM_WAVEFORM_BANDS];
+
 public:
-	inline WaveformEncoder(void) {
+	inline WaveformEncoder(int outputRate = WAVEFORM_SAMPLE_RATE) :
+		outputRate_(outputRate)
+	{
 		reset();
 	}
+	inline int getOutputRate(void) const {
+		return outputRate_;
+	}
 
 	void reset(void);
+	// If bandOutputs is not null, it must point to NUM_WAVEFORM_BANDS buffers
+	// as large as the main output buffer. Band levels should be either always
+	// or never requested for the same stream.
 	size_t encode(
-		uint8_t      *output,
-		const Sample *input,
-		int          sampleRate,
-		size_t       numSamples,
-		size_t       inputStride = 1
+		uint8_t        *output,
+		const Sample   *input,
+		int            sampleRate,
+		size_t         numSamples,
+		size_t         inputStride = 1,
+		uint8_t *const *bandOutputs = nullptr
 	);
 };
 
+// Resamples a waveform to an arbitrary number of samples, taking the peak of
+// each range of input samples. Used to generate fixed-length overviews of an
+// entire track.
+size_t resampleWaveform(
+	uint8_t       *output,
+	const uint8_t *input,
+	size_t        inputLength,
+	size_t        outputLength
+);
+
 }
@@ -1,5 +1,6 @@
 
 #include <assert.h>
+#include <math.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -14,6 +15,85 @@ namespace sst {
 
 static const char TAG_[]{ "sst" };
 
+/* .sst file structures */
+
+void SSTHeader::upgrade(void) {
+	if (info.magic != SST_LEGACY_MAGIC)
+		return;
+
+	// Files using the original layout have the string blob right after the
+	// shorter header info. Move the blob out of the way, zero out all fields
+	// added since then and terminate the last string if it got truncated.
+	constexpr size_t shift = sizeof(SSTHeaderInfo) - SST_LEGACY_HEADER_LENGTH;
+
+	memmove(
+		&strings[sizeof(SSTHeaderInfo)],
+		&strings[SST_LEGACY_HEADER_LENGTH],
+		sizeof(strings) - sizeof(SSTHeaderInfo)
+	);
+	memset(&strings[SST_LEGACY_HEADER_LENGTH], 0, shift);
+	strings[sizeof(strings) - 1] = 0;
+
+	// Any string that would now start past the end of the header is replaced
+	// with the (empty) last byte.
+	constexpr size_t last = sizeof(strings) - 1;
+
+	info.titleOffset  = util::min<size_t>(info.titleOffset  + shift, last);
+	info.artistOffset = util::min<size_t>(info.artistOffset + shift, last);
+	info.albumOffset  = util::min<size_t>(info.albumOffset  + shift, last);
+	info.genreOffset  = util::min<size_t>(info.genreOffset  + shift, last);
+
+	info.magic = SST_MAGIC;
+}
+
+bool SSTHeader::validateSilentRuns(void) const {
+	// Runs must be sorted and must not overlap, so that the stored index of
+	// each chunk can be found with a single pass.
+	if (info.numSilentRuns > SST_MAX_SILENT_RUNS)
+		return false;
+
+	uint32_t lastEnd = 0;
+
+	for (int i = 0; i < info.numSilentRuns; i++) {
+		auto &run = info.silentRuns[i];
+
+		// Check the start and length separately first, so that their sum
+		// cannot overflow.
+		if ((run.start < lastEnd) || (run.start > info.numChunks))
+			return false;
+		if (run.length > info.numChunks)
+			return false;
+
+		lastEnd = run.start + run.length;
+
+		if (lastEnd > info.numChunks)
+			return false;
+	}
+
+	return true;
+}
+
+bool SSTHeader::getSectorFormat(SSTSectorFormat &output, int variant) const {
+	output.flags       = info.flags & ~SST_FLAG_SILENT;
+	output.numChannels = info.numChannels;
+
+	for (size_t i = 0; i < NUM_CHANNELS; i++) {
+		auto format = info.blockFormats[variant][i % info.numChannels];
+
+		if (format > dsp::SST_FORMAT_2BIT)
+			return false;
+
+		output.blockFormats[i] = dsp::SSTBlockFormat(format);
+	}
+
+	// Mid/side conversion is meaningless for mono tracks, whose only channel
+	// is decoded into both output channels as-is.
+	if (info.numChannels == 1)
+		output.flags &= ~SST_FLAG_MID_SIDE;
+
+	return true;
+}
+
 /* .sst file reader */
 
 static const char *const KEY_NAMES_[]{
@@ -27,40 +107,82 @@ static const char *const KEY_NAMES_[]{
 };
 
 bool Reader::open(const char *path) {
-	if (file_)
+	if (file_->isOpen())
 		close();
 
-	size_t waveformOffset;
-
-	file_ = fopen(path, "rb");
+	size_t waveformLength;
 
-	if (!file_) {
+	if (!file_->open(path)) {
 		ESP_LOGE(TAG_, "could not open .sst file: %s", path);
 		return false;
 	}
 	if (
-		!fread(&header_, sizeof(SSTHeader), 1, file_) ||
+		!file_->read(&header_, sizeof(SSTHeader), 0) ||
 		!header_.validate()
 	) {
 		ESP_LOGE(TAG_, "not a valid .sst file: %s", path);
 		goto cleanup;
 	}
 
-	// Preload the entire waveform (which is typically just a few kilobytes).
-	waveform_.allocate((header_.info.waveformLength + 1) / 2);
-	assert(waveform_.ptr);
-
-	waveformOffset  = header_.info.numChunks * header_.info.numVariants;
-	waveformOffset *= sizeof(SSTSector);
-	waveformOffset += sizeof(SSTHeader);
+	header_.upgrade();
+	assert(header_.validate());
 
-	if (
-		fseek(file_, waveformOffset, SEEK_SET) ||
-		!fread(waveform_.ptr, waveform_.length, 1, file_)
-	) {
-		ESP_LOGE(TAG_, "could not load .sst waveform: %s", path);
+	if (!header_.validateSilentRuns()) {
+		ESP_LOGE(TAG_, "invalid .sst silent chunk map: %s", path);
 		goto cleanup;
 	}
+	if (header_.info.numWaveformLevels > SST_MAX_WAVEFORM_LEVELS) {
+		ESP_LOGE(TAG_, "invalid .sst waveform levels: %s", path);
+		goto cleanup;
+	}
+
+	// Each chunk is stored as a row of sectors, one per variant, whose lengths
+	// depend on the block formats used by each variant. Rows may additionally
+	// be grouped, storing the sectors of each variant for several consecutive
+	// chunks back to back (older files have no groups, i.e. one row each).
+	rowLength_      = 0;
+	chunksPerGroup_ = util::max<size_t>(header_.info.chunksPerGroup, 1);
+
+	for (int i = 0; i < header_.info.numVariants; i++) {
+		if (!header_.getSectorFormat(formats_[i], i)) {
+			ESP_LOGE(TAG_, "unsupported .sst block format: %s", path);
+			goto cleanup;
+		}
+
+		variantOffsets_[i] = rowLength_;
+		rowLength_        += formats_[i].getLength();
+	}
+
+	numStoredChunks_ = header_.info.numChunks;
+
+	for (int i = 0; i < header_.info.numSilentRuns; i++)
+		numStoredChunks_ -= header_.info.silentRuns[i].length;
+
+	// The waveform (which is typically just a few kilobytes) is stored at the
+	// end of the file, followed by any additional levels. Seeking there may be
+	// slow, so it is only allocated here and loaded later through
+	// loadWaveform().
+	numWaveformPlanes_ = 1;
+
+	if (header_.info.flags & SST_FLAG_WAVEFORM_BANDS)
+		numWaveformPlanes_ += dsp::NUM_WAVEFORM_BANDS;
+
+	waveformLength           = (header_.info.waveformLength + 1) / 2;
+	waveformLength          *= numWaveformPlanes_;
+	waveformLevelOffsets_[0] = 0;
+
+	for (int i = 0; i < header_.info.numWaveformLevels; i++) {
+		waveformLevelOffsets_[i + 1] = waveformLength;
+		waveformLength              +=
+			(header_.info.waveformLevels[i].length + 1) / 2 * numWaveformPlanes_;
+	}
+
+	waveform_.allocate(waveformLength);
+
+	waveformOffset_  = numStoredChunks_ * rowLength_;
+	waveformOffset_ += sizeof(SSTHeader);
+	waveformLoaded_  = 0;
+	waveformReady_   = !waveform_.ptr;
 
 	resetVariant();
 	ESP_LOGI(TAG_, "loaded .sst: %s (variant %d)", path, currentVariant_);
@@ -72,38 +194,153 @@ cleanup:
 }
 
 void Reader::close(void) {
-	if (!file_)
+	if (!file_->isOpen())
 		return;
 
-	fclose(file_);
+	file_->close();
 	waveform_.destroy();
-	file_ = nullptr;
+	waveformReady_ = false;
 }
 
-bool Reader::read(SSTSector &output, int chunk) {
-	if (!file_)
-		return false;
-	if ((chunk < 0) || (chunk >= header_.info.numChunks))
+bool Reader::loadWaveform(size_t maxLength) {
+	if (!isWaveformPending())
+		return waveformReady_;
+
+	const size_t length =
+		util::min(maxLength, waveform_.length - waveformLoaded_);
+
+	if (!file_->read(
+		&waveform_.as<uint8_t>()[waveformLoaded_],
+		length,
+		waveformOffset_ + waveformLoaded_
+	)) {
+		// Give up on the waveform rather than retrying, as the track can still
+		// be played without it.
+		ESP_LOGE(TAG_, "could not load .sst waveform");
+		waveform_.destroy();
 		return false;
+	}
 
-	size_t chunkOffset = chunk * header_.info.numVariants;
-	chunkOffset       += currentVariant_;
-	chunkOffset       *= sizeof(SSTSector);
-	chunkOffset       += sizeof(SSTHeader);
+	waveformLoaded_ += length;
+	waveformReady_   = (waveformLoaded_ >= waveform_.length);
+	return waveformReady_;
+}
 
-	if (
-		fseek(file_, chunkOffset, SEEK_SET) ||
-		!fread(&output, sizeof(SSTSector), 1, file_)
-	) {
-		ESP_LOGE(TAG_, ".sst read failed, c=%d, v=%d", chunk, currentVariant_);
+bool Reader::getWaveformLevel(WaveformLevel &output, int level) const {
+	if (!waveform_.ptr || (level < 0) || (level >= getNumWaveformLevels()))
 		return false;
+
+	auto ptr = &waveform_.as<uint8_t>()[waveformLevelOffsets_[level]];
+
+	if (level) {
+		auto &info = header_.info.waveformLevels[level - 1];
+
+		output.length     = info.length;
+		output.sampleRate = info.sampleRate;
+	} else {
+		output.length     = header_.info.waveformLength;
+		output.sampleRate = dsp::WAVEFORM_SAMPLE_RATE;
+	}
+
+	output.data = ptr;
+
+	for (int i = 0; i < dsp::NUM_WAVEFORM_BANDS; i++) {
+		if (numWaveformPlanes_ > 1) {
+			ptr            += (output.length + 1) / 2;
+			output.bands[i] = ptr;
+		} else {
+			output.bands[i] = nullptr;
+		}
 	}
 
 	return true;
 }
 
+bool Reader::getChunkOffset_(size_t &output, int chunk) const {
+	// Skip over any elided runs preceding the chunk, or return false if the
+	// chunk is part of one.
+	int storedChunk = chunk;
+
+	for (int i = 0; i < header_.info.numSilentRuns; i++) {
+		auto &run = header_.info.silentRuns[i];
+
+		if (chunk < int(run.start))
+			break;
+		if (chunk < int(run.start + run.length))
+			return false;
+
+		storedChunk -= run.length;
+	}
+
+	// The last group may hold fewer chunks than the others.
+	const size_t group       = storedChunk / chunksPerGroup_;
+	const size_t index       = storedChunk % chunksPerGroup_;
+	const size_t groupLength = util::min(
+		chunksPerGroup_,
+		numStoredChunks_ - group * chunksPerGroup_
+	);
+
+	output  = group * chunksPerGroup_ * rowLength_;
+	output += groupLength * variantOffsets_[currentVariant_];
+	output += index * formats_[currentVariant_].getLength();
+	output += sizeof(SSTHeader);
+	return true;
+}
+
+int Reader::readBatch(
+	uint8_t         *output,
+	SSTSectorFormat &format,
+	int             chunk,
+	int             numChunks
+) {
+	if (!file_->isOpen())
+		return 0;
+	if ((chunk < 0) || (chunk >= int(header_.info.numChunks)))
+		return 0;
+
+	format = formats_[currentVariant_];
+
+	// Silent chunks are synthesized without touching the file, one at a time.
+	size_t chunkOffset;
+
+	if (!getChunkOffset_(chunkOffset, chunk)) {
+		format.flags |= SST_FLAG_SILENT;
+		return 1;
+	}
+
+	// Extend the batch for as long as the following chunks are stored right
+	// after the previous ones, so that they can all be fetched in one go.
+	const size_t sectorLength = format.getLength();
+
+	numChunks = util::min(numChunks, int(header_.info.numChunks) - chunk);
+	int batchLength;
+
+	for (batchLength = 1; batchLength < numChunks; batchLength++) {
+		size_t nextOffset;
+
+		if (
+			!getChunkOffset_(nextOffset, chunk + batchLength) ||
+			(nextOffset != (chunkOffset + sectorLength * batchLength))
+		)
+			break;
+	}
+
+	if (!file_->read(output, sectorLength * batchLength, chunkOffset)) {
+		ESP_LOGE(
+			TAG_,
+			".sst read failed, c=%d+%d, v=%d",
+			chunk,
+			batchLength,
+			currentVariant_
+		);
+		return 0;
+	}
+
+	return batchLength;
+}
+
 void Reader::resetVariant(void) {
-	if (!file_)
+	if (!file_->isOpen())
 		return;
 
 	// Find the variant whose pitch offset is closest to zero.
@@ -123,7 +360,7 @@ void Reader::resetVariant(void) {
 }
 
 size_t Reader::getKeyName(char *output) const {
-	if (!file_)
+	if (!file_->isOpen())
 		return 0;
 
 	if (!header_.info.keyScale) {
@@ -153,109 +390,851 @@ size_t Reader::getKeyName(char *output) const {
 /* .sst sampler */
 
 static constexpr int CHUNK_INDEX_UNIT_ = SAMPLE_OFFSET_UNIT * SAMPLES_PER_SECTOR;
-static constexpr int STEP_THRESHOLD_   = SAMPLE_OFFSET_UNIT * 100;
+static constexpr int STEP_THRESHOLD_   = SAMPLE_OFFSET_UNIT / 100;
+
+static_assert(CHUNK_INDEX_UNIT_ < (INT32_MAX / 2));
+
+/* Interpolation kernels */
+
+// Only the upper bits of the fractional offset are used by each kernel, so
+// that all products fit in 32 bits.
+static constexpr int LINEAR_BITS_  = 14;
+static constexpr int HERMITE_BITS_ = 12;
+
+static constexpr int SINC_TAPS_       = 8;
+static constexpr int SINC_PHASE_BITS_ = 7;
+static constexpr int SINC_COEFF_BITS_ = 14;
+static constexpr int SINC_PHASES_     = 1 << SINC_PHASE_BITS_;
+
+// Number of frames preceding and following the current one that each kernel
+// requires.
+static constexpr int KERNEL_FRAMES_BEFORE_ =
+	(SAMPLER_KERNEL == KERNEL_SINC)    ? (SINC_TAPS_ / 2 - 1) :
+	(SAMPLER_KERNEL == KERNEL_HERMITE) ? 1 : 0;
+static constexpr int KERNEL_FRAMES_AFTER_  =
+	(SAMPLER_KERNEL == KERNEL_SINC)    ? (SINC_TAPS_ / 2) :
+	(SAMPLER_KERNEL == KERNEL_HERMITE) ? 2 : 1;
+static constexpr int KERNEL_LENGTH_        =
+	KERNEL_FRAMES_BEFORE_ + 1 + KERNEL_FRAMES_AFTER_;
+
+// Filled in by initSincTable_(), as there is no way to evaluate the window at
+// compile time.
+DRAM_ATTR static int16_t sincTable_[SINC_PHASES_][SINC_TAPS_];
+
+static void initSincTable_(void) {
+	constexpr float halfLength = float(SINC_TAPS_ / 2);
+	constexpr float coeffUnit  = float(1 << SINC_COEFF_BITS_);
+
+	for (int i = 0; i < SINC_PHASES_; i++) {
+		const float fraction = float(i) / float(SINC_PHASES_);
+		float       coeffs[SINC_TAPS_];
+		float       sum      = 0.0f;
+
+		// Blackman-windowed sinc, normalized so that each phase has unity gain.
+		for (int j = 0; j < SINC_TAPS_; j++) {
+			const float x = float(j - KERNEL_FRAMES_BEFORE_) - fraction;
+			const float a = float(M_PI) * x;
+			const float w = float(M_PI) * x / halfLength;
+
+			float value  = (x == 0.0f) ? 1.0f : (sinf(a) / a);
+			value       *= 0.42f + 0.5f * cosf(w) + 0.08f * cosf(2.0f * w);
+			coeffs[j]    = value;
+			sum         += value;
+		}
+
+		// Any rounding error is compensated for by adjusting the largest tap.
+		int total = 0;
+
+		for (int j = 0; j < SINC_TAPS_; j++) {
+			sincTable_[i][j] = int16_t(lroundf(coeffs[j] / sum * coeffUnit));
+			total           += sincTable_[i][j];
+		}
+
+		const int center =
+			KERNEL_FRAMES_BEFORE_ + ((i >= SINC_PHASES_ / 2) ? 1 : 0);
+
+		sincTable_[i][center] += int16_t((1 << SINC_COEFF_BITS_) - total);
+	}
+}
+
+// Interpolates a single channel. The frame pointer points to the channel's
+// sample in the frame preceding the offset; other frames are NUM_CHANNELS
+// samples apart. The fraction is a 0.16 fixed point value.
+IRAM_ATTR static inline int applyKernel_(
+	const dsp::Sample *frame,
+	int               fraction
+) {
+	constexpr int N = NUM_CHANNELS;
+
+	int value;
+
+	if constexpr (SAMPLER_KERNEL == KERNEL_SINC) {
+		auto coeffs = sincTable_[fraction >> (16 - SINC_PHASE_BITS_)];
+		frame      -= KERNEL_FRAMES_BEFORE_ * N;
+		value       = 1 << (SINC_COEFF_BITS_ - 1);
+
+		for (int i = 0; i < SINC_TAPS_; i++)
+			value += coeffs[i] * frame[i * N];
+
+		value >>= SINC_COEFF_BITS_;
+	} else if constexpr (SAMPLER_KERNEL == KERNEL_HERMITE) {
+		// 4-point, 3rd order Hermite (Catmull-Rom) spline. All coefficients
+		// are halved to keep the intermediate products within 32 bits.
+		const int x0 = frame[-N], x1 = frame[0];
+		const int x2 = frame[N],  x3 = frame[2 * N];
+		const int t  = fraction >> (16 - HERMITE_BITS_);
+
+		const int c1 = (x2 - x0) >> 1;
+		const int c2 = (2 * x0 - 5 * x1 + 4 * x2 - x3) >> 1;
+		const int c3 = ((x3 - x0) + 3 * (x1 - x2)) >> 1;
+
+		value   = (c3 * t) >> HERMITE_BITS_;
+		value   = ((value + c2) * t) >> HERMITE_BITS_;
+		value   = ((value + c1) * t) >> HERMITE_BITS_;
+		value  += x1;
+	} else {
+		const int alpha = fraction >> (16 - LINEAR_BITS_);
+
+		value = (frame[N] - frame[0]) * alpha;
+		value = frame[0] + value / (1 << LINEAR_BITS_);
+	}
+
+	return util::clamp(value, INT16_MIN, INT16_MAX);
+}
+
+/* .sst sampler runs */
+
+// Offsets outside of this range require frames from the previous or next
+// sector in order to be interpolated.
+static constexpr int FIRST_RUN_OFFSET_ =
+	KERNEL_FRAMES_BEFORE_ << SAMPLE_OFFSET_BITS;
+static constexpr int LAST_RUN_OFFSET_  =
+	int(SAMPLES_PER_SECTOR - KERNEL_FRAMES_AFTER_) << SAMPLE_OFFSET_BITS;
+
+IRAM_ATTR static inline int getRunLength_(
+	int    offset,
+	int    step,
+	size_t numSamples
+) {
+	// Determine how many samples can be generated, starting from the given
+	// offset, before either end of the sector is reached.
+	if ((offset < FIRST_RUN_OFFSET_) || (offset >= LAST_RUN_OFFSET_))
+		return 0;
+
+	int length;
+
+	if (step > 0)
+		length = (LAST_RUN_OFFSET_ - offset + step - 1) / step;
+	else
+		length = (offset - FIRST_RUN_OFFSET_) / (-step) + 1;
+
+	return util::min(length, int(numSamples));
+}
+
+IRAM_ATTR static inline dsp::Sample *copyRun_(
+	dsp::Sample       *output,
+	const dsp::Sample *input,
+	int               stride,
+	int               length
+) {
+	if (stride == NUM_CHANNELS) {
+		memcpy(output, input, length * sizeof(dsp::Sample) * NUM_CHANNELS);
+		return output + length * NUM_CHANNELS;
+	}
+
+	for (; length > 0; length--) {
+		for (size_t i = 0; i < NUM_CHANNELS; i++)
+			*(output++) = input[i];
+
+		input += stride;
+	}
+
+	return output;
+}
+
+IRAM_ATTR static inline dsp::Sample *interpolateRun_(
+	dsp::Sample       *output,
+	const dsp::Sample *input,
+	int               stride,
+	int               fraction,
+	int               length
+) {
+	for (; length > 0; length--) {
+		for (size_t i = 0; i < NUM_CHANNELS; i++)
+			*(output++) = applyKernel_(&input[i], fraction);
+
+		input += stride;
+	}
+
+	return output;
+}
+
+IRAM_ATTR static inline dsp::Sample *resampleRun_(
+	dsp::Sample       *output,
+	const dsp::Sample *input,
+	int               &offset,
+	int               step,
+	int               length
+) {
+	for (; length > 0; length--) {
+		const int sample   = offset >> SAMPLE_OFFSET_BITS;
+		const int fraction = offset & (SAMPLE_OFFSET_UNIT - 1);
+		auto      frame    = &input[sample * NUM_CHANNELS];
+
+		for (size_t i = 0; i < NUM_CHANNELS; i++)
+			*(output++) = applyKernel_(&frame[i], fraction);
+
+		offset += step;
+	}
+
+	return output;
+}
+
+IRAM_ATTR void SamplerCacheEntry::decode(int lastFrame) {
+	constexpr int blockLength = dsp::SST_SAMPLES_PER_BLOCK;
+
+	const int firstBlock = numDecodedFrames / blockLength;
+	const int numBlocks  = lastFrame / blockLength + 1 - firstBlock;
+
+	auto &left  = sector.getChunk(format, 0);
+	auto &right = sector.getChunk(format, 1);
+
+	if (!firstBlock) {
+		history[0][0] = left.s2;
+		history[0][1] = right.s2;
+		history[1][0] = left.s1;
+		history[1][1] = right.s1;
+	}
+
+	if (format.numChannels == 1)
+		dsp::decodeSSTMono(
+			samples[numDecodedFrames],
+			left.getBlock(firstBlock, format.blockFormats[0]),
+			numBlocks,
+			history[0],
+			format.blockFormats[0]
+		);
+	else
+		dsp::decodeSSTStereo(
+			samples[numDecodedFrames],
+			left.getBlock(firstBlock, format.blockFormats[0]),
+			right.getBlock(firstBlock, format.blockFormats[1]),
+			numBlocks,
+			history[0],
+			format.flags & SST_FLAG_MID_SIDE,
+			format.blockFormats[0],
+			format.blockFormats[1]
+		);
+
+	numDecodedFrames += numBlocks * blockLength;
+}
+
+static constexpr size_t MIN_UNPINNED_ENTRIES_ = 2;
+
+IRAM_ATTR int Sampler::findEntry_(int chunk) {
+	auto entries = entries_.as<SamplerCacheEntry>();
+
+	for (int index = getBucket_(chunk); index >= 0; ) {
+		if (entries[index].chunk == chunk)
+			return index;
+
+		index = entries[index].chained;
+	}
+
+	return -1;
+}
+
+IRAM_ATTR void Sampler::addToBucket_(int index) {
+	auto entries = entries_.as<SamplerCacheEntry>();
+	auto &bucket = getBucket_(entries[index].chunk);
+
+	entries[index].chained = bucket;
+	bucket                 = index;
+}
 
-IRAM_ATTR static inline int interpolate_(int sample1, int sample2, int alpha) {
-	int diff = (sample2 - sample1) * alpha;
-	diff    /= SAMPLE_OFFSET_UNIT;
+IRAM_ATTR void Sampler::removeFromBucket_(int index) {
+	auto entries = entries_.as<SamplerCacheEntry>();
+	auto link    = &getBucket_(entries[index].chunk);
 
-	return sample1 + diff;
+	while (*link != index)
+		link = &entries[*link].chained;
+
+	*link = entries[index].chained;
+}
+
+IRAM_ATTR void Sampler::addToList_(int index, bool front) {
+	auto entries = entries_.as<SamplerCacheEntry>();
+	auto &entry  = entries[index];
+
+	if (front) {
+		entry.prevEntry = -1;
+		entry.nextEntry = firstEntry_;
+
+		if (firstEntry_ >= 0)
+			entries[firstEntry_].prevEntry = index;
+		else
+			lastEntry_ = index;
+
+		firstEntry_ = index;
+	} else {
+		entry.prevEntry = lastEntry_;
+		entry.nextEntry = -1;
+
+		if (lastEntry_ >= 0)
+			entries[lastEntry_].nextEntry = index;
+		else
+			firstEntry_ = index;
+
+		lastEntry_ = index;
+	}
 }
 
-IRAM_ATTR const SamplerCacheEntry *Sampler::loadChunk_(int chunk) {
-	auto &oldEntry = cache_[currentCacheEntry_];
+IRAM_ATTR void Sampler::removeFromList_(int index) {
+	auto entries = entries_.as<SamplerCacheEntry>();
+	auto &entry  = entries[index];
 
-	if (oldEntry.chunk == chunk)
-		return &oldEntry;
+	if (entry.prevEntry >= 0)
+		entries[entry.prevEntry].nextEntry = entry.nextEntry;
+	else
+		firstEntry_ = entry.nextEntry;
 
-	currentCacheEntry_ ^= 1;
-	auto &newEntry      = cache_[currentCacheEntry_];
+	if (entry.nextEntry >= 0)
+		entries[entry.nextEntry].prevEntry = entry.prevEntry;
+	else
+		lastEntry_ = entry.prevEntry;
+}
+
+IRAM_ATTR void Sampler::touchEntry_(int index) {
+	auto &entry = entries_.as<SamplerCacheEntry>()[index];
+
+	// Pinned entries are not part of the LRU list at all, so that they can
+	// never be picked for eviction.
+	if (entry.pinned)
+		return;
 
-	if (newEntry.chunk == chunk)
-		return &newEntry;
+	if ((entry.chunk >= firstPinned_) && (entry.chunk <= lastPinned_)) {
+		removeFromList_(index);
+		entry.pinned = true;
+		numPinned_++;
+	} else if (index != firstEntry_) {
+		removeFromList_(index);
+		addToList_(index, true);
+	}
+}
 
-	// Decode the sector returned by the callback, falling back to generating
-	// silence if none was returned.
+IRAM_ATTR SamplerCacheEntry *Sampler::loadChunk_(int chunk) {
+	auto entries = entries_.as<SamplerCacheEntry>();
+
+	// Most lookups are for the sector that is currently being played, which is
+	// usually the most recently used one.
+	if (entries[firstEntry_].chunk == chunk) {
+		stats_.hits++;
+		return &entries[firstEntry_];
+	}
+
+	int index = findEntry_(chunk);
+
+	if (index >= 0) {
+		touchEntry_(index);
+		stats_.hits++;
+		return &entries[index];
+	}
+
+	// Evict the least recently used entry. Only entries holding a valid sector
+	// are present in the hash table.
+	index          = lastEntry_;
+	auto &newEntry = entries[index];
+
+	if (newEntry.chunk >= 0)
+		removeFromBucket_(index);
+
+	removeFromList_(index);
+	addToList_(index, true);
+	stats_.misses++;
+
+	// Copy the sector returned by the callback so that it can be decoded later
+	// on demand, falling back to generating silence if none was returned.
 	if (readCallback_) {
-		auto sector = readCallback_(chunk, arg_);
+		auto sector = readCallback_(chunk, newEntry.format, arg_);
 
 		if (sector) {
-			for (int i = 0; i < NUM_CHANNELS; i++)
-				dsp::decodeSST(
-					&newEntry.samples[0][i],
-					sector->channels[i],
-					NUM_CHANNELS
-				);
+			const bool silent = newEntry.format.flags & SST_FLAG_SILENT;
+
+			if (silent)
+				util::clear(newEntry.samples);
+			else
+				util::copy(newEntry.sector, *sector);
 
 			if (readDoneCallback_)
 				readDoneCallback_(sector, arg_);
 
-			newEntry.chunk = chunk;
+			newEntry.chunk            = chunk;
+			newEntry.numDecodedFrames = silent ? SAMPLES_PER_SECTOR : 0;
+
+			if (chunk >= 0) {
+				addToBucket_(index);
+				touchEntry_(index);
+			}
+
 			return &newEntry;
 		}
 	}
 
 	util::clear(newEntry.samples);
+	newEntry.chunk            = -1;
+	newEntry.numDecodedFrames = SAMPLES_PER_SECTOR;
 	return &newEntry;
 }
 
+bool Sampler::allocate(size_t numEntries) {
+	numEntries_ = 0;
+	numBuckets_ = 0;
+
+	if (numEntries < MIN_UNPINNED_ENTRIES_)
+		return false;
+
+	size_t numBuckets = 1;
+
+	while (numBuckets < numEntries)
+		numBuckets <<= 1;
+
+	if (!entries_.allocate<SamplerCacheEntry>(numEntries))
+		return false;
+	if (!buckets_.allocate<int>(numBuckets))
+		return false;
+
+	if constexpr (SAMPLER_KERNEL == KERNEL_SINC)
+		initSincTable_();
+
+	numEntries_ = numEntries;
+	numBuckets_ = numBuckets;
+	flush();
+	return true;
+}
+
 IRAM_ATTR void Sampler::flush(void) {
-	cache_[0].chunk = -1;
-	cache_[1].chunk = -1;
+	numPinned_ = 0;
+
+	if (!numEntries_)
+		return;
+
+	auto entries = entries_.as<SamplerCacheEntry>();
+	auto buckets = buckets_.as<int>();
+
+	for (size_t i = 0; i < numEntries_; i++) {
+		entries[i].chunk     = -1;
+		entries[i].prevEntry = int(i) - 1;
+		entries[i].nextEntry = int(i) + 1;
+		entries[i].pinned    = false;
+	}
+	for (size_t i = 0; i < numBuckets_; i++)
+		buckets[i] = -1;
+
+	entries[numEntries_ - 1].nextEntry = -1;
+
+	firstEntry_ = 0;
+	lastEntry_  = int(numEntries_) - 1;
+}
+
+IRAM_ATTR bool Sampler::pin(int firstChunk, int lastChunk) {
+	if ((firstChunk == firstPinned_) && (lastChunk == lastPinned_))
+		return true;
+
+	unpin();
+
+	const size_t maxPinned = numEntries_ - MIN_UNPINNED_ENTRIES_;
+
+	if (
+		(firstChunk < 0) ||
+		(lastChunk < firstChunk) ||
+		(size_t(lastChunk - firstChunk + 1) > maxPinned)
+	)
+		return false;
+
+	// Sectors already in the cache are pinned right away, while the other ones
+	// will be pinned as soon as they are loaded.
+	auto entries = entries_.as<SamplerCacheEntry>();
+
+	firstPinned_ = firstChunk;
+	lastPinned_  = lastChunk;
+
+	for (int chunk = firstChunk; chunk <= lastChunk; chunk++) {
+		const int index = findEntry_(chunk);
+
+		if (index < 0)
+			continue;
+
+		removeFromList_(index);
+		entries[index].pinned = true;
+		numPinned_++;
+	}
+
+	return true;
 }
 
-IRAM_ATTR void Sampler::process(
+IRAM_ATTR void Sampler::unpin(void) {
+	firstPinned_ = 0;
+	lastPinned_  = -1;
+
+	if (!numPinned_)
+		return;
+
+	// Pinned sectors are returned to the tail of the LRU list, as they are no
+	// longer going to be accessed repeatedly.
+	auto entries = entries_.as<SamplerCacheEntry>();
+
+	for (size_t i = 0; i < numEntries_; i++) {
+		if (!entries[i].pinned)
+			continue;
+
+		entries[i].pinned = false;
+		addToList_(int(i), false);
+	}
+
+	numPinned_ = 0;
+}
+
+IRAM_ATTR void Sampler::gatherFrames_(
+	dsp::Sample       *output,
+	SamplerCacheEntry *current,
+	int               chunk,
+	int               firstFrame,
+	bool              reverse
+) {
+	constexpr int N = NUM_CHANNELS;
+
+	const int lastFrame = firstFrame + KERNEL_LENGTH_ - 1;
+
+	current->decodeUntil(
+		util::clamp(lastFrame, 0, int(SAMPLES_PER_SECTOR - 1))
+	);
+
+	for (
+		int i = util::max(firstFrame, 0);
+		i <= util::min(lastFrame, int(SAMPLES_PER_SECTOR - 1));
+		i++
+	) {
+		for (int j = 0; j < N; j++)
+			output[(i - firstFrame) * N + j] = current->samples[i][j];
+	}
+
+	if ((firstFrame >= 0) && (lastFrame < int(SAMPLES_PER_SECTOR)))
+		return;
+
+	// The adjacent sector in the direction of playback is going to be needed
+	// right after this frame anyway, so it is loaded if not yet cached. The
+	// one behind is only used if it is still in the cache, as requesting it
+	// would flush the sector queue; the edge frame is repeated otherwise. The
+	// same applies to sectors lying entirely outside of the loop currently
+	// being played, as those are not going to be streamed in either.
+	const int adjacent = (firstFrame < 0) ? (chunk - 1) : (chunk + 1);
+
+	const int64_t framePosition    =
+		int64_t(chunk) * CHUNK_INDEX_UNIT_
+		+ (int64_t(firstFrame + KERNEL_FRAMES_BEFORE_) << SAMPLE_OFFSET_BITS);
+	const int64_t adjacentPosition = int64_t(adjacent) * CHUNK_INDEX_UNIT_;
+
+	const bool inLoop  = true
+		&& (loopEnd_ > loopStart_)
+		&& ((framePosition + SAMPLE_OFFSET_UNIT) > loopStart_)
+		&& (framePosition < loopEnd_);
+	const bool outside =
+		(adjacentPosition >= loopEnd_) ||
+		((adjacentPosition + CHUNK_INDEX_UNIT_) <= loopStart_);
+	const bool isAhead = (reverse == (firstFrame < 0)) && !(inLoop && outside);
+
+	SamplerCacheEntry *entry = nullptr;
+
+	if (isAhead && (adjacent >= 0)) {
+		entry = loadChunk_(adjacent);
+	} else if (adjacent >= 0) {
+		const int index = findEntry_(adjacent);
+
+		if (index >= 0)
+			entry = &entries_.as<SamplerCacheEntry>()[index];
+	}
+
+	if (firstFrame < 0) {
+		if (entry)
+			entry->decodeUntil(SAMPLES_PER_SECTOR - 1);
+
+		for (int i = firstFrame; i < util::min(lastFrame + 1, 0); i++) {
+			auto frame = entry
+				? entry->samples[i + SAMPLES_PER_SECTOR]
+				: current->samples[0];
+
+			for (int j = 0; j < N; j++)
+				output[(i - firstFrame) * N + j] = frame[j];
+		}
+	} else {
+		if (entry)
+			entry->decodeUntil(lastFrame - SAMPLES_PER_SECTOR);
+
+		for (
+			int i = util::max(firstFrame, int(SAMPLES_PER_SECTOR));
+			i <= lastFrame;
+			i++
+		) {
+			auto frame = entry
+				? entry->samples[i - SAMPLES_PER_SECTOR]
+				: current->samples[SAMPLES_PER_SECTOR - 1];
+
+			for (int j = 0; j < N; j++)
+				output[(i - firstFrame) * N + j] = frame[j];
+		}
+	}
+}
+
+IRAM_ATTR void Sampler::render_(
 	dsp::Sample *output,
-	int         offset,
+	int64_t     position,
 	int         step,
 	size_t      numSamples
 ) {
-	// Output silence if the playback rate is too slow.
-	if ((step > -STEP_THRESHOLD_) && (step < STEP_THRESHOLD_)) {
-		memset(output, 0, numSamples * sizeof(dsp::Sample) * NUM_CHANNELS);
-		return;
-	}
+	// Only the chunk index needs to be wider than 32 bits. The offset within
+	// the current chunk is kept as a 32-bit value, so that the loop below does
+	// not need any 64-bit arithmetic.
+	int chunk  = int(position / CHUNK_INDEX_UNIT_);
+	int offset = int(position % CHUNK_INDEX_UNIT_);
 
-	int chunk = offset / CHUNK_INDEX_UNIT_;
-	offset   %= CHUNK_INDEX_UNIT_;
+	// Integer steps (including 1:1 playback) use the same interpolation weights
+	// for all samples, which reduce to a copy if the offset is also an integer.
+	const bool isIntegerStep = !(step & (SAMPLE_OFFSET_UNIT - 1));
+	const int  stride        = (step >> SAMPLE_OFFSET_BITS) * NUM_CHANNELS;
 
 	auto cacheEntry = loadChunk_(chunk);
 
-	for (; numSamples > 0; numSamples--) {
-		const int sample = offset >> SAMPLE_OFFSET_BITS;
-		const int alpha  = offset & (SAMPLE_OFFSET_UNIT - 1);
-
-		const dsp::Sample *sample1 = cacheEntry->samples[sample];
-		const dsp::Sample *sample2;
-
-		// In order to perform linear interpolation, both the sample preceding
-		// the current offset and the one after it are required. This window may
-		// span two sectors, so two different cases must be handled here:
-		// - both samples are in the current sector
-		//   -> sample the current sector only;
-		// - the second sample is in the next sector
-		//   -> load the next sector and sample both.
-		if (sample != (SAMPLES_PER_SECTOR - 1))
-			sample2 = cacheEntry->samples[sample + 1];
-		else
-			sample2 = loadChunk_(chunk + 1)->samples[0];
+	while (numSamples > 0) {
+		// Process as many samples as possible in a single run that does not
+		// need to check for sector boundaries, decoding all blocks that are
+		// going to be accessed upfront.
+		const int length = getRunLength_(offset, step, numSamples);
 
-		for (int i = 0; i < NUM_CHANNELS; i++)
-			*(output++) = interpolate_(sample1[i], sample2[i], alpha);
+		if (length > 0) {
+			const int lastOffset = offset + (length - 1) * step;
+			const int lastFrame  = KERNEL_FRAMES_AFTER_
+				+ (util::max(offset, lastOffset) >> SAMPLE_OFFSET_BITS);
 
-		// Use a DDA-like algorithm to update the chunk index incrementally
-		// without performing division. As the step can be negative, overflows
-		// in either direction must be taken into account.
-		offset += step;
+			cacheEntry->decodeUntil(lastFrame);
+			const dsp::Sample *input = cacheEntry->samples[0];
+
+			if (isIntegerStep) {
+				const int fraction = offset & (SAMPLE_OFFSET_UNIT - 1);
+				input += (offset >> SAMPLE_OFFSET_BITS) * NUM_CHANNELS;
+
+				if (fraction)
+					output = interpolateRun_(
+						output,
+						input,
+						stride,
+						fraction,
+						length
+					);
+				else
+					output = copyRun_(output, input, stride, length);
+
+				offset += length * step;
+			} else {
+				output = resampleRun_(output, input, offset, step, length);
+			}
+
+			numSamples -= length;
+		} else {
+			// Frames close to either end of a sector have to be interpolated
+			// using frames from the adjacent sectors, which are gathered into
+			// a temporary buffer.
+			dsp::Sample frames[KERNEL_LENGTH_][NUM_CHANNELS];
+
+			const int sample   = offset >> SAMPLE_OFFSET_BITS;
+			const int fraction = offset & (SAMPLE_OFFSET_UNIT - 1);
+
+			gatherFrames_(
+				frames[0],
+				cacheEntry,
+				chunk,
+				sample - KERNEL_FRAMES_BEFORE_,
+				step < 0
+			);
 
+			for (size_t i = 0; i < NUM_CHANNELS; i++)
+				*(output++) = applyKernel_(
+					&frames[KERNEL_FRAMES_BEFORE_][i],
+					fraction
+				);
+
+			offset += step;
+			numSamples--;
+		}
+
+		// Move to the next or previous sector if the run ended past either
+		// boundary. The step is always shorter than a sector, so at most one
+		// boundary can be crossed at a time.
 		if (offset >= CHUNK_INDEX_UNIT_) {
-			cacheEntry = loadChunk_(--chunk);
+			cacheEntry = loadChunk_(++chunk);
 			offset    -= CHUNK_INDEX_UNIT_;
 		} else if (offset < 0) {
-			cacheEntry = loadChunk_(++chunk);
+			cacheEntry = loadChunk_(--chunk);
 			offset    += CHUNK_INDEX_UNIT_;
 		}
 	}
 }
 
+
+IRAM_ATTR int64_t Sampler::wrapLoop_(int64_t position, int step) {
+	const int64_t loopLength = loopEnd_ - loopStart_;
+
+	int64_t offset = (position - loopStart_) % loopLength;
+
+	if (offset < 0)
+		offset += loopLength;
+
+	// Start fading out the audio that would have been played had the loop not
+	// wrapped. The crossfade may not be longer than the loop itself.
+	if constexpr (LOOP_CROSSFADE_LENGTH > 0) {
+		const int     speed      = util::max(util::max(step, -step), 1);
+		const int64_t loopFrames = loopLength / speed;
+
+		fadePosition_  = position;
+		fadeLength_    = int(util::min(
+			loopFrames,
+			int64_t(LOOP_CROSSFADE_LENGTH)
+		));
+		fadeRemaining_ = fadeLength_;
+	}
+
+	return loopStart_ + offset;
+}
+
+IRAM_ATTR void Sampler::crossfade_(
+	dsp::Sample *output,
+	int         step,
+	size_t      numSamples
+) {
+	const int length = util::min(fadeRemaining_, int(numSamples));
+
+	// The audio past the loop boundary is not going to be streamed in, so the
+	// crossfade is skipped altogether unless all sectors it spans (including
+	// the frames required by the interpolation kernel) are already cached.
+	const int64_t lastPosition = fadePosition_ + int64_t(step) * (length - 1);
+	const int64_t firstFrame   =
+		(util::min(fadePosition_, lastPosition) >> SAMPLE_OFFSET_BITS)
+		- KERNEL_FRAMES_BEFORE_;
+	const int64_t lastFrame    =
+		(util::max(fadePosition_, lastPosition) >> SAMPLE_OFFSET_BITS)
+		+ KERNEL_FRAMES_AFTER_;
+
+	if (firstFrame < 0) {
+		fadeRemaining_ = 0;
+		return;
+	}
+
+	for (
+		int chunk = int(firstFrame / SAMPLES_PER_SECTOR);
+		chunk <= int(lastFrame / SAMPLES_PER_SECTOR);
+		chunk++
+	) {
+		if (findEntry_(chunk) < 0) {
+			fadeRemaining_ = 0;
+			return;
+		}
+	}
+
+	dsp::Sample tail[util::max(LOOP_CROSSFADE_LENGTH, 1)][NUM_CHANNELS];
+
+	render_(tail[0], fadePosition_, step, length);
+
+	for (int i = 0; i < length; i++) {
+		// Weight of the looped audio, in 1/16384 units.
+		const int progress = fadeLength_ - fadeRemaining_ + i + 1;
+		const int weight   = (progress << 14) / (fadeLength_ + 1);
+
+		for (size_t j = 0; j < NUM_CHANNELS; j++) {
+			const int sample = tail[i][j];
+			const int diff   = *output - sample;
+
+			*(output++) = dsp::Sample(sample + ((diff * weight) >> 14));
+		}
+	}
+
+	fadePosition_  += int64_t(step) * length;
+	fadeRemaining_ -= length;
+}
+
+IRAM_ATTR int64_t Sampler::process(
+	dsp::Sample *output,
+	int64_t     position,
+	int         step,
+	size_t      numSamples
+) {
+	// Output silence if the playback rate is too slow or if no cache has been
+	// allocated.
+	const bool tooSlow = (step > -STEP_THRESHOLD_) && (step < STEP_THRESHOLD_);
+	const bool silent  = tooSlow || !numEntries_;
+
+	const int64_t loopLength = loopEnd_ - loopStart_;
+
+	// Abandon any crossfade in progress if the caller moved the playback
+	// position since the last call.
+	if (position != nextPosition_)
+		fadeRemaining_ = 0;
+
+	// If the position is past the loop boundary in the direction of playback
+	// (e.g. because the loop was just set or moved), bring it back into the
+	// loop. Positions on the other side of the loop are left alone, as they
+	// are going to enter it anyway.
+	if (loopLength > 0) {
+		const bool pastEnd   = (step > 0) && (position >= loopEnd_);
+		const bool pastStart = (step < 0) && (position <  loopStart_);
+
+		if (pastEnd || pastStart)
+			position = wrapLoop_(position, step);
+	}
+
+	while (numSamples > 0) {
+		size_t length = numSamples;
+		bool   wrap   = false;
+
+		// If the loop boundary is going to be crossed within this buffer, split
+		// it at the exact sample the loop wraps at, so that no per-sample check
+		// is needed.
+		if (loopLength > 0) {
+			int64_t loopSamples = 0;
+
+			if (step > 0)
+				loopSamples = (loopEnd_ - position + step - 1) / step;
+			else if (step < 0)
+				loopSamples = (position - loopStart_) / (-step) + 1;
+
+			if (loopSamples && (loopSamples <= int64_t(length))) {
+				length = size_t(loopSamples);
+				wrap   = true;
+			}
+		}
+
+		if (silent) {
+			memset(output, 0, length * sizeof(dsp::Sample) * NUM_CHANNELS);
+		} else {
+			render_(output, position, step, length);
+
+			if constexpr (LOOP_CROSSFADE_LENGTH > 0) {
+				if (fadeRemaining_ > 0)
+					crossfade_(output, step, length);
+			}
+		}
+
+		output     += length * NUM_CHANNELS;
+		position   += int64_t(step) * int64_t(length);
+		numSamples -= length;
+
+		if (wrap)
+			position = wrapLoop_(position, step);
+	}
+
+	if (silent)
+		fadeRemaining_ = 0;
+
+	nextPosition_ = position;
+	return position;
+}
+
 }
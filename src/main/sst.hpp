@@ -3,9 +3,9 @@
 
 #include <stddef.h>
 #include <stdint.h>
-#include <stdio.h>
 #include "src/main/dsp/adpcm.hpp"
 #include "src/main/dsp/dsp.hpp"
+#include "src/main/util/file.hpp"
 #include "src/main/util/templates.hpp"
 
 namespace sst {
@@ -17,8 +17,13 @@ static constexpr size_t SAMPLES_PER_SECTOR =
 
 /* .sst file structures */
 
-static constexpr size_t SST_MAX_VARIANTS      = 16;
-static constexpr int    SST_PITCH_OFFSET_UNIT = 1 << 4;
+static constexpr size_t SST_MAX_VARIANTS        = 16;
+static constexpr size_t SST_MAX_SILENT_RUNS     = 32;
+static constexpr size_t SST_MAX_WAVEFORM_LEVELS = 4;
+static constexpr int    SST_PITCH_OFFSET_UNIT   = 1 << 4;
+static constexpr int    SST_BEAT_LENGTH_BITS    = 16;
+static constexpr int    SST_BEAT_LENGTH_UNIT    = 1 << SST_BEAT_LENGTH_BITS;
+static constexpr int    SST_LOUDNESS_UNIT       = 1 << 8;
 
 enum SSTKeyScale : uint8_t {
 	SCALE_UNKNOWN = 0,
@@ -26,6 +31,33 @@ enum SSTKeyScale : uint8_t {
 	SCALE_MINOR   = 2
 };
 
+enum SSTFlag : uint8_t {
+	SST_FLAG_MID_SIDE       = 1 << 0,
+	SST_FLAG_WAVEFORM_BANDS = 1 << 1,
+	SST_FLAG_LOUDNESS       = 1 << 2,
+	// Never set in the header, only used to mark elided sectors when reading.
+	SST_FLAG_SILENT         = 1 << 7
+};
+
+// Runs of chunks that only contain digital silence across all variants are
+// not stored in the file at all.
+struct [[gnu::packed]] SSTChunkRun {
+public:
+	uint32_t start, length;
+};
+
+// Lower resolution copies of the waveform, stored after the main one (each
+// padded to a whole byte) in the order they are listed in. Levels with a sample
+// rate of zero span the entire track, regardless of its length. If
+// SST_FLAG_WAVEFORM_BANDS is set, each level (including the main one) is
+// immediately followed by the levels of each frequency band, stored in the
+// same format and with the same length as the level itself.
+struct [[gnu::packed]] SSTWaveformLevel {
+public:
+	uint32_t length;
+	uint16_t sampleRate;
+};
+
 struct [[gnu::packed]] SSTHeaderInfo {
 public:
 	uint32_t magic;
@@ -37,6 +69,65 @@ public:
 
 	uint16_t titleOffset, artistOffset, albumOffset, genreOffset;
 	uint8_t  trackNumber, trackCount, discNumber, discCount;
+
+	uint8_t flags;
+	uint8_t blockFormats[SST_MAX_VARIANTS][NUM_CHANNELS];
+
+	uint8_t     numSilentRuns;
+	SSTChunkRun silentRuns[SST_MAX_SILENT_RUNS];
+
+	uint8_t chunksPerGroup;
+
+	uint8_t          numWaveformLevels;
+	SSTWaveformLevel waveformLevels[SST_MAX_WAVEFORM_LEVELS];
+
+	// Constant tempo beatgrid, anchored to the first downbeat (in samples). The
+	// beat length is a fixed point value in 1/SST_BEAT_LENGTH_UNIT sample
+	// units; tracks with no beatgrid have it set to zero.
+	uint32_t firstBeat, beatLength;
+	uint8_t  beatsPerBar;
+
+	// Integrated loudness (in LUFS) and true peak (in dBTP) of the whole track,
+	// in 1/SST_LOUDNESS_UNIT dB units. Only valid if SST_FLAG_LOUDNESS is set.
+	int16_t loudness, truePeak;
+};
+
+// Files using the original header layout, which ends right before the flags,
+// have a different magic. SSTHeader::upgrade() converts them to the current
+// layout after loading.
+static constexpr uint32_t SST_MAGIC                = "SST2"_c;
+static constexpr uint32_t SST_LEGACY_MAGIC         = "SST1"_c;
+static constexpr size_t   SST_LEGACY_HEADER_LENGTH =
+	offsetof(SSTHeaderInfo, flags);
+
+// Describes how the sectors of a variant are to be decoded. Each channel may be
+// stored using a different block format; the chunk for the second channel
+// immediately follows the first one's. Mono sectors only contain a single
+// chunk, which is shared by both output channels.
+struct SSTSectorFormat {
+public:
+	uint8_t             flags, numChannels;
+	dsp::SSTBlockFormat blockFormats[NUM_CHANNELS];
+
+	inline size_t getChunkLength(int channel) const {
+		return dsp::getSSTChunkLength(BLOCKS_PER_SECTOR, blockFormats[channel]);
+	}
+	inline size_t getChunkOffset(int channel) const {
+		size_t offset = 0;
+
+		for (int i = 0; i < (channel % numChannels); i++)
+			offset += getChunkLength(i);
+
+		return offset;
+	}
+	inline size_t getLength(void) const {
+		size_t length = 0;
+
+		for (int i = 0; i < numChannels; i++)
+			length += getChunkLength(i);
+
+		return length;
+	}
 };
 
 union [[gnu::packed]] SSTHeader {
@@ -44,14 +135,33 @@ public:
 	SSTHeaderInfo info;
 	char          strings[2048];
 
+	inline size_t getInfoLength(void) const {
+		return (info.magic == SST_LEGACY_MAGIC)
+			? SST_LEGACY_HEADER_LENGTH
+			: sizeof(SSTHeaderInfo);
+	}
 	inline bool validate(void) const {
+		const size_t infoLength = getInfoLength();
+
 		return true
-			&& (info.magic       == "SST1"_c)
+			&& (
+				(info.magic == SST_MAGIC) ||
+				(info.magic == SST_LEGACY_MAGIC)
+			)
 			&& (info.sampleRate  >= 8000)
 			&& (info.sampleRate  <= 192000)
 			&& (info.numVariants >= 1)
 			&& (info.numVariants <= SST_MAX_VARIANTS)
-			&& (info.numChannels == NUM_CHANNELS);
+			&& (info.numChannels >= 1)
+			&& (info.numChannels <= NUM_CHANNELS)
+			&& (info.titleOffset  >= infoLength)
+			&& (info.artistOffset >= infoLength)
+			&& (info.albumOffset  >= infoLength)
+			&& (info.genreOffset  >= infoLength)
+			&& (info.titleOffset  < sizeof(strings))
+			&& (info.artistOffset < sizeof(strings))
+			&& (info.albumOffset  < sizeof(strings))
+			&& (info.genreOffset  < sizeof(strings));
 	}
 	inline const char *getTitle(void) const {
 		return &strings[info.titleOffset];
@@ -65,36 +175,126 @@ public:
 	inline const char *getGenre(void) const {
 		return &strings[info.genreOffset];
 	}
+
+	void upgrade(void);
+	bool validateSilentRuns(void) const;
+	bool getSectorFormat(SSTSectorFormat &output, int variant) const;
 };
 
-struct [[gnu::packed]] SSTSector {
+union [[gnu::packed]] SSTSector {
 public:
 	dsp::SSTChunk<BLOCKS_PER_SECTOR> channels[NUM_CHANNELS];
+	uint8_t                          data[
+		NUM_CHANNELS * sizeof(dsp::SSTChunk<BLOCKS_PER_SECTOR>)
+	];
+
+	inline const dsp::SSTChunkBase &getChunk(
+		const SSTSectorFormat &format,
+		int                   channel
+	) const {
+		return *reinterpret_cast<const dsp::SSTChunkBase *>(
+			&data[format.getChunkOffset(channel)]
+		);
+	}
 };
 
 /* .sst file reader */
 
+// A single level of a track's waveform, as loaded by the reader. The band
+// pointers are null if the file has no band data.
+struct WaveformLevel {
+public:
+	const uint8_t *data;
+	const uint8_t *bands[dsp::NUM_WAVEFORM_BANDS];
+	size_t        length;
+	int           sampleRate;
+};
+
+// A track's constant tempo beatgrid, copied out of the header so that it can be
+// handed to other tasks. Beats are numbered starting from the first downbeat;
+// beats preceding it have negative indices. All offsets are in samples. The
+// methods below are only meaningful if isValid() returns true.
+struct Beatgrid {
+public:
+	int      sampleRate;
+	uint32_t firstBeat, beatLength;
+	int      beatsPerBar;
+
+	inline bool isValid(void) const {
+		return sampleRate && beatLength && beatsPerBar;
+	}
+	inline float getBPM(void) const {
+		return float(sampleRate * 60)
+			/ (float(beatLength) / float(SST_BEAT_LENGTH_UNIT));
+	}
+	inline int getBeatOffset(int beat) const {
+		// Round up, returning the first sample at or after the beat.
+		int64_t offset  = int64_t(beat) * beatLength;
+		offset         += SST_BEAT_LENGTH_UNIT - 1;
+
+		return int(firstBeat) + int(offset >> SST_BEAT_LENGTH_BITS);
+	}
+	inline int getBeatIndex(int offset) const {
+		if (!beatLength)
+			return 0;
+
+		int64_t delta  = int64_t(offset) - int64_t(firstBeat);
+		delta        <<= SST_BEAT_LENGTH_BITS;
+
+		// Round towards negative infinity, so that offsets preceding the first
+		// downbeat map to negative beats.
+		if (delta < 0)
+			delta -= beatLength - 1;
+
+		return int(delta / int64_t(beatLength));
+	}
+};
+
+// The reader uses a stdio backend by default, which can be swapped out for any
+// other util::File implementation while no file is open.
 class Reader {
 private:
-	FILE *file_;
-	int  currentVariant_;
+	util::File      *file_;
+	util::StdioFile defaultFile_;
+
+	int    currentVariant_;
+	size_t rowLength_, numStoredChunks_, chunksPerGroup_;
+
+	SSTSectorFormat formats_[SST_MAX_VARIANTS];
+	size_t          variantOffsets_[SST_MAX_VARIANTS];
 
 	SSTHeader  header_;
 	util::Data waveform_;
+	size_t     waveformOffset_, waveformLoaded_;
+	size_t     waveformLevelOffsets_[SST_MAX_WAVEFORM_LEVELS + 1];
+	int        numWaveformPlanes_;
+	bool       waveformReady_;
+
+	bool getChunkOffset_(size_t &output, int chunk) const;
 
 public:
 	inline Reader(void) :
-		file_(nullptr),
-		currentVariant_(0)
+		file_(&defaultFile_),
+		currentVariant_(0),
+		rowLength_(0),
+		numStoredChunks_(0),
+		chunksPerGroup_(1),
+		waveformOffset_(0),
+		waveformLoaded_(0),
+		numWaveformPlanes_(1),
+		waveformReady_(false)
 	{}
 	inline ~Reader(void) {
 		close();
 	}
 	inline const SSTHeader *getHeader(void) const {
-		return file_ ? &header_ : nullptr;
+		return file_->isOpen() ? &header_ : nullptr;
+	}
+	inline int getNumWaveformLevels(void) const {
+		return waveformReady_ ? (header_.info.numWaveformLevels + 1) : 0;
 	}
-	inline const util::Data &getWaveform(void) const {
-		return waveform_;
+	inline bool isWaveformPending(void) const {
+		return waveform_.ptr && !waveformReady_;
 	}
 	inline int getVariant(void) const {
 		return currentVariant_;
@@ -102,10 +302,58 @@ public:
 	inline void setVariant(int variant) {
 		currentVariant_ = util::clamp(variant, 0, header_.info.numVariants - 1);
 	}
+	inline void setBackend(util::File &file) {
+		close();
+		file_ = &file;
+	}
+	inline bool read(SSTSector &output, SSTSectorFormat &format, int chunk) {
+		return readBatch(output.data, format, chunk, 1) > 0;
+	}
 
 	bool open(const char *path);
 	void close(void);
-	bool read(SSTSector &output, int chunk);
+
+	// Reads up to numChunks consecutive chunks of the current variant into a
+	// buffer of packed sectors (format.getLength() bytes apart), using a
+	// single read for as many of them as are stored contiguously. Returns the
+	// number of chunks read, or 0 on failure. Silent chunks are returned one
+	// at a time with no data.
+	int readBatch(
+		uint8_t         *output,
+		SSTSectorFormat &format,
+		int             chunk,
+		int             numChunks
+	);
+
+	// The waveform is not loaded by open(), so that playback can start right
+	// away. Each call reads up to maxLength bytes of it; no levels are
+	// available until the whole waveform (including all levels) has been
+	// loaded. Level 0 is always the full resolution waveform.
+	bool loadWaveform(size_t maxLength);
+	bool getWaveformLevel(WaveformLevel &output, int level) const;
+
+	inline void getBeatgrid(Beatgrid &output) const {
+		if (!file_->isOpen()) {
+			util::clear(output);
+			return;
+		}
+
+		output.sampleRate  = header_.info.sampleRate;
+		output.firstBeat   = header_.info.firstBeat;
+		output.beatLength  = header_.info.beatLength;
+		output.beatsPerBar = header_.info.beatsPerBar;
+	}
+
+	// Loudness values are in LUFS and dBTP respectively.
+	inline bool hasLoudness(void) const {
+		return file_->isOpen() && (header_.info.flags & SST_FLAG_LOUDNESS);
+	}
+	inline float getLoudness(void) const {
+		return float(header_.info.loudness) / float(SST_LOUDNESS_UNIT);
+	}
+	inline float getTruePeak(void) const {
+		return float(header_.info.truePeak) / float(SST_LOUDNESS_UNIT);
+	}
 
 	void resetVariant(void);
 	size_t getKeyName(char *output) const;
@@ -113,36 +361,163 @@ public:
 
 /* .sst sampler */
 
-static constexpr int SAMPLE_OFFSET_BITS = 4;
+// Playback positions are 48.16 fixed point values (in samples), which do not
+// overflow even for multi-hour tracks. Steps are 16.16 values, as are offsets
+// within a single sector.
+static constexpr int SAMPLE_OFFSET_BITS = 16;
 static constexpr int SAMPLE_OFFSET_UNIT = 1 << SAMPLE_OFFSET_BITS;
 
-using ReadCallback     = const SSTSector *(*)(int chunk, void *arg);
+enum SamplerKernel {
+	KERNEL_LINEAR  = 0,
+	KERNEL_HERMITE = 1,
+	KERNEL_SINC    = 2
+};
+
+// Interpolation kernel used by the sampler, as a tradeoff between aliasing and
+// CPU time. Approximate costs per stereo output frame at fractional playback
+// rates, excluding ADPCM decoding, as measured by bench/kernelBench.cpp (the
+// ESP32 figures are estimates based on the number of loads and multiplies, not
+// measurements):
+// - KERNEL_LINEAR:  2 taps,  ~8 cycles on x86-64, ~15 on the ESP32
+// - KERNEL_HERMITE: 4 taps, ~15 cycles on x86-64, ~40 on the ESP32
+// - KERNEL_SINC:    8 taps, ~17 cycles on x86-64 (vectorized), ~70 on the ESP32
+// 1:1 playback at an integer offset is a plain copy regardless of the kernel.
+// The default can be overridden by defining SST_SAMPLER_KERNEL.
+#ifndef SST_SAMPLER_KERNEL
+#define SST_SAMPLER_KERNEL KERNEL_LINEAR
+#endif
+
+static constexpr SamplerKernel SAMPLER_KERNEL = SST_SAMPLER_KERNEL;
+
+// Length of the crossfade applied when wrapping around a loop, in output
+// samples (~1.5 ms at 44.1 kHz). The audio past the end of the loop is faded
+// out as the start fades in, but only if the respective sectors happen to be
+// cached; the loop wraps without a crossfade otherwise. Set to zero to disable.
+static constexpr int LOOP_CROSSFADE_LENGTH = 64;
+
+using ReadCallback     =
+	const SSTSector *(*)(int chunk, SSTSectorFormat &format, void *arg);
 using ReadDoneCallback = void (*)(const SSTSector *sector, void *arg);
 
+// Sectors are decoded lazily one block at a time, as scratching will often
+// only touch a few milliseconds of each sector. Blocks are always decoded in
+// order, with the filter state at the point decoding stopped being kept around
+// in order to resume from the next block.
 struct SamplerCacheEntry {
 public:
-	int         chunk;
+	int             chunk, numDecodedFrames;
+	int             prevEntry, nextEntry, chained;
+	bool            pinned;
+	SSTSectorFormat format;
+	dsp::Sample     history[2][NUM_CHANNELS];
+
+	SSTSector   sector;
 	dsp::Sample samples[SAMPLES_PER_SECTOR][NUM_CHANNELS];
+
+	inline const dsp::Sample *decodeUntil(int lastFrame) {
+		if (lastFrame >= numDecodedFrames)
+			decode(lastFrame);
+
+		return samples[lastFrame];
+	}
+
+	void decode(int lastFrame);
 };
 
+struct SamplerStats {
+public:
+	uint32_t hits, misses;
+};
+
+// Decoded sectors are kept in a cache of configurable size, with the least
+// recently used entry being evicted to make room for a new sector. Entries are
+// looked up through a small hash table indexed by the low bits of the chunk
+// index, which maps consecutive chunks to different buckets. A range of chunks
+// (such as the one covered by a loop) can additionally be pinned, preventing
+// the respective entries from being evicted. Each buffer is split at loop
+// boundaries, so that the inner loop never has to check for them.
 class Sampler {
 private:
-	SamplerCacheEntry cache_[2];
-	int               currentCacheEntry_;
+	util::Data   entries_, buckets_;
+	size_t       numEntries_, numBuckets_, numPinned_;
+	int          firstEntry_, lastEntry_, firstPinned_, lastPinned_;
+	SamplerStats stats_;
+
+	int64_t loopStart_, loopEnd_, nextPosition_, fadePosition_;
+	int     fadeLength_, fadeRemaining_;
 
 	ReadCallback     readCallback_;
 	ReadDoneCallback readDoneCallback_;
 	void             *arg_;
 
-	const SamplerCacheEntry *loadChunk_(int chunk);
+	inline int &getBucket_(int chunk) {
+		return buckets_.as<int>()[unsigned(chunk) & (numBuckets_ - 1)];
+	}
+
+	int findEntry_(int chunk);
+	void addToBucket_(int index);
+	void removeFromBucket_(int index);
+	void addToList_(int index, bool front);
+	void removeFromList_(int index);
+	void touchEntry_(int index);
+	SamplerCacheEntry *loadChunk_(int chunk);
+	void gatherFrames_(
+		dsp::Sample       *output,
+		SamplerCacheEntry *current,
+		int               chunk,
+		int               firstFrame,
+		bool              reverse
+	);
+	void render_(
+		dsp::Sample *output,
+		int64_t     position,
+		int         step,
+		size_t      numSamples
+	);
+	int64_t wrapLoop_(int64_t position, int step);
+	void crossfade_(dsp::Sample *output, int step, size_t numSamples);
 
 public:
 	inline Sampler(void) :
+		numEntries_(0),
+		numBuckets_(0),
+		numPinned_(0),
+		firstPinned_(0),
+		lastPinned_(-1),
+		loopStart_(0),
+		loopEnd_(0),
+		nextPosition_(0),
+		fadePosition_(0),
+		fadeLength_(0),
+		fadeRemaining_(0),
 		readCallback_(nullptr),
 		readDoneCallback_(nullptr),
 		arg_(nullptr)
 	{
-		flush();
+		resetStats();
+	}
+	inline size_t getNumEntries(void) const {
+		return numEntries_;
+	}
+	inline const SamplerStats &getStats(void) const {
+		return stats_;
+	}
+	inline void resetStats(void) {
+		stats_.hits   = 0;
+		stats_.misses = 0;
+	}
+	inline bool isPinned(void) const {
+		return true
+			&& (lastPinned_ >= firstPinned_)
+			&& (numPinned_ == size_t(lastPinned_ - firstPinned_ + 1));
+	}
+	inline void setLoop(int64_t start, int64_t end) {
+		loopStart_ = start;
+		loopEnd_   = end;
+	}
+	inline void clearLoop(void) {
+		loopStart_ = 0;
+		loopEnd_   = 0;
 	}
 	inline void setCallbacks(
 		ReadCallback     read,
@@ -154,8 +529,28 @@ public:
 		arg_              = arg;
 	}
 
+	// At least two entries are required, as interpolating across a sector
+	// boundary accesses two sectors at once.
+	bool allocate(size_t numEntries);
 	void flush(void);
-	void process(dsp::Sample *output, int offset, int step, size_t numSamples);
+
+	// Up to getNumEntries() - 2 chunks may be pinned at a time. Chunks that are
+	// not yet in the cache are pinned once loaded; isPinned() returns true once
+	// the whole range is resident.
+	bool pin(int firstChunk, int lastChunk);
+	void unpin(void);
+
+	// Returns the playback position following the last sample generated. If a
+	// loop is set, the position wraps back to its start as soon as it reaches
+	// the end (or, when playing backwards, goes past the start). A position
+	// that is already past either boundary in the direction of playback is
+	// wrapped before any sample is generated.
+	int64_t process(
+		dsp::Sample *output,
+		int64_t     position,
+		int         step,
+		size_t      numSamples
+	);
 };
 
 }
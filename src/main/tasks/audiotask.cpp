@@ -2,6 +2,7 @@
 #include <assert.h>
 #include <stddef.h>
 #include <stdint.h>
+#include "esp_heap_caps.h"
 #include "src/main/drivers/audio.hpp"
 #include "src/main/drivers/input.hpp"
 #include "src/main/drivers/inputdefs.hpp"
@@ -10,14 +11,36 @@
 #include "src/main/tasks/iotask.hpp"
 #include "src/main/tasks/streamtask.hpp"
 #include "src/main/util/templates.hpp"
+#include "src/main/defs.hpp"
 #include "src/main/sst.hpp"
 
 namespace tasks {
 
+static const char TAG_[]{ "audio" };
+
 /* Deck object */
 
-// Allocate ~96 KB per deck for the sector streaming FIFOs.
-static constexpr size_t NUM_QUEUED_SECTORS_ = 48;
+// There is no external RAM, so the queues and caches of both decks are kept
+// within the ~227 KB previously taken up by 48-sector queues and fixed
+// two-sector caches (~110 KB per deck).
+
+// Allocate ~72 KB per deck for the sector streaming FIFOs, or ~1.5 s of audio
+// at normal speed.
+static constexpr size_t NUM_QUEUED_SECTORS_ = 36;
+
+// Allocate ~37 KB per deck for decoded sectors, enough to keep a loop spanning
+// three sectors decoded. Scratches only benefit from a much larger cache (see
+// bench/samplerReplay.cpp). Up to 2 sectors (~85 ms) can be pinned while
+// looping.
+static constexpr size_t NUM_CACHED_SECTORS_ = 4;
+static constexpr size_t MIN_CACHED_SECTORS_ = 2;
+
+// Heap space left untouched when falling back to a smaller cache, for use by
+// other tasks.
+static constexpr size_t HEAP_RESERVE_ = 16384;
+
+static constexpr int64_t CHUNK_INDEX_UNIT_ =
+	sst::SAMPLE_OFFSET_UNIT * sst::SAMPLES_PER_SECTOR;
 
 static constexpr float SMOOTHING_FACTOR_ = 0.3f;
 
@@ -25,29 +48,41 @@ void DeckState::reset(void) {
 	playbackOffset = 0;
 	playbackStep   = 0;
 	cueOffset      = 0;
-	loopStart      = INT_MIN;
-	loopEnd        = INT_MIN;
+	loopStart      = INT64_MIN;
+	loopEnd        = INT64_MIN;
 
 	sampleRate = 0;
 	flags      = 0;
+
+	util::clear(beatgrid);
 }
 
 void AudioTaskDeck::init_(void) {
 	sampler_.setCallbacks(
-		[](int chunk, void *arg) -> const sst::SSTSector * {
+		[](
+			int                  chunk,
+			sst::SSTSectorFormat &format,
+			void                 *arg
+		) -> const sst::SSTSector * {
 			auto deck = reinterpret_cast<AudioTaskDeck *>(arg);
 
-			// Consume all sectors in the queue prior to the requested one.
+			// Consume all sectors in the queue prior to the requested one, as
+			// well as any left over from a previous track or variant.
 			for (;;) {
 				auto entry = deck->sectorQueue_.popItem();
 
 				if (!entry) // Underrun
 					return nullptr;
 
-				if (entry->chunk == chunk)
+				const bool stale =
+					int32_t(entry->generation - deck->track_.generation) < 0;
+
+				if ((entry->chunk == chunk) && !stale) {
+					format = entry->format;
 					return &(entry->sector);
-				else
-					deck->sectorQueue_.finalizePop();
+				}
+
+				deck->sectorQueue_.finalizePop();
 			}
 		},
 		[](const sst::SSTSector *sector, void *arg) {
@@ -63,12 +98,56 @@ void AudioTaskDeck::init_(void) {
 	smoothingFilter_.reset();
 	state_.reset();
 
+	track_.numChunks  = 0;
+	track_.trim       = 1.0f;
+	track_.generation = 0;
+	util::clear(track_.beatgrid);
+
 	bool ok = sectorQueue_.allocate(NUM_QUEUED_SECTORS_);
 	assert(ok);
+
+	// Failed allocations abort rather than returning null, so the cache is
+	// shrunk beforehand if the heap is short. A smaller cache only limits the
+	// length of loops that can be pinned.
+	const size_t freeSpace  = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+	const size_t numEntries = util::clamp(
+		(util::max(freeSpace, HEAP_RESERVE_) - HEAP_RESERVE_)
+			/ sizeof(sst::SamplerCacheEntry),
+		MIN_CACHED_SECTORS_,
+		NUM_CACHED_SECTORS_
+	);
+
+	if (numEntries < NUM_CACHED_SECTORS_)
+		ESP_LOGW(TAG_, "low memory, caching %d sectors", int(numEntries));
+
+	ok = sampler_.allocate(numEntries);
+	assert(ok);
+}
+
+void AudioTaskDeck::updateTrack_(void) {
+	const uint32_t generation = track_.generation;
+
+	if (!trackMailbox_.get(track_))
+		return;
+
+	state_.beatgrid = track_.beatgrid;
+
+	// Cached (and possibly pinned) sectors were decoded from the previous
+	// track or variant and must be fetched again. Sectors still in the queue
+	// are skipped by the read callback.
+	if (track_.generation != generation)
+		sampler_.flush();
 }
 
 void AudioTaskDeck::process_(void) {
-	sampler_.process(
+	// The sampler takes care of wrapping around the loop at the exact sample
+	// its end is reached.
+	if (state_.flags & DECK_FLAG_LOOPING)
+		sampler_.setLoop(state_.loopStart, state_.loopEnd);
+	else
+		sampler_.clearLoop();
+
+	const int64_t offset = sampler_.process(
 		audioBuffer_[0],
 		state_.playbackOffset,
 		state_.playbackStep,
@@ -86,17 +165,7 @@ void AudioTaskDeck::process_(void) {
 	}
 
 	// Update the current playback position.
-	const int delta = state_.playbackStep * AUDIO_BUFFER_SIZE;
-
-	if ((-delta) > state_.playbackOffset)
-		state_.playbackOffset  = 0;
-	else
-		state_.playbackOffset += delta;
-
-	if (state_.flags & DECK_FLAG_LOOPING) {
-		while (state_.playbackOffset >= state_.loopEnd)
-			state_.playbackOffset -= state_.loopEnd - state_.loopStart;
-	}
+	state_.playbackOffset = util::max(offset, int64_t(0));
 }
 
 void AudioTaskDeck::updateMeasuredSpeed_(int16_t value, float dt) {
@@ -105,11 +174,38 @@ void AudioTaskDeck::updateMeasuredSpeed_(int16_t value, float dt) {
 	speed      /= DECK_TARGET_RPM / 60.0f;
 	speed       = smoothingFilter_.update(speed);
 
-	speed              *= float(state_.sampleRate);
+	speed              *= float(state_.sampleRate) / float(OUTPUT_SAMPLE_RATE);
 	speed              *= float(sst::SAMPLE_OFFSET_UNIT);
 	state_.playbackStep = int(speed);
 }
 
+void AudioTaskDeck::updatePinnedLoop_(int numChunks) {
+	state_.flags &= ~DECK_FLAG_LOOP_PINNED;
+
+	if (!(state_.flags & DECK_FLAG_LOOPING)) {
+		sampler_.unpin();
+		return;
+	}
+
+	// Pin the same sectors the stream task would otherwise fetch over and over.
+	// Loops that are too long to be pinned are streamed as usual.
+	const int firstChunk = int(state_.loopStart / CHUNK_INDEX_UNIT_);
+	const int lastChunk  = util::min(
+		int((state_.loopEnd - 1) / CHUNK_INDEX_UNIT_),
+		numChunks - 1
+	);
+
+	if (!sampler_.pin(firstChunk, lastChunk))
+		return;
+
+	const bool inLoop = true
+		&& (state_.playbackOffset >= state_.loopStart)
+		&& (state_.playbackOffset <  state_.loopEnd);
+
+	if (sampler_.isPinned() && inLoop)
+		state_.flags |= DECK_FLAG_LOOP_PINNED;
+}
+
 void AudioTaskDeck::updateFilter_(uint8_t value) {
 	float                 cutoff = float(value) / 127.5f;
 	dsp::BiquadFilterType type;
@@ -138,8 +234,11 @@ void AudioTaskDeck::updateFilter_(uint8_t value) {
 		while (inputQueue_.pop(inputs))
 			handleInputs_(inputs);
 
-		for (auto &deck : decks_)
+		for (auto &deck : decks_) {
+			deck.updateTrack_();
+			deck.updatePinnedLoop_(deck.track_.numChunks);
 			deck.process_();
+		}
 
 		for (int i = 0; i < sst::NUM_CHANNELS; i++) {
 			mainMixer_.process(
@@ -186,13 +285,22 @@ void AudioTask::handleInputs_(const drivers::InputState &inputs) {
 	const float effectDepth   =
 		float(inputs.analog[drivers::ANALOG_EFFECT_DEPTH])   / 255.0f;
 
+	// Normalization is folded into the mixer's coefficients, so it does not
+	// add any per-sample work.
+	const float trim1 = decks_[0].track_.trim;
+	const float trim2 = decks_[1].track_.trim;
+
 	mainMixer_.configure(
 		(1.0f - crossfade) * mainVolume,
-		crossfade          * mainVolume
+		crossfade          * mainVolume,
+		trim1,
+		trim2
 	);
 	monitorMixer_.configure(
 		(decks_[0].state_.flags & DECK_FLAG_MONITORING) ? monitorVolume : 0.0f,
-		(decks_[1].state_.flags & DECK_FLAG_MONITORING) ? monitorVolume : 0.0f
+		(decks_[1].state_.flags & DECK_FLAG_MONITORING) ? monitorVolume : 0.0f,
+		trim1,
+		trim2
 	);
 	bitcrusher_.configure(effectDepth);
 
@@ -245,7 +353,8 @@ void AudioTask::handleDeckButtons_(
 			deck.state_.flags |= DECK_FLAG_SHIFT_USED;
 	} else {
 		if (pressed & drivers::DECK_BTN_LOOP_IN) {
-			const int length = deck.state_.loopEnd - deck.state_.loopStart;
+			const int64_t length =
+				deck.state_.loopEnd - deck.state_.loopStart;
 			deck.state_.loopStart  = deck.state_.playbackOffset;
 
 			// Move the entire loop when attempting to move the start point past
@@ -291,6 +400,12 @@ void AudioTask::handleDeckButtons_(
 	}
 }
 
+size_t AudioTask::getQueueSpace(int deck) const {
+	const size_t length = getQueueLength(deck);
+
+	return NUM_QUEUED_SECTORS_ - util::min(length, NUM_QUEUED_SECTORS_);
+}
+
 AudioTask &AudioTask::instance(void) {
 	static AudioTask task;
 
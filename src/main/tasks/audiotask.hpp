@@ -18,21 +18,30 @@ static constexpr size_t AUDIO_BUFFER_SIZE  = 256;
 /* Deck object */
 
 enum DeckFlag : uint8_t {
-	DECK_FLAG_PLAYING    = 1 << 0,
-	DECK_FLAG_MONITORING = 1 << 1,
-	DECK_FLAG_LOOPING    = 1 << 2,
-	DECK_FLAG_REVERSE    = 1 << 3,
-	DECK_FLAG_SHIFT_USED = 1 << 4
+	DECK_FLAG_PLAYING     = 1 << 0,
+	DECK_FLAG_MONITORING  = 1 << 1,
+	DECK_FLAG_LOOPING     = 1 << 2,
+	DECK_FLAG_REVERSE     = 1 << 3,
+	DECK_FLAG_SHIFT_USED  = 1 << 4,
+	// Set while the loop being played is entirely held in the sampler's cache,
+	// in which case the stream task does not fetch any sectors for the deck.
+	DECK_FLAG_LOOP_PINNED = 1 << 5
 };
 
 struct DeckState {
 public:
-	int playbackOffset, playbackStep;
-	int cueOffset, loopStart, loopEnd;
+	// Offsets are in 1/sst::SAMPLE_OFFSET_UNIT sample units, while the step
+	// is the number of such units to advance by for each output sample.
+	int64_t playbackOffset, cueOffset, loopStart, loopEnd;
+	int     playbackStep;
 
 	int     sampleRate;
 	uint8_t flags;
 
+	// Copied from the track info, so that the UI task does not have to access
+	// the reader's header to display the current beat.
+	sst::Beatgrid beatgrid;
+
 	inline DeckState(void) {
 		reset();
 	}
@@ -40,17 +49,31 @@ public:
 		if (!sampleRate)
 			return 0.0f;
 
-		return
-			float(playbackOffset) / float(sampleRate * sst::SAMPLE_OFFSET_UNIT);
+		return float(playbackOffset)
+			/ (float(sampleRate) * float(sst::SAMPLE_OFFSET_UNIT));
 	}
 
 	void reset(void);
 };
 
+// Parameters of the track loaded in a deck, sent by the stream task whenever a
+// track is opened or closed (or its variant is changed) so that the audio task
+// never accesses its reader. The generation is incremented on each such change
+// and is used to tell sectors read before it apart.
+struct TrackInfo {
+public:
+	int           numChunks;
+	float         trim;
+	sst::Beatgrid beatgrid;
+	uint32_t      generation;
+};
+
 struct SectorQueueEntry {
 public:
-	int            chunk;
-	sst::SSTSector sector;
+	int                  chunk;
+	uint32_t             generation;
+	sst::SSTSectorFormat format;
+	sst::SSTSector       sector;
 };
 
 class AudioTaskDeck {
@@ -66,10 +89,15 @@ private:
 	DeckState                            state_;
 	util::InPlaceQueue<SectorQueueEntry> sectorQueue_;
 
+	TrackInfo                track_;
+	util::Mailbox<TrackInfo> trackMailbox_;
+
 	void init_(void);
+	void updateTrack_(void);
 	void process_(void);
 	void updateMeasuredSpeed_(int16_t value, float dt);
 	void updateFilter_(uint8_t value);
+	void updatePinnedLoop_(int numChunks);
 };
 
 /* Main audio processing task */
@@ -103,15 +131,23 @@ public:
 	inline void updateInputs(const drivers::InputState &inputs) {
 		inputQueue_.push(inputs);
 	}
-	inline SectorQueueEntry *feedSector(int deck) {
-		return decks_[deck].sectorQueue_.pushItem();
+	inline SectorQueueEntry *feedSector(int deck, bool blocking = false) {
+		return decks_[deck].sectorQueue_.pushItem(blocking);
 	}
 	inline void finalizeFeed(int deck) {
 		decks_[deck].sectorQueue_.finalizePush();
 	}
+	// Only the most recent track info is kept if the audio task has yet to
+	// apply it.
+	inline void setTrackInfo(int deck, const TrackInfo &info) {
+		decks_[deck].trackMailbox_.forcePut(info);
+	}
 	inline size_t getQueueLength(int deck) const {
 		return decks_[deck].sectorQueue_.getLength();
 	}
+	// Returns the number of sectors that can currently be fed to a deck without
+	// blocking.
+	size_t getQueueSpace(int deck) const;
 	inline void getDeckState(DeckState &output, int index) const {
 		// The DeckState struct is not properly locked for concurrent access.
 		// This may result in this method running while the struct is being
@@ -1,35 +1,52 @@
 
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "esp_timer.h"
 #include "src/main/drivers/input.hpp"
+#include "src/main/drivers/storage.hpp"
 #include "src/main/tasks/audiotask.hpp"
 #include "src/main/tasks/streamtask.hpp"
+#include "src/main/defs.hpp"
 #include "src/main/sst.hpp"
 
 namespace tasks {
 
+static const char TAG_[]{ "stream" };
+
 /* Main file streaming task */
 
-static constexpr int CHUNK_INDEX_UNIT_ =
+static constexpr int64_t CHUNK_INDEX_UNIT_ =
 	sst::SAMPLE_OFFSET_UNIT * sst::SAMPLES_PER_SECTOR;
+static constexpr int    MAX_BATCH_CHUNKS_      = 4;
+static constexpr size_t WAVEFORM_READ_LENGTH_ = 1024;
+
+// Sectors read in a batch are staged here before being copied into the
+// respective queue entries, as the latter are not laid out contiguously. The
+// buffer must be 32-bit aligned for the SDMMC driver to read into it directly.
+alignas(4) static uint8_t
+	batchBuffer_[MAX_BATCH_CHUNKS_ * sizeof(sst::SSTSector)];
 
 static int predictNextChunk_(
 	const DeckState &state,
 	int             numChunks,
 	int             lookahead
 ) {
-	int chunk = state.playbackOffset / CHUNK_INDEX_UNIT_;
+	int chunk = int(state.playbackOffset / CHUNK_INDEX_UNIT_);
 
 	if (chunk >= numChunks)
 		return -1;
 
 	for (; lookahead > 0; lookahead--) {
 		chunk++;
-		int newOffset = chunk * CHUNK_INDEX_UNIT_;
+		int64_t newOffset = chunk * CHUNK_INDEX_UNIT_;
 
 		if (state.flags & DECK_FLAG_LOOPING) {
 			while (newOffset >= state.loopEnd)
 				newOffset -= state.loopEnd - state.loopStart;
 
-			chunk = newOffset / CHUNK_INDEX_UNIT_;
+			chunk = int(newOffset / CHUNK_INDEX_UNIT_);
 		}
 
 		// If the end of the track has been reached and looping is disabled,
@@ -41,8 +58,50 @@ static int predictNextChunk_(
 	return chunk;
 }
 
+// Tracks are normalized to the target loudness, unless doing so would push
+// their true peak above the ceiling. The gain is limited to what the mixer can
+// apply.
+static constexpr float LOUDNESS_TARGET_   = -10.0f;
+static constexpr float TRUE_PEAK_CEILING_ = -1.0f;
+static constexpr float MAX_NORMALIZATION_ = 6.0f;
+
+static TrackInfo getTrackInfo_(
+	const sst::Reader &reader,
+	uint32_t          generation
+) {
+	auto      header = reader.getHeader();
+	TrackInfo info;
+
+	info.numChunks  = header ? int(header->info.numChunks) : 0;
+	info.trim       = 1.0f;
+	info.generation = generation;
+	reader.getBeatgrid(info.beatgrid);
+
+	if (reader.hasLoudness()) {
+		const float gain = util::min(
+			LOUDNESS_TARGET_   - reader.getLoudness(),
+			TRUE_PEAK_CEILING_ - reader.getTruePeak()
+		);
+
+		info.trim = powf(10.0f, util::min(gain, MAX_NORMALIZATION_) / 20.0f);
+	}
+
+	return info;
+}
+
 [[noreturn]] void StreamTask::taskMain_(void) {
-	auto &audioTask = AudioTask::instance();
+	auto &audioTask     = AudioTask::instance();
+	auto &storageDriver = drivers::StorageDriver::instance();
+
+	// Resolve each file's extents when opening it and read sectors from the
+	// SD card directly, rather than going through the VFS and FatFs.
+	for (int i = 0; i < drivers::NUM_DECKS; i++) {
+		files_[i].setVolume(
+			storageDriver.getVolume(),
+			storageDriver.getMountPoint()
+		);
+		readers_[i].setBackend(files_[i]);
+	}
 
 	for (;;) {
 		StreamCommand command;
@@ -50,6 +109,8 @@ static int predictNextChunk_(
 		while (commandQueue_.pop(command))
 			handleCommand_(command);
 
+		bool idle = true;
+
 		for (int i = 0; i < drivers::NUM_DECKS; i++) {
 			auto header = readers_[i].getHeader();
 
@@ -63,36 +124,146 @@ static int predictNextChunk_(
 
 			audioTask.getDeckState(state, i);
 
+			// Skip decks that are looping entirely from the sampler's cache,
+			// leaving all bandwidth to the other deck.
+			if (state.flags & DECK_FLAG_LOOP_PINNED)
+				continue;
+
+			// Only read as many sectors as the queue can take right away, so
+			// that none of them has to be dropped or wait for the audio task
+			// (and go stale in the meantime) once read.
+			const int queueSpace  = int(audioTask.getQueueSpace(i));
+			const int queueLength = audioTask.getQueueLength(i);
+
+			if (!queueSpace)
+				continue;
+
 			const int chunk = predictNextChunk_(
 				state,
 				header->info.numChunks,
-				audioTask.getQueueLength(i)
+				queueLength
 			);
 
 			if (chunk < 0)
 				continue;
 
-			auto entry = audioTask.feedSector(i);
+			// Determine how many of the following chunks are going to be
+			// played in order (i.e. not interrupted by a loop point), so that
+			// they can be fetched with a single read if possible.
+			const int maxChunks = util::min(queueSpace, MAX_BATCH_CHUNKS_);
+			int       numChunks = 1;
+
+			for (; numChunks < maxChunks; numChunks++) {
+				const int nextChunk = predictNextChunk_(
+					state,
+					header->info.numChunks,
+					queueLength + numChunks
+				);
+
+				if (nextChunk != (chunk + numChunks))
+					break;
+			}
+
+			sst::SSTSectorFormat format{};
+
+			numChunks = readers_[i].readBatch(
+				batchBuffer_,
+				format,
+				chunk,
+				numChunks
+			);
+
+			// If the read failed, push a silent sector anyway rather than
+			// retrying the same chunk over and over.
+			if (!numChunks) {
+				format.flags |= sst::SST_FLAG_SILENT;
+				numChunks     = 1;
+			}
+
+			const size_t sectorLength = format.getLength();
+			auto         ptr          = batchBuffer_;
+
+			// As the free space was checked beforehand, feeding never actually
+			// blocks here; only this task pushes to the queue.
+			for (int j = 0; j < numChunks; j++, ptr += sectorLength) {
+				auto entry = audioTask.feedSector(i, true);
+
+				entry->chunk      = chunk + j;
+				entry->generation = generations_[i];
+				entry->format     = format;
+
+				if (!(format.flags & sst::SST_FLAG_SILENT))
+					memcpy(entry->sector.data, ptr, sectorLength);
 
-			if (entry) {
-				entry->chunk = chunk;
-				readers_[i].read(entry->sector, chunk);
 				audioTask.finalizeFeed(i);
 			}
+
+			idle = false;
+
+			if (!firstSectorQueued_[i]) {
+				firstSectorQueued_[i] = true;
+				ESP_LOGI(
+					TAG_,
+					"deck %d: first sector queued %d us after open",
+					i,
+					int(esp_timer_get_time() - openTimes_[i])
+				);
+			}
 		}
+
+		// Waveforms are loaded in small pieces once each deck's sectors have
+		// been queued, so that opening a track never delays playback.
+		for (int i = 0; i < drivers::NUM_DECKS; i++) {
+			if (!readers_[i].isWaveformPending())
+				continue;
+
+			idle = false;
+
+			// Try again on the next pass if the UI task is currently drawing
+			// the deck, rather than waiting for it.
+			if (!readerLocks_[i].lock())
+				continue;
+
+			const bool loaded = readers_[i].loadWaveform(WAVEFORM_READ_LENGTH_);
+			readerLocks_[i].unlock();
+
+			if (!loaded)
+				continue;
+
+			ESP_LOGI(
+				TAG_,
+				"deck %d: waveform loaded %d us after open",
+				i,
+				int(esp_timer_get_time() - openTimes_[i])
+			);
+		}
+
+		// If all queues are full, give the audio task a tick to consume some
+		// sectors rather than spinning.
+		if (idle)
+			vTaskDelay(1);
 	}
 }
 
 void StreamTask::handleCommand_(const StreamCommand &command) {
-	auto &reader = readers_[command.deck];
+	auto &audioTask = AudioTask::instance();
+	auto &reader    = readers_[command.deck];
+
+	readerLocks_[command.deck].lock(true);
+
+	const int variant = reader.getVariant();
+	bool      changed = false;
 
 	switch (command.cmd) {
 		case STREAM_CMD_OPEN:
-			reader.open(command.path);
+			openTimes_[command.deck]         = esp_timer_get_time();
+			firstSectorQueued_[command.deck] = !reader.open(command.path);
+			changed                          = true;
 			break;
 
 		case STREAM_CMD_CLOSE:
 			reader.close();
+			changed = true;
 			break;
 
 		case STREAM_CMD_PREV_VARIANT:
@@ -107,6 +278,20 @@ void StreamTask::handleCommand_(const StreamCommand &command) {
 			reader.resetVariant();
 			break;
 	}
+
+	// Selecting a variant past the first or last one leaves it unchanged, in
+	// which case the sectors already queued and cached remain valid. The
+	// header is only read here, so that the audio task never has to access
+	// the reader.
+	if (changed || (reader.getVariant() != variant)) {
+		generations_[command.deck]++;
+		audioTask.setTrackInfo(
+			command.deck,
+			getTrackInfo_(reader, generations_[command.deck])
+		);
+	}
+
+	readerLocks_[command.deck].unlock();
 }
 
 StreamTask &StreamTask::instance(void) {
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include "src/main/drivers/input.hpp"
+#include "src/main/util/fat.hpp"
 #include "src/main/util/rtos.hpp"
 #include "src/main/sst.hpp"
 
@@ -27,13 +28,33 @@ public:
 
 class StreamTask : public util::Task {
 private:
-	sst::Reader readers_[drivers::NUM_DECKS];
+	// The files must outlive the readers, which close them when destroyed.
+	util::ExtentFile files_[drivers::NUM_DECKS];
+	sst::Reader      readers_[drivers::NUM_DECKS];
+
+	// Held while a reader's header or waveform is being replaced (i.e. when
+	// opening or closing a track or loading its waveform), as well as by other
+	// tasks while accessing them.
+	util::Mutex readerLocks_[drivers::NUM_DECKS];
 
 	util::Queue<StreamCommand> commandQueue_;
 
+	// Incremented whenever a deck's track or variant changes, so that the
+	// audio task can discard sectors read beforehand.
+	uint32_t generations_[drivers::NUM_DECKS];
+
+	// Used to log how long it takes for a newly opened track to be playable.
+	int64_t openTimes_[drivers::NUM_DECKS];
+	bool    firstSectorQueued_[drivers::NUM_DECKS];
+
 	inline StreamTask(void) :
 		Task("StreamTask", 0x1000)
-	{}
+	{
+		for (auto &generation : generations_)
+			generation = 0;
+		for (auto &queued : firstSectorQueued_)
+			queued = true;
+	}
 
 	[[noreturn]] void taskMain_(void) override;
 	void handleCommand_(const StreamCommand &command);
@@ -52,11 +73,27 @@ public:
 
 		commandQueue_.push(command, true);
 	}
+
+	// The methods below may only be called while holding the deck's lock. Any
+	// pointers returned become invalid once it is released.
+	inline void lockReader(int deck) {
+		readerLocks_[deck].lock(true);
+	}
+	inline void unlockReader(int deck) {
+		readerLocks_[deck].unlock();
+	}
 	inline const sst::SSTHeader *getSSTHeader(int deck) const {
 		return readers_[deck].getHeader();
 	}
-	inline const util::Data &getSSTWaveform(int deck) const {
-		return readers_[deck].getWaveform();
+	inline int getNumSSTWaveformLevels(int deck) const {
+		return readers_[deck].getNumWaveformLevels();
+	}
+	inline bool getSSTWaveformLevel(
+		int                deck,
+		sst::WaveformLevel &output,
+		int                level
+	) const {
+		return readers_[deck].getWaveformLevel(output, level);
 	}
 	inline size_t getKeyName(int deck, char *output) const {
 		return readers_[deck].getKeyName(output);
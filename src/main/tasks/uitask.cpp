@@ -1,6 +1,7 @@
 
 #include <assert.h>
 #include <dirent.h>
+#include <limits.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
@@ -23,38 +24,166 @@ namespace tasks {
 
 static constexpr int WAVEFORM_HEIGHT_ = dsp::WAVEFORM_RANGE * 2 + 1;
 
+// Picks the lowest resolution waveform level that still provides at least one
+// sample per pixel at the given zoom level (or the overview level, if
+// requested and present). Returns the number of samples per pixel, or 0 if no
+// waveform is available.
+static int findWaveformLevel_(
+	sst::WaveformLevel &output,
+	int                deck,
+	int                zoom
+) {
+	auto &streamTask = StreamTask::instance();
+
+	const int numLevels = streamTask.getNumSSTWaveformLevels(deck);
+	int       bestLevel = -1;
+	int       bestRate  = INT_MAX;
+
+	for (int i = 0; i < numLevels; i++) {
+		sst::WaveformLevel level;
+
+		streamTask.getSSTWaveformLevel(deck, level, i);
+
+		if (!level.sampleRate) {
+			if (zoom >= WAVEFORM_OVERVIEW_ZOOM) {
+				output = level;
+				return 1;
+			}
+
+			continue;
+		}
+
+		const int rate = level.sampleRate << util::min(zoom, MAX_WAVEFORM_ZOOM);
+
+		if ((rate >= dsp::WAVEFORM_SAMPLE_RATE) && (rate < bestRate)) {
+			bestLevel = i;
+			bestRate  = rate;
+		}
+	}
+
+	if (bestLevel < 0)
+		return 0;
+
+	streamTask.getSSTWaveformLevel(deck, output, bestLevel);
+	return bestRate / dsp::WAVEFORM_SAMPLE_RATE;
+}
+
+// Linear amplitude of each band level (see dsp::WAVEFORM_BAND_STEP), scaled so
+// that full scale maps to 255.
+DRAM_ATTR static const uint8_t BAND_WEIGHTS_[]{
+	  1,   2,   3,   4,   6,   8,  11,  16,
+	 23,  32,  45,  64,  90, 128, 181, 255
+};
+
+// Maps the low, mid and high band levels to the red, green and blue channels
+// respectively, normalizing the color so that the loudest band is always at
+// full brightness.
+IRAM_ATTR static renderer::RGB565 getBandColor_(const int *levels) {
+	const int r = BAND_WEIGHTS_[levels[dsp::WAVEFORM_BAND_LOW]];
+	const int g = BAND_WEIGHTS_[levels[dsp::WAVEFORM_BAND_MID]];
+	const int b = BAND_WEIGHTS_[levels[dsp::WAVEFORM_BAND_HIGH]];
+	const int m = util::max(util::max(r, g), b);
+
+	return renderer::rgb565(
+		(r * 31 + m / 2) / m,
+		(g * 63 + m / 2) / m,
+		(b * 31 + m / 2) / m
+	);
+}
+
 IRAM_ATTR static void drawWaveform_(
 	renderer::Renderer &gfx,
 	const DeckState    &state,
-	const util::Data   &waveform,
+	int                deck,
+	int                zoom,
 	int                y
 ) {
 	gfx.fill(0, y, DISPLAY_WIDTH, WAVEFORM_HEIGHT_, UI_COLOR_WINDOW1);
 
-	if (!waveform.ptr)
-		return;
+	// The waveform may not have been loaded yet if the track was just opened.
+	sst::WaveformLevel level;
+	const int          samplesPerPixel = findWaveformLevel_(level, deck, zoom);
 
-	const float time =
-		state.getCurrentTime() * float(dsp::WAVEFORM_SAMPLE_RATE);
+	if (!samplesPerPixel)
+		return;
 
-	int offset = int(time + 0.5f);
-	offset    -= DISPLAY_WIDTH / 2;
+	const float time   = state.getCurrentTime();
+	int         offset = 0;
 
-	auto      ptr = &waveform.as<uint8_t>()[offset / 2];
-	int       x1  = util::max<int>(0, DISPLAY_WIDTH / 2 - offset);
-	const int x2  = util::min<int>(DISPLAY_WIDTH, waveform.length * 2 - offset);
+	if (level.sampleRate) {
+		// Center the waveform around the current playback position.
+		offset  = int(time * float(level.sampleRate) + 0.5f);
+		offset -= (DISPLAY_WIDTH / 2) * samplesPerPixel;
+	}
 
 	y += dsp::WAVEFORM_RANGE;
 
-	for (; x1 < x2; x1 += 2, offset += 2, ptr++) {
-		if (offset < 0)
-			continue;
+	// Each column only ever spans a few samples, as levels are spaced
+	// closely enough, so drawing takes constant time at any zoom level.
+	const int  length   = level.length;
+	const bool hasBands = level.bands[0] != nullptr;
+	const auto color    = renderer::rgb888to565(UI_COLOR_ACCENT1);
+
+	for (int x = 0; x < DISPLAY_WIDTH; x++) {
+		int start, end;
+
+		if (level.sampleRate) {
+			start = offset + x * samplesPerPixel;
+			end   = start  + samplesPerPixel;
+		} else {
+			start = (x       * length) / DISPLAY_WIDTH;
+			end   = ((x + 1) * length) / DISPLAY_WIDTH;
+			end   = util::max(end, start + 1);
+		}
+
+		start = util::max(start, 0);
+		end   = util::min(end, length);
+
+		int value = -1;
+		int bands[dsp::NUM_WAVEFORM_BANDS]{ 0 };
+
+		for (; start < end; start++) {
+			value = util::max(value, dsp::getWaveformSample(level.data, start));
+
+			if (!hasBands)
+				continue;
+
+			for (int i = 0; i < dsp::NUM_WAVEFORM_BANDS; i++)
+				bands[i] = util::max(
+					bands[i],
+					dsp::getWaveformSample(level.bands[i], start)
+				);
+		}
+
+		if (value >= 0)
+			gfx.verticalLine(
+				x,
+				y - value,
+				value * 2 + 1,
+				hasBands ? getBandColor_(bands) : color
+			);
+	}
+
+	// The overview is static, so the playback position is shown separately.
+	if (!level.sampleRate) {
+		auto header = StreamTask::instance().getSSTHeader(deck);
 
-		const int value1 = *ptr & 15;
-		const int value2 = *ptr >> 4;
+		if (!header || !header->info.numChunks)
+			return;
 
-		gfx.verticalLine(x1 + 0, y - value1, value1 * 2 + 1, UI_COLOR_ACCENT1);
-		gfx.verticalLine(x1 + 1, y - value2, value2 * 2 + 1, UI_COLOR_ACCENT1);
+		const float duration = float(
+			header->info.numChunks * sst::SAMPLES_PER_SECTOR
+		) / float(header->info.sampleRate);
+
+		const int x = int(time / duration * float(DISPLAY_WIDTH));
+
+		if ((x >= 0) && (x < DISPLAY_WIDTH))
+			gfx.verticalLine(
+				x,
+				y - dsp::WAVEFORM_RANGE,
+				WAVEFORM_HEIGHT_,
+				UI_COLOR_TITLE
+			);
 	}
 }
 
@@ -75,8 +204,11 @@ void MainScreen::draw(UITask &task) const {
 	int waveformY = (DISPLAY_HEIGHT - WAVEFORM_HEIGHT_ * drivers::NUM_DECKS) / 2;
 
 	for (int i = 0; i < drivers::NUM_DECKS; i++) {
-		auto      header    = streamTask.getSSTHeader(i);
-		auto      &waveform = streamTask.getSSTWaveform(i);
+		// Keep the stream task from replacing the header or waveform while
+		// they are being drawn.
+		streamTask.lockReader(i);
+
+		auto      header = streamTask.getSSTHeader(i);
 		DeckState state;
 
 		if (header) {
@@ -108,7 +240,7 @@ void MainScreen::draw(UITask &task) const {
 			int  time = int(state.getCurrentTime());
 
 			streamTask.getKeyName(i, keyName);
-			snprintf(
+			int length = snprintf(
 				buffer,
 				sizeof(buffer),
 				"%d:%02d  %s",
@@ -116,6 +248,31 @@ void MainScreen::draw(UITask &task) const {
 				time % 60,
 				keyName
 			);
+
+			// Show the tempo and the current bar and beat (counting from 1, as
+			// is customary) if the track has a beatgrid.
+			auto &beatgrid = state.beatgrid;
+
+			if (beatgrid.isValid()) {
+				const int bpm  = int(beatgrid.getBPM() * 10.0f + 0.5f);
+				const int beat = beatgrid.getBeatIndex(
+					int(state.playbackOffset >> sst::SAMPLE_OFFSET_BITS)
+				);
+				const int beatsPerBar = beatgrid.beatsPerBar;
+				const int bar         =
+					util::truncateToMultiple(beat, beatsPerBar) / beatsPerBar;
+
+				snprintf(
+					&buffer[length],
+					sizeof(buffer) - length,
+					"  %d.%d  %d.%d",
+					bpm / 10,
+					bpm % 10,
+					bar + 1,
+					util::modulo(beat, beatsPerBar) + 1
+				);
+			}
+
 			task.font_.draw(
 				task.gfx_,
 				TEXT_MARGIN_,
@@ -128,13 +285,25 @@ void MainScreen::draw(UITask &task) const {
 			titleY += lineHeight;
 		}
 
-		drawWaveform_(task.gfx_, state, waveform, waveformY);
+		drawWaveform_(task.gfx_, state, i, zoom_, waveformY);
+		streamTask.unlockReader(i);
+
 		titleY    += (WAVEFORM_MARGIN_ + WAVEFORM_HEIGHT_) * 2;
 		waveformY += WAVEFORM_HEIGHT_;
 	}
 }
 
 void MainScreen::update(UITask &task, const drivers::InputState &inputs) {
+	// The selector is used to switch variants while either shift button is
+	// held.
+	constexpr auto SHIFT_MASK =
+		(drivers::DECK_BTN_SHIFT << 0) | (drivers::DECK_BTN_SHIFT << 5);
+
+	if (!(inputs.buttonsHeld & SHIFT_MASK)) {
+		zoom_ += inputs.selector;
+		zoom_  = util::clamp(zoom_, 0, WAVEFORM_OVERVIEW_ZOOM);
+	}
+
 	if (inputs.buttonsPressed & drivers::BTN_SELECTOR) {
 		task.libraryScreen_.loadDirectory("/sd");
 		task.currentScreen_ = &task.libraryScreen_;
@@ -48,8 +48,21 @@ public:
 	virtual void update(UITask &task, const drivers::InputState &inputs) {}
 };
 
+// Zoom levels are expressed as the base 2 logarithm of the number of full
+// resolution waveform samples per pixel. The last zoom level shows an overview
+// of the whole track instead.
+static constexpr int MAX_WAVEFORM_ZOOM      = 5;
+static constexpr int WAVEFORM_OVERVIEW_ZOOM = MAX_WAVEFORM_ZOOM + 1;
+
 class MainScreen : public Screen {
+private:
+	int zoom_;
+
 public:
+	inline MainScreen(void) :
+		zoom_(0)
+	{}
+
 	void draw(UITask &task) const override;
 	void update(UITask &task, const drivers::InputState &inputs) override;
 };
@@ -0,0 +1,616 @@
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "src/main/util/fat.hpp"
+#include "src/main/util/file.hpp"
+#include "src/main/util/string.hpp"
+#include "src/main/util/templates.hpp"
+
+namespace util {
+
+/* On-disk structures */
+
+struct [[gnu::packed]] MBREntry_ {
+public:
+	uint8_t  status, chsStart[3], type, chsEnd[3];
+	uint32_t lba, numBlocks;
+};
+
+struct [[gnu::packed]] BPB_ {
+public:
+	uint8_t  jump[3];
+	char     oemName[8];
+	uint16_t blockLength;
+	uint8_t  blocksPerCluster;
+	uint16_t numReservedBlocks;
+	uint8_t  numFATs;
+	uint16_t numRootEntries, numBlocks16;
+	uint8_t  mediaType;
+	uint16_t fatLength16, blocksPerTrack, numHeads;
+	uint32_t numHiddenBlocks, numBlocks32;
+
+	// FAT32 only
+	uint32_t fatLength32;
+	uint16_t flags, version;
+	uint32_t rootCluster;
+};
+
+struct [[gnu::packed]] DirEntry_ {
+public:
+	char     name[11];
+	uint8_t  attributes, reserved, createTimeFine;
+	uint16_t createTime, createDate, accessDate, clusterHigh;
+	uint16_t modifyTime, modifyDate, clusterLow;
+	uint32_t length;
+};
+
+struct [[gnu::packed]] LFNEntry_ {
+public:
+	uint8_t  sequence;
+	uint16_t name1[5];
+	uint8_t  attributes, type, checksum;
+	uint16_t name2[6];
+	uint16_t cluster;
+	uint16_t name3[2];
+};
+
+static constexpr size_t  MBR_ENTRY_OFFSET_    = 446;
+static constexpr size_t  MIN_FAT16_CLUSTERS_  = 4085;
+static constexpr size_t  MIN_FAT32_CLUSTERS_  = 65525;
+static constexpr size_t  LFN_CHARS_PER_ENTRY_ = 13;
+static constexpr uint8_t LFN_LAST_ENTRY_      = 1 << 6;
+
+static constexpr uint8_t ATTR_VOLUME_ID_ = 1 << 3;
+static constexpr uint8_t ATTR_DIRECTORY_ = 1 << 4;
+static constexpr uint8_t ATTR_LFN_       = 0x0f;
+static constexpr uint8_t ATTR_LFN_MASK_  = 0x3f;
+
+static inline bool hasSignature_(const uint8_t *block) {
+	return (block[510] == 0x55) && (block[511] == 0xaa);
+}
+
+static inline bool isBootBlock_(const uint8_t *block) {
+	auto bpb = reinterpret_cast<const BPB_ *>(block);
+
+	return true
+		&& hasSignature_(block)
+		&& ((bpb->jump[0] == 0xeb) || (bpb->jump[0] == 0xe9))
+		&& (bpb->blockLength == BLOCK_LENGTH)
+		&& bpb->blocksPerCluster
+		&& !(bpb->blocksPerCluster & (bpb->blocksPerCluster - 1))
+		&& bpb->numReservedBlocks
+		&& bpb->numFATs;
+}
+
+static inline bool isFATPartition_(const MBREntry_ &entry) {
+	switch (entry.type) {
+		case 0x04: // FAT16 (<32 MB)
+		case 0x06: // FAT16
+		case 0x0b: // FAT32 (CHS)
+		case 0x0c: // FAT32 (LBA)
+		case 0x0e: // FAT16 (LBA)
+			return entry.numBlocks > 0;
+
+		default:
+			return false;
+	}
+}
+
+/* Name matching */
+
+static inline uint32_t foldCase_(uint32_t ch) {
+	return ((ch >= 'a') && (ch <= 'z')) ? (ch - 'a' + 'A') : ch;
+}
+
+static uint8_t getShortNameChecksum_(const char *name) {
+	uint8_t sum = 0;
+
+	for (int i = 0; i < 11; i++)
+		sum = rotateRight<uint8_t>(sum, 1) + uint8_t(name[i]);
+
+	return sum;
+}
+
+static bool matchShortName_(
+	const char *shortName,
+	const char *name,
+	size_t     nameLength
+) {
+	char   buffer[12];
+	size_t length = 0;
+
+	for (int i = 0; (i < 8) && (shortName[i] != ' '); i++)
+		buffer[length++] = shortName[i];
+
+	if (shortName[8] != ' ') {
+		buffer[length++] = '.';
+
+		for (int i = 8; (i < 11) && (shortName[i] != ' '); i++)
+			buffer[length++] = shortName[i];
+	}
+
+	// A leading 0xe5 byte is stored as 0x05, as the former marks deleted
+	// entries.
+	if (buffer[0] == 0x05)
+		buffer[0] = char(0xe5);
+	if (length != nameLength)
+		return false;
+
+	for (size_t i = 0; i < length; i++) {
+		if (foldCase_(uint8_t(buffer[i])) != foldCase_(uint8_t(name[i])))
+			return false;
+	}
+
+	return true;
+}
+
+static bool matchLongName_(
+	const uint16_t *longName,
+	size_t         longNameLength,
+	const char     *name,
+	size_t         nameLength
+) {
+	auto   end = &name[nameLength];
+	size_t i   = 0;
+
+	// Decode the UTF-8 name and compare it against the UTF-16 long name.
+	while (name < end) {
+		auto value = parseUTF8Character(name);
+		auto ch    = value.codePoint;
+
+		if (!value.length || ((name + value.length) > end))
+			return false;
+
+		name += value.length;
+
+		if (ch >= 0x10000) {
+			ch -= 0x10000;
+
+			if ((i + 2) > longNameLength)
+				return false;
+			if (longName[i++] != (0xd800 | (ch >> 10)))
+				return false;
+			if (longName[i++] != (0xdc00 | (ch & 0x3ff)))
+				return false;
+		} else {
+			if (i >= longNameLength)
+				return false;
+			if (foldCase_(longName[i++]) != foldCase_(ch))
+				return false;
+		}
+	}
+
+	return (i == longNameLength);
+}
+
+/* FAT16/FAT32 extent resolver */
+
+bool FATVolume::readBlock_(uint32_t lba) {
+	if (lba == bufferLBA_)
+		return true;
+
+	bufferLBA_ = UINT32_MAX;
+
+	if (!device_->readBlocks(buffer_, lba, 1))
+		return false;
+
+	bufferLBA_ = lba;
+	return true;
+}
+
+uint32_t FATVolume::getNextCluster_(uint32_t cluster) {
+	const size_t offset = cluster * (isFAT32_ ? 4 : 2);
+
+	if (!readBlock_(fatLBA_ + offset / BLOCK_LENGTH))
+		return 0;
+
+	auto     ptr = &buffer_[offset % BLOCK_LENGTH];
+	uint32_t next;
+
+	if (isFAT32_)
+		next = concat4(ptr[0], ptr[1], ptr[2], ptr[3]) & 0x0fffffff;
+	else
+		next = concat2(ptr[0], ptr[1]);
+
+	// Free, bad and end-of-chain markers all terminate the chain.
+	if ((next < 2) || (next >= (numClusters_ + 2)))
+		return 0;
+
+	return next;
+}
+
+bool FATVolume::findEntry_(
+	uint32_t   &cluster,
+	uint32_t   &length,
+	bool       &isDirectory,
+	uint32_t   dirCluster,
+	const char *name,
+	size_t     nameLength
+) {
+	// A directory cluster of zero denotes the FAT16 root directory, which is
+	// stored in a fixed area rather than in the data region.
+	uint32_t lba       = dirCluster ? getClusterLBA_(dirCluster) : rootLBA_;
+	uint32_t numBlocks = dirCluster ? blocksPerCluster_ : numRootBlocks_;
+
+	int     nextSequence   = -1;
+	uint8_t checksum       = 0;
+	size_t  longNameLength = 0;
+
+	for (;;) {
+		for (uint32_t i = 0; i < numBlocks; i++) {
+			if (!readBlock_(lba + i))
+				return false;
+
+			auto entries = reinterpret_cast<const DirEntry_ *>(buffer_);
+
+			for (size_t j = 0; j < (BLOCK_LENGTH / sizeof(DirEntry_)); j++) {
+				auto &entry = entries[j];
+
+				if (!entry.name[0])
+					return false;
+				if (uint8_t(entry.name[0]) == 0xe5) {
+					nextSequence = -1;
+					continue;
+				}
+
+				// Long file names are split across multiple entries, stored
+				// in reverse order right before the short name entry.
+				if ((entry.attributes & ATTR_LFN_MASK_) == ATTR_LFN_) {
+					auto &lfn     = reinterpret_cast<const LFNEntry_ &>(entry);
+					int  sequence = lfn.sequence & (LFN_LAST_ENTRY_ - 1);
+
+					if (lfn.sequence & LFN_LAST_ENTRY_) {
+						nextSequence   = sequence;
+						checksum       = lfn.checksum;
+						longNameLength = sequence * LFN_CHARS_PER_ENTRY_;
+
+						if (longNameLength > countOf(nameBuffer_))
+							nextSequence = -1;
+					}
+					if (
+						!sequence ||
+						(sequence != nextSequence) ||
+						(lfn.checksum != checksum)
+					) {
+						nextSequence = -1;
+						continue;
+					}
+
+					auto ptr =
+						&nameBuffer_[(sequence - 1) * LFN_CHARS_PER_ENTRY_];
+
+					memcpy(ptr,      lfn.name1, sizeof(lfn.name1));
+					memcpy(ptr + 5,  lfn.name2, sizeof(lfn.name2));
+					memcpy(ptr + 11, lfn.name3, sizeof(lfn.name3));
+					nextSequence--;
+					continue;
+				}
+
+				const bool hasLongName = true
+					&& !nextSequence
+					&& (getShortNameChecksum_(entry.name) == checksum);
+
+				nextSequence = -1;
+
+				if (entry.attributes & ATTR_VOLUME_ID_)
+					continue;
+
+				if (hasLongName) {
+					// The name is null terminated (and padded with 0xffff)
+					// unless it fills the last entry entirely.
+					size_t actualLength = 0;
+
+					while (
+						(actualLength < longNameLength) &&
+						nameBuffer_[actualLength]
+					)
+						actualLength++;
+
+					const bool match = false
+						|| matchLongName_(
+							nameBuffer_,
+							actualLength,
+							name,
+							nameLength
+						)
+						|| matchShortName_(entry.name, name, nameLength);
+
+					if (!match)
+						continue;
+				} else if (!matchShortName_(entry.name, name, nameLength)) {
+					continue;
+				}
+
+				cluster     = concat4(entry.clusterLow, entry.clusterHigh);
+				length      = entry.length;
+				isDirectory = entry.attributes & ATTR_DIRECTORY_;
+
+				if (!isFAT32_)
+					cluster &= 0xffff;
+				// ".." entries pointing to the root directory use cluster 0
+				// even on FAT32.
+				if (isDirectory && !cluster && isFAT32_)
+					cluster = rootCluster_;
+
+				return true;
+			}
+		}
+
+		if (!dirCluster)
+			return false;
+
+		dirCluster = getNextCluster_(dirCluster);
+
+		if (!dirCluster)
+			return false;
+
+		lba = getClusterLBA_(dirCluster);
+	}
+}
+
+bool FATVolume::mount(BlockDevice &device) {
+	device_    = &device;
+	bufferLBA_ = UINT32_MAX;
+
+	// The volume may either span the entire device or be preceded by an MBR,
+	// in which case the first FAT partition is used (as FatFs does).
+	uint32_t baseLBA = 0;
+
+	if (!readBlock_(0))
+		goto cleanup;
+
+	if (!isBootBlock_(buffer_)) {
+		if (!hasSignature_(buffer_))
+			goto cleanup;
+
+		auto entries =
+			reinterpret_cast<const MBREntry_ *>(&buffer_[MBR_ENTRY_OFFSET_]);
+		int  index   = 0;
+
+		for (; index < 4; index++) {
+			if (isFATPartition_(entries[index]))
+				break;
+		}
+
+		if (index == 4)
+			goto cleanup;
+
+		baseLBA = entries[index].lba;
+
+		if (!readBlock_(baseLBA) || !isBootBlock_(buffer_))
+			goto cleanup;
+	}
+
+	{
+		auto bpb = reinterpret_cast<const BPB_ *>(buffer_);
+
+		const uint32_t fatLength =
+			bpb->fatLength16 ? bpb->fatLength16 : bpb->fatLength32;
+		const uint32_t numBlocks =
+			bpb->numBlocks16 ? bpb->numBlocks16 : bpb->numBlocks32;
+
+		blocksPerCluster_ = bpb->blocksPerCluster;
+		numRootBlocks_    =
+			(bpb->numRootEntries * sizeof(DirEntry_) + BLOCK_LENGTH - 1)
+			/ BLOCK_LENGTH;
+		fatLBA_           = baseLBA + bpb->numReservedBlocks;
+		rootLBA_          = fatLBA_ + bpb->numFATs * fatLength;
+		dataLBA_          = rootLBA_ + numRootBlocks_;
+
+		if ((dataLBA_ - baseLBA) >= numBlocks)
+			goto cleanup;
+
+		// The FAT type is determined solely by the number of clusters. FAT12
+		// is not supported as it is never used on SD cards.
+		numClusters_ = (numBlocks - (dataLBA_ - baseLBA)) / blocksPerCluster_;
+		isFAT32_     = (numClusters_ >= MIN_FAT32_CLUSTERS_);
+		rootCluster_ = isFAT32_ ? bpb->rootCluster : 0;
+
+		if (numClusters_ < MIN_FAT16_CLUSTERS_)
+			goto cleanup;
+		if (isFAT32_ && (numRootBlocks_ || (rootCluster_ < 2)))
+			goto cleanup;
+	}
+
+	return true;
+
+cleanup:
+	device_ = nullptr;
+	return false;
+}
+
+size_t FATVolume::resolve(
+	FATExtent  *output,
+	size_t     maxExtents,
+	size_t     &length,
+	const char *path
+) {
+	if (!device_)
+		return 0;
+
+	uint32_t cluster     = rootCluster_;
+	uint32_t fileLength  = 0;
+	bool     isDirectory = true;
+
+	while (*path) {
+		if (*path == '/') {
+			path++;
+			continue;
+		}
+
+		auto   separator  = strchr(path, '/');
+		size_t nameLength = separator ? (separator - path) : strlen(path);
+
+		if (!isDirectory)
+			return 0;
+		if (!findEntry_(
+			cluster,
+			fileLength,
+			isDirectory,
+			cluster,
+			path,
+			nameLength
+		))
+			return 0;
+
+		path += nameLength;
+	}
+
+	if (isDirectory)
+		return 0;
+
+	// Walk the cluster chain, merging runs of consecutive clusters into a
+	// single extent.
+	const size_t clusterLength = blocksPerCluster_ * BLOCK_LENGTH;
+	size_t       numClusters   =
+		(fileLength + clusterLength - 1) / clusterLength;
+	size_t       numExtents    = 0;
+
+	for (; numClusters > 0; numClusters--) {
+		if ((cluster < 2) || (cluster >= (numClusters_ + 2)))
+			return 0;
+
+		const uint32_t lba = getClusterLBA_(cluster);
+
+		if (
+			numExtents &&
+			((output[numExtents - 1].lba + output[numExtents - 1].numBlocks)
+				== lba)
+		) {
+			output[numExtents - 1].numBlocks += blocksPerCluster_;
+		} else {
+			if (numExtents >= maxExtents)
+				return 0;
+
+			output[numExtents].lba       = lba;
+			output[numExtents].numBlocks = blocksPerCluster_;
+			numExtents++;
+		}
+
+		if (numClusters > 1)
+			cluster = getNextCluster_(cluster);
+	}
+
+	length = fileLength;
+	return numExtents;
+}
+
+/* Raw extent file backend */
+
+bool ExtentFile::findBlock_(uint32_t &lba, size_t &numBlocks, size_t block) {
+	// Reads are mostly sequential, so the search resumes from the extent the
+	// previous block was found in.
+	if (block < lastExtentBlock_) {
+		lastExtent_      = 0;
+		lastExtentBlock_ = 0;
+	}
+
+	for (; lastExtent_ < numExtents_; lastExtent_++) {
+		auto         &extent = extents_[lastExtent_];
+		const size_t index   = block - lastExtentBlock_;
+
+		if (index < extent.numBlocks) {
+			lba       = extent.lba + index;
+			numBlocks = extent.numBlocks - index;
+			return true;
+		}
+
+		lastExtentBlock_ += extent.numBlocks;
+	}
+
+	lastExtent_      = 0;
+	lastExtentBlock_ = 0;
+	return false;
+}
+
+bool ExtentFile::open(const char *path) {
+	if (isOpen())
+		close();
+
+	if (volume_ && volume_->isMounted()) {
+		const size_t prefixLength = strlen(mountPoint_);
+
+		if (
+			!strncmp(path, mountPoint_, prefixLength) &&
+			(path[prefixLength] == '/')
+		)
+			numExtents_ = volume_->resolve(
+				extents_,
+				MAX_FILE_EXTENTS,
+				length_,
+				&path[prefixLength]
+			);
+	}
+
+	if (!isRaw())
+		return fallback_.open(path);
+
+	lastExtent_      = 0;
+	lastExtentBlock_ = 0;
+	bufferLBA_       = UINT32_MAX;
+	return true;
+}
+
+void ExtentFile::close(void) {
+	numExtents_ = 0;
+	length_     = 0;
+	fallback_.close();
+}
+
+bool ExtentFile::read(void *output, size_t length, size_t offset) {
+	if (!isRaw())
+		return fallback_.read(output, length, offset);
+
+	auto device = volume_->getDevice();
+
+	if (!device)
+		return false;
+	if ((offset > length_) || (length > (length_ - offset)))
+		return false;
+
+	auto ptr = reinterpret_cast<uint8_t *>(output);
+
+	while (length > 0) {
+		uint32_t lba;
+		size_t   numBlocks;
+
+		if (!findBlock_(lba, numBlocks, offset / BLOCK_LENGTH))
+			return false;
+
+		const size_t blockOffset = offset % BLOCK_LENGTH;
+		size_t       chunkLength;
+
+		if (blockOffset || (length < BLOCK_LENGTH)) {
+			// Partial blocks go through a buffer, which is kept around as
+			// unaligned sequential reads often start in the block the previous
+			// read ended in.
+			if (lba != bufferLBA_) {
+				bufferLBA_ = UINT32_MAX;
+
+				if (!device->readBlocks(buffer_, lba, 1))
+					return false;
+
+				bufferLBA_ = lba;
+			}
+
+			chunkLength = min(BLOCK_LENGTH - blockOffset, length);
+			memcpy(ptr, &buffer_[blockOffset], chunkLength);
+		} else {
+			numBlocks = min(numBlocks, length / BLOCK_LENGTH);
+
+			if (!device->readBlocks(ptr, lba, numBlocks))
+				return false;
+
+			chunkLength = numBlocks * BLOCK_LENGTH;
+		}
+
+		ptr    += chunkLength;
+		offset += chunkLength;
+		length -= chunkLength;
+	}
+
+	return true;
+}
+
+}
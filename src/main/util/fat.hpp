@@ -0,0 +1,155 @@
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "src/main/util/file.hpp"
+
+namespace util {
+
+/* Block device interface */
+
+static constexpr size_t BLOCK_LENGTH = 512;
+
+class BlockDevice {
+public:
+	virtual ~BlockDevice(void) {}
+
+	virtual bool readBlocks(void *output, uint32_t lba, size_t numBlocks) = 0;
+};
+
+// Block device backed by a disk image, which may be accessed through any file
+// backend. Mainly useful for testing the FAT resolver on the host.
+class ImageBlockDevice : public BlockDevice {
+private:
+	File &file_;
+
+public:
+	inline ImageBlockDevice(File &file) :
+		file_(file)
+	{}
+
+	inline bool readBlocks(
+		void     *output,
+		uint32_t lba,
+		size_t   numBlocks
+	) override {
+		return file_.read(
+			output,
+			numBlocks * BLOCK_LENGTH,
+			size_t(lba) * BLOCK_LENGTH
+		);
+	}
+};
+
+/* FAT16/FAT32 extent resolver */
+
+static constexpr size_t MAX_FILE_EXTENTS = 32;
+
+struct FATExtent {
+public:
+	uint32_t lba, numBlocks;
+};
+
+// Minimal read-only FAT parser, which can look up a file by path (including
+// long file names) and translate its cluster chain into a list of contiguous
+// block ranges. Only ASCII characters are matched case-insensitively.
+class FATVolume {
+private:
+	BlockDevice *device_;
+
+	bool     isFAT32_;
+	uint8_t  blocksPerCluster_;
+	uint32_t fatLBA_, dataLBA_, rootLBA_, numRootBlocks_;
+	uint32_t rootCluster_, numClusters_;
+
+	uint32_t bufferLBA_;
+	uint8_t  buffer_[BLOCK_LENGTH];
+	uint16_t nameBuffer_[260];
+
+	inline uint32_t getClusterLBA_(uint32_t cluster) const {
+		return dataLBA_ + (cluster - 2) * blocksPerCluster_;
+	}
+
+	bool readBlock_(uint32_t lba);
+	uint32_t getNextCluster_(uint32_t cluster);
+	bool findEntry_(
+		uint32_t   &cluster,
+		uint32_t   &length,
+		bool       &isDirectory,
+		uint32_t   dirCluster,
+		const char *name,
+		size_t     nameLength
+	);
+
+public:
+	inline FATVolume(void) :
+		device_(nullptr)
+	{}
+
+	inline bool isMounted(void) const {
+		return device_ != nullptr;
+	}
+	inline BlockDevice *getDevice(void) const {
+		return device_;
+	}
+	inline void unmount(void) {
+		device_ = nullptr;
+	}
+
+	bool mount(BlockDevice &device);
+	size_t resolve(
+		FATExtent  *output,
+		size_t     maxExtents,
+		size_t     &length,
+		const char *path
+	);
+};
+
+// File backend that resolves a file's extents once when opening it and then
+// reads from the underlying block device directly, bypassing the VFS and FAT
+// driver. Paths must start with the volume's mount point; files that cannot be
+// resolved (or are too fragmented) are accessed through stdio instead.
+class ExtentFile : public File {
+private:
+	FATVolume  *volume_;
+	const char *mountPoint_;
+	StdioFile  fallback_;
+
+	size_t    length_, numExtents_, lastExtent_, lastExtentBlock_;
+	FATExtent extents_[MAX_FILE_EXTENTS];
+
+	uint32_t bufferLBA_;
+	alignas(4) uint8_t buffer_[BLOCK_LENGTH];
+
+	bool findBlock_(uint32_t &lba, size_t &numBlocks, size_t block);
+
+public:
+	inline ExtentFile(void) :
+		volume_(nullptr),
+		mountPoint_(nullptr),
+		length_(0),
+		numExtents_(0)
+	{}
+	inline ~ExtentFile(void) {
+		close();
+	}
+
+	inline void setVolume(FATVolume &volume, const char *mountPoint) {
+		close();
+		volume_     = &volume;
+		mountPoint_ = mountPoint;
+	}
+	inline bool isRaw(void) const {
+		return numExtents_ > 0;
+	}
+
+	inline bool isOpen(void) const override {
+		return isRaw() || fallback_.isOpen();
+	}
+	bool open(const char *path) override;
+	void close(void) override;
+	bool read(void *output, size_t length, size_t offset) override;
+};
+
+}
@@ -0,0 +1,131 @@
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "src/main/util/file.hpp"
+
+#ifndef ESP_PLATFORM
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace util {
+
+/* Stdio backend */
+
+bool StdioFile::open(const char *path) {
+	if (file_)
+		close();
+
+	file_ = fopen(path, "rb");
+	return (file_ != nullptr);
+}
+
+void StdioFile::close(void) {
+	if (!file_)
+		return;
+
+	fclose(file_);
+	file_ = nullptr;
+}
+
+bool StdioFile::read(void *output, size_t length, size_t offset) {
+	if (!file_)
+		return false;
+
+	return !fseek(file_, offset, SEEK_SET) && fread(output, length, 1, file_);
+}
+
+/* POSIX backend */
+
+bool POSIXFile::open(const char *path) {
+	if (fd_ >= 0)
+		close();
+
+	fd_ = ::open(path, O_RDONLY);
+	return (fd_ >= 0);
+}
+
+void POSIXFile::close(void) {
+	if (fd_ < 0)
+		return;
+
+	::close(fd_);
+	fd_ = -1;
+}
+
+bool POSIXFile::read(void *output, size_t length, size_t offset) {
+	if (fd_ < 0)
+		return false;
+
+	auto ptr = reinterpret_cast<uint8_t *>(output);
+
+	// pread() may return less data than requested (e.g. if interrupted by a
+	// signal), in which case the remaining data must be read separately.
+	while (length > 0) {
+		auto actualLength = pread(fd_, ptr, length, offset);
+
+		if (actualLength <= 0)
+			return false;
+
+		ptr    += actualLength;
+		offset += actualLength;
+		length -= actualLength;
+	}
+
+	return true;
+}
+
+/* Memory-mapped backend */
+
+#ifndef ESP_PLATFORM
+
+bool MappedFile::open(const char *path) {
+	if (data_)
+		close();
+
+	int         fd = ::open(path, O_RDONLY);
+	struct stat info;
+
+	if (fd < 0)
+		return false;
+
+	if (!fstat(fd, &info) && (info.st_size > 0)) {
+		auto ptr = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+		if (ptr != MAP_FAILED) {
+			data_   = reinterpret_cast<const uint8_t *>(ptr);
+			length_ = info.st_size;
+		}
+	}
+
+	// The mapping stays valid after the file descriptor is closed.
+	::close(fd);
+	return (data_ != nullptr);
+}
+
+void MappedFile::close(void) {
+	if (!data_)
+		return;
+
+	munmap(const_cast<uint8_t *>(data_), length_);
+	data_   = nullptr;
+	length_ = 0;
+}
+
+bool MappedFile::read(void *output, size_t length, size_t offset) {
+	if (!data_)
+		return false;
+	if ((offset > length_) || (length > (length_ - offset)))
+		return false;
+
+	memcpy(output, &data_[offset], length);
+	return true;
+}
+
+#endif
+
+}
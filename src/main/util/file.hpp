@@ -0,0 +1,97 @@
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace util {
+
+/* File I/O backends */
+
+// All reads are positional, so that callers (such as sst::Reader) do not have
+// to track the current file offset and backends are free to implement them in
+// a single call where possible.
+class File {
+public:
+	virtual ~File(void) {}
+
+	virtual bool isOpen(void) const = 0;
+	virtual bool open(const char *path) = 0;
+	virtual void close(void) = 0;
+	virtual bool read(void *output, size_t length, size_t offset) = 0;
+};
+
+// Buffered stdio backend, which issues an fseek() and fread() for each read.
+class StdioFile : public File {
+private:
+	FILE *file_;
+
+public:
+	inline StdioFile(void) :
+		file_(nullptr)
+	{}
+	inline ~StdioFile(void) {
+		close();
+	}
+
+	inline bool isOpen(void) const override {
+		return file_ != nullptr;
+	}
+	bool open(const char *path) override;
+	void close(void) override;
+	bool read(void *output, size_t length, size_t offset) override;
+};
+
+// Unbuffered POSIX backend, which uses pread() to seek and read in a single
+// call.
+class POSIXFile : public File {
+private:
+	int fd_;
+
+public:
+	inline POSIXFile(void) :
+		fd_(-1)
+	{}
+	inline ~POSIXFile(void) {
+		close();
+	}
+
+	inline bool isOpen(void) const override {
+		return fd_ >= 0;
+	}
+	bool open(const char *path) override;
+	void close(void) override;
+	bool read(void *output, size_t length, size_t offset) override;
+};
+
+#ifndef ESP_PLATFORM
+
+// Memory-mapped backend (host only), which maps the entire file and copies
+// data out of the mapping. Reads never block on the kernel once the relevant
+// pages are resident.
+class MappedFile : public File {
+private:
+	const uint8_t *data_;
+	size_t        length_;
+
+public:
+	inline MappedFile(void) :
+		data_(nullptr),
+		length_(0)
+	{}
+	inline ~MappedFile(void) {
+		close();
+	}
+
+	inline bool isOpen(void) const override {
+		return data_ != nullptr;
+	}
+	bool open(const char *path) override;
+	void close(void) override;
+	bool read(void *output, size_t length, size_t offset) override;
+};
+
+#endif
+
+}
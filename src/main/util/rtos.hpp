@@ -207,7 +207,7 @@ public:
 			handle_,
 			&pushedItem_,
 			sizeof(T),
-			blocking ? 0 : portMAX_DELAY
+			blocking ? portMAX_DELAY : 0
 		);
 
 		return reinterpret_cast<T *>(pushedItem_);
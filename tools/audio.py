@@ -1,10 +1,15 @@
 # -*- coding: utf-8 -*-
 
-from collections.abc import Iterable
-from typing          import Any, BinaryIO
+from collections        import deque
+from collections.abc    import Iterable, Sequence
+from concurrent.futures import Executor, Future
+from enum               import IntEnum
+from typing             import Any, BinaryIO
 
 import av, numpy
-from native import KeyFinder, PitchShifter, SSTEncoder, WaveformEncoder
+from native import \
+	BeatTracker, KeyFinder, LoudnessMeter, PitchShifter, SSTEncoder, \
+	WaveformEncoder, resampleWaveform
 from numpy  import dtype, ndarray
 
 ## Pitch shifting and .sst ADPCM encoding
@@ -13,22 +18,93 @@ NUM_CHANNELS:       int = 2
 BLOCKS_PER_SECTOR:  int = 85
 SAMPLES_PER_SECTOR: int = 22 * BLOCKS_PER_SECTOR
 
+class SSTEncoderQuality(IntEnum):
+	SST_QUALITY_DRAFT  = 0
+	SST_QUALITY_FAST   = 1
+	SST_QUALITY_NORMAL = 2
+	SST_QUALITY_BEST   = 3
+
+class SSTBlockFormat(IntEnum):
+	SST_FORMAT_4BIT = 0
+	SST_FORMAT_3BIT = 1
+	SST_FORMAT_2BIT = 2
+
+DEFAULT_BLOCK_FORMATS: tuple[SSTBlockFormat, ...] = \
+	( SSTBlockFormat.SST_FORMAT_4BIT, ) * NUM_CHANNELS
+
+def encodeIndependentSector(
+	samples: ndarray,
+	history: ndarray,
+	quality: SSTEncoderQuality,
+	formats: Sequence[SSTBlockFormat]
+) -> bytes:
+	sector: bytearray = bytearray()
+
+	# Seed the encoder with the last two source samples of the previous chunk
+	# rather than carrying its state over, so that chunks can be encoded in any
+	# order.
+	for channel, ( s2, s1 ), blockFormat in zip(samples, history, formats):
+		encoder: SSTEncoder = SSTEncoder(quality, blockFormat)
+		encoder.reset(s1, s2)
+		sector += encoder.encode(channel)
+
+	return bytes(sector)
+
 class VariantEncoder:
-	def __init__(self):
+	def __init__(
+		self,
+		quality:  SSTEncoderQuality        = SSTEncoderQuality.SST_QUALITY_BEST,
+		midSide:  bool                     = False,
+		formats:  Sequence[SSTBlockFormat] = DEFAULT_BLOCK_FORMATS,
+		executor: Executor | None          = None
+	):
+		self._quality:  SSTEncoderQuality          = quality
+		self._midSide:  bool                       = midSide
+		self._executor: Executor | None            = executor
+		self.formats:   tuple[SSTBlockFormat, ...] = tuple(formats)
+
+		self.lastSectorSilent: bool = False
+
 		self._encoders: list[SSTEncoder] = [
-			SSTEncoder() for _ in range(NUM_CHANNELS)
+			SSTEncoder(quality, blockFormat) for blockFormat in self.formats
 		]
+		self._history:  ndarray = \
+			numpy.zeros(( len(self.formats), 2 ), numpy.int16)
 		self._buffered: ndarray = \
-			numpy.empty(( NUM_CHANNELS, 0 ), numpy.float32)
+			numpy.empty(( len(self.formats), 0 ), numpy.float32)
 
-	def _encode(self, samples: ndarray) -> bytes:
-		samples           = (samples * 32768.0).clip(-32768.0, 32767.0)
-		sector: bytearray = bytearray()
+	def _encode(self, samples: ndarray) -> bytes | Future[bytes]:
+		# In mid/side mode the decoder reconstructs the left and right channels
+		# as (mid + side) and (mid - side) respectively.
+		if self._midSide:
+			samples = numpy.stack((
+				samples[0] + samples[1],
+				samples[0] - samples[1]
+			)) * 0.5
 
-		for channel, encoder in zip(samples, self._encoders):
-			sector += encoder.encode(channel.astype(numpy.int16))
+		samples = (samples * 32768.0).clip(-32768.0, 32767.0)
+		samples = samples.astype(numpy.int16)
 
-		return bytes(sector)
+		self.lastSectorSilent = not samples.any()
+
+		if self._executor is None:
+			sector: bytearray = bytearray()
+
+			for channel, encoder in zip(samples, self._encoders):
+				sector += encoder.encode(channel)
+
+			return bytes(sector)
+
+		history: ndarray = self._history
+		self._history    = samples[:, -2:].copy()
+
+		return self._executor.submit(
+			encodeIndependentSector,
+			samples,
+			history,
+			self._quality,
+			self.formats
+		)
 
 	def feed(
 		self,
@@ -37,7 +113,7 @@ class VariantEncoder:
 	):
 		self._buffered = numpy.c_[self._buffered, samples]
 
-	def encodeSector(self) -> bytes:
+	def encodeSector(self) -> bytes | Future[bytes]:
 		samples: ndarray = self._buffered[:, 0:SAMPLES_PER_SECTOR]
 		self._buffered   = self._buffered[:, SAMPLES_PER_SECTOR:]
 
@@ -48,12 +124,21 @@ class VariantEncoder:
 		return self._buffered.shape[1] // SAMPLES_PER_SECTOR
 
 class PitchShiftedVariantEncoder(VariantEncoder):
-	def __init__(self, sampleRate: int, pitchOffset: float):
-		super().__init__()
+	def __init__(
+		self,
+		sampleRate:  int,
+		pitchOffset: float,
+		quality:     SSTEncoderQuality        = \
+			SSTEncoderQuality.SST_QUALITY_BEST,
+		midSide:     bool                     = False,
+		formats:     Sequence[SSTBlockFormat] = DEFAULT_BLOCK_FORMATS,
+		executor:    Executor | None          = None
+	):
+		super().__init__(quality, midSide, formats, executor)
 
 		self._shifter: PitchShifter = PitchShifter(
 			sampleRate,
-			NUM_CHANNELS,
+			len(self.formats),
 			1.0,
 			2.0 ** (pitchOffset / 12.0),
 			0x4000
@@ -66,7 +151,7 @@ class PitchShiftedVariantEncoder(VariantEncoder):
 	):
 		self._shifter.feed(samples, final)
 
-	def encodeSector(self) -> bytes:
+	def encodeSector(self) -> bytes | Future[bytes]:
 		return self._encode(self._shifter.retrieve(SAMPLES_PER_SECTOR))
 
 	@property
@@ -75,34 +160,136 @@ class PitchShiftedVariantEncoder(VariantEncoder):
 
 ## .sst encoder pipeline
 
+# Maximum number of sectors that can be queued for encoding on a thread pool
+# before the pipeline waits for them to be written out.
+MAX_PENDING_SECTORS: int = 1024
+
+# Runs of silent chunks are elided from the file and listed in the header
+# instead, as long as they are long enough to be worth a slot in the list.
+SST_MAX_SILENT_RUNS:   int = 32
+MIN_SILENT_RUN_LENGTH: int = 4
+
+# Lower resolution copies of the waveform are stored alongside the full one
+# (sampled at WAVEFORM_SAMPLE_RATE), so that the player can draw it at any zoom
+# level by only looking at a few samples per pixel. The overview spans the whole
+# track and matches the width of the display.
+SST_MAX_WAVEFORM_LEVELS:  int             = 4
+WAVEFORM_SAMPLE_RATE:     int             = 32
+WAVEFORM_LEVEL_RATES:     tuple[int, ...] = ( 8, 2 )
+WAVEFORM_OVERVIEW_LENGTH: int             = 160
+
+# If enabled, each level is followed by the RMS levels of the low, mid and high
+# frequency bands, in the same format, which the player uses to color the
+# waveform.
+NUM_WAVEFORM_BANDS: int = 3
+
+# (sample rate, number of samples, data) tuple; overviews have a sample rate of
+# zero. The data includes the band levels, if any.
+WaveformLevel = tuple[int, int, bytes]
+
 class EncodingPipeline:
-	def __init__(self, sampleRate: int, pitchOffsets: Iterable[float]):
+	def __init__(
+		self,
+		sampleRate:    int,
+		pitchOffsets:  Iterable[float],
+		numChannels:   int               = NUM_CHANNELS,
+		quality:       SSTEncoderQuality = SSTEncoderQuality.SST_QUALITY_BEST,
+		midSide:       bool              = False,
+		variantFormat: SSTBlockFormat    = SSTBlockFormat.SST_FORMAT_4BIT,
+		sideFormat:    SSTBlockFormat    = SSTBlockFormat.SST_FORMAT_4BIT,
+		groupLength:   int               = 1,
+		waveformBands: bool              = True,
+		executor:      Executor | None   = None
+	):
+		# Mono tracks are stored as a single channel, which the player
+		# duplicates into both outputs. Mid/side encoding is only meaningful
+		# for stereo tracks.
+		if numChannels == 1:
+			layout:  str  = "mono"
+			midSide: bool = False
+		else:
+			layout:  str  = "stereo"
+
 		self._resampler: av.AudioResampler = av.AudioResampler(
 			"fltp",
-			"stereo",
+			layout,
 			sampleRate,
 			SAMPLES_PER_SECTOR
 		)
 		self._keyFinder: KeyFinder = KeyFinder(
 			sampleRate,
-			NUM_CHANNELS
+			numChannels
+		)
+		self._beatTracker: BeatTracker = BeatTracker(
+			sampleRate,
+			numChannels
+		)
+		self._loudnessMeter: LoudnessMeter = LoudnessMeter(
+			sampleRate,
+			numChannels
 		)
-		self._variants: list[VariantEncoder] = []
-		self._waveform: WaveformEncoder      = WaveformEncoder()
+		self._variants: list[VariantEncoder]              = []
+		self._waveform: WaveformEncoder                   = WaveformEncoder()
+		self._levels:   list[WaveformEncoder]             = [
+			WaveformEncoder(rate) for rate in WAVEFORM_LEVEL_RATES
+		]
+		self._bands:    bool                              = waveformBands
+		self._pending:  deque[bytes | Future[bytes]]    = deque()
+		self._silent:   list[list[bytes | Future[bytes]]] = []
+		self._group:    list[list[bytes | Future[bytes]]] = []
+
+		self.groupLength: int = groupLength
 
 		for pitch in pitchOffsets:
+			# Pitch-shifted variants are only played back while the pitch is
+			# being adjusted, so they may be stored at a lower bit depth than
+			# the original one. In mid/side mode the side channel can be
+			# further reduced on its own (higher format values use fewer bits).
 			if (pitch > -0.01) and (pitch < 0.01):
-				encoder: VariantEncoder = VariantEncoder()
+				mainFormat: SSTBlockFormat = SSTBlockFormat.SST_FORMAT_4BIT
+			else:
+				mainFormat: SSTBlockFormat = variantFormat
+
+			formats: list[SSTBlockFormat] = [ mainFormat ] * numChannels
+
+			if midSide:
+				formats[1] = max(mainFormat, sideFormat)
+
+			if (pitch > -0.01) and (pitch < 0.01):
+				encoder: VariantEncoder = \
+					VariantEncoder(quality, midSide, formats, executor)
 			else:
 				encoder: VariantEncoder = PitchShiftedVariantEncoder(
 					sampleRate,
-					pitch
+					pitch,
+					quality,
+					midSide,
+					formats,
+					executor
 				)
 
 			self._variants.append(encoder)
 
-		self.waveformData:  bytearray = bytearray()
-		self.chunksEncoded: int       = 0
+		self.waveformData:  bytearray             = bytearray()
+		self.chunksEncoded: int                   = 0
+		self.silentRuns:    list[tuple[int, int]] = []
+
+		self.waveformBands: list[bytearray] = []
+
+		# Each entry holds the peak waveform followed by the band levels.
+		self._levelData: list[list[bytearray]] = [
+			[] for _ in self._levels
+		]
+
+		if waveformBands:
+			self.waveformBands = \
+				[ bytearray() for _ in range(NUM_WAVEFORM_BANDS) ]
+
+			for data in self._levelData:
+				data.extend(bytearray() for _ in range(NUM_WAVEFORM_BANDS + 1))
+		else:
+			for data in self._levelData:
+				data.append(bytearray())
 
 	def feed(self, frame: av.AudioFrame | None):
 		newFrames: list[av.AudioFrame] = self._resampler.resample(frame)
@@ -112,29 +299,155 @@ class EncodingPipeline:
 			final:   bool    = (frame is None) and (newFrame is newFrames[-1])
 
 			self._keyFinder.feed(samples)
+			self._beatTracker.feed(samples)
+			self._loudnessMeter.feed(samples)
 
 			converted: ndarray = samples.mean(0)
 			converted          = (converted * 32768.0).clip(-32768.0, 32767.0)
-			self.waveformData += self._waveform.encode(
-				converted.astype(numpy.int16),
-				self._resampler.rate
+			converted          = converted.astype(numpy.int16)
+
+			self._encodeWaveform(
+				self._waveform,
+				[ self.waveformData, *self.waveformBands ],
+				converted
 			)
 
+			for encoder, data in zip(self._levels, self._levelData):
+				self._encodeWaveform(encoder, data, converted)
+
 			for variant in self._variants:
 				variant.feed(samples, final)
 
-	def flush(self, outputFile: BinaryIO):
-		while True:
-			# Keep flushing as long as at least one sector is available from
-			# each variant encoder.
-			for variant in self._variants:
-				if not variant.availableSectors:
-					return
+	def _encodeWaveform(
+		self,
+		encoder: WaveformEncoder,
+		outputs: list[bytearray],
+		samples: ndarray
+	):
+		if self._bands:
+			data, bands = encoder.encodeWithBands(samples, self._resampler.rate)
+		else:
+			data, bands = encoder.encode(samples, self._resampler.rate), ()
 
-			for variant in self._variants:
-				outputFile.write(variant.encodeSector())
+		for output, chunk in zip(outputs, ( data, *bands )):
+			output += chunk
+
+	def _endGroup(self):
+		# Within each group of chunks, all sectors belonging to the same
+		# variant are written back to back (one row per chunk if the group
+		# length is 1).
+		for index in range(len(self._variants)):
+			self._pending.extend(row[index] for row in self._group)
+
+		self._group.clear()
+
+	def _storeRow(self, row: list[bytes | Future[bytes]]):
+		self._group.append(row)
+
+		if len(self._group) >= self.groupLength:
+			self._endGroup()
+
+	def _endSilentRun(self):
+		if not self._silent:
+			return
+
+		length: int = len(self._silent)
+
+		if (
+			(length >= MIN_SILENT_RUN_LENGTH) and
+			(len(self.silentRuns) < SST_MAX_SILENT_RUNS)
+		):
+			self.silentRuns.append(( self.chunksEncoded - length, length ))
+
+			for row in self._silent:
+				for sector in row:
+					if isinstance(sector, Future):
+						sector.cancel()
+		else:
+			for row in self._silent:
+				self._storeRow(row)
+
+		self._silent.clear()
+
+	def flush(self, outputFile: BinaryIO, final: bool = False):
+		# Keep flushing as long as at least one sector is available from each
+		# variant encoder. Silent chunks are still encoded (so that the
+		# encoders' state is unaffected) but held back until the end of the
+		# run is known.
+		while all(variant.availableSectors for variant in self._variants):
+			sectors: list[bytes | Future[bytes]] = [
+				variant.encodeSector() for variant in self._variants
+			]
+
+			if all(variant.lastSectorSilent for variant in self._variants):
+				self._silent.append(sectors)
+			else:
+				self._endSilentRun()
+				self._storeRow(sectors)
 
 			self.chunksEncoded += 1
 
+		if final:
+			self._endSilentRun()
+			self._endGroup()
+
+		# Sectors encoded on a thread pool are written out in order as soon as
+		# they are ready. Waiting is only necessary once too many sectors are
+		# queued, or when flushing the last ones.
+		while self._pending:
+			sector: bytes | Future[bytes] = self._pending[0]
+
+			if isinstance(sector, Future):
+				if not (
+					final or
+					sector.done() or
+					(len(self._pending) > MAX_PENDING_SECTORS)
+				):
+					break
+
+				sector = sector.result()
+
+			outputFile.write(sector)
+			self._pending.popleft()
+
+	@property
+	def blockFormats(self) -> list[tuple[SSTBlockFormat, ...]]:
+		return [ variant.formats for variant in self._variants ]
+
+	@property
+	def waveform(self) -> WaveformLevel:
+		return (
+			WAVEFORM_SAMPLE_RATE,
+			len(self.waveformData) * 2,
+			b"".join(( self.waveformData, *self.waveformBands ))
+		)
+
+	@property
+	def waveformLevels(self) -> list[WaveformLevel]:
+		levels: list[WaveformLevel] = [
+			( encoder.outputRate, len(data[0]) * 2, b"".join(data) )
+			for encoder, data in zip(self._levels, self._levelData)
+		]
+
+		# The overview is derived from the full resolution waveform rather
+		# than encoded directly, as its sample rate depends on the length of
+		# the track. Band levels are resampled the same way.
+		overview: list[bytearray] = [
+			resampleWaveform(
+				data,
+				len(self.waveformData) * 2,
+				WAVEFORM_OVERVIEW_LENGTH
+			) for data in ( self.waveformData, *self.waveformBands )
+		]
+		levels.append(( 0, WAVEFORM_OVERVIEW_LENGTH, b"".join(overview) ))
+
+		return levels
+
 	def estimateKey(self) -> tuple[str | None, int]:
 		return self._keyFinder.estimateKey(True)
+
+	def estimateBeatgrid(self) -> tuple[float, float, int] | None:
+		return self._beatTracker.estimateBeatgrid()
+
+	def measureLoudness(self) -> tuple[float, float] | None:
+		return self._loudnessMeter.measure()
@@ -6,7 +6,7 @@ from libc.stdint cimport int16_t, uint8_t
 
 ctypedef int16_t Sample
 
-cdef extern from "src/main/dsp/adpcm.hpp" namespace "dsp":
+cdef extern from "src/main/dsp/adpcm.hpp" namespace "dsp" nogil:
 	# 12-byte .sst ADPCM encoder and decoder
 
 	cdef struct SSTBlock:
@@ -19,10 +19,29 @@ cdef extern from "src/main/dsp/adpcm.hpp" namespace "dsp":
 
 	cdef const size_t SST_SAMPLES_PER_BLOCK = 22
 
+	cdef enum SSTBlockFormat:
+		SST_FORMAT_4BIT = 0
+		SST_FORMAT_3BIT = 1
+		SST_FORMAT_2BIT = 2
+
+	size_t getSSTBlockLength(SSTBlockFormat format)
+	size_t getSSTChunkLength(size_t numBlocks, SSTBlockFormat format)
+
+	cdef enum SSTEncoderQuality:
+		SST_QUALITY_DRAFT  = 0
+		SST_QUALITY_FAST   = 1
+		SST_QUALITY_NORMAL = 2
+		SST_QUALITY_BEST   = 3
+
 	cdef cppclass SSTEncoder:
 		SSTEncoder()
+		SSTEncoder(SSTEncoderQuality quality)
+		SSTEncoder(SSTEncoderQuality quality, SSTBlockFormat format)
 
+		void setQuality(SSTEncoderQuality quality)
+		void setFormat(SSTBlockFormat format)
 		void reset()
+		void reset(Sample s1, Sample s2)
 		size_t encode(
 			SSTChunkBase &output,
 			const Sample *input,
@@ -34,7 +53,17 @@ cdef extern from "src/main/dsp/adpcm.hpp" namespace "dsp":
 		Sample             *output,
 		const SSTChunkBase &input,
 		size_t             numBlocks,
-		size_t             outputStride
+		size_t             outputStride,
+		SSTBlockFormat     format
+	)
+	size_t decodeSSTBatch(
+		Sample             *output,
+		const SSTChunkBase &input,
+		size_t             numChunks,
+		size_t             numBlocks,
+		size_t             inputStride,
+		size_t             outputStride,
+		SSTBlockFormat     format
 	)
 
 	# 16-byte BRR ADPCM decoder (unused)
@@ -57,15 +86,18 @@ cdef extern from "src/main/dsp/adpcm.hpp" namespace "dsp":
 			size_t         inputStride
 		)
 
-cdef extern from "src/main/dsp/dsp.hpp" namespace "dsp":
+cdef extern from "src/main/dsp/dsp.hpp" namespace "dsp" nogil:
 	# 4-bit waveform data generator
 
 	cdef const int     WAVEFORM_SAMPLE_RATE = 32
 	cdef const uint8_t WAVEFORM_RANGE       = 12
+	cdef const int     NUM_WAVEFORM_BANDS   = 3
 
 	cdef cppclass WaveformEncoder:
 		WaveformEncoder()
+		WaveformEncoder(int outputRate)
 
+		int getOutputRate()
 		void reset()
 		size_t encode(
 			uint8_t      *output,
@@ -74,3 +106,18 @@ cdef extern from "src/main/dsp/dsp.hpp" namespace "dsp":
 			size_t       numSamples,
 			size_t       inputStride
 		)
+		size_t encode(
+			uint8_t      *output,
+			const Sample *input,
+			int          sampleRate,
+			size_t       numSamples,
+			size_t       inputStride,
+			uint8_t      **bandOutputs
+		)
+
+	size_t resampleWaveform(
+		uint8_t       *output,
+		const uint8_t *input,
+		size_t        inputLength,
+		size_t        outputLength
+	)
@@ -2,16 +2,19 @@
 # -*- coding: utf-8 -*-
 
 import logging, os, time
-from argparse        import ArgumentParser, Namespace
-from collections.abc import Iterable, Mapping, Sequence
-from enum            import IntEnum
-from io              import SEEK_SET
-from multiprocessing import Pool
-from pathlib         import Path
-from struct          import Struct
+from argparse           import ArgumentParser, Namespace
+from collections.abc    import Iterable, Mapping, Sequence
+from concurrent.futures import Executor, ThreadPoolExecutor
+from enum               import IntEnum, IntFlag
+from io                 import SEEK_SET
+from multiprocessing    import Pool
+from pathlib            import Path
+from struct             import Struct
 
 import av
-from audio        import NUM_CHANNELS, EncodingPipeline
+from audio        import \
+	NUM_CHANNELS, SST_MAX_SILENT_RUNS, SST_MAX_WAVEFORM_LEVELS, \
+	EncodingPipeline, SSTBlockFormat, SSTEncoderQuality, WaveformLevel
 from av.container import InputContainer
 from util         import \
 	StringBlobBuilder, findFilesWithExtensions, roundUpToMultiple, setupLogger
@@ -23,10 +26,19 @@ class SSTKeyScale(IntEnum):
 	SCALE_MAJOR   = 1
 	SCALE_MINOR   = 2
 
-SST_HEADER_STRUCT:     Struct = Struct("< 4s 3I 4B 16h 4H 4B")
+class SSTFlag(IntFlag):
+	SST_FLAG_MID_SIDE       = 1 << 0
+	SST_FLAG_WAVEFORM_BANDS = 1 << 1
+	SST_FLAG_LOUDNESS       = 1 << 2
+
+SST_HEADER_STRUCT:     Struct = \
+	Struct("< 4s 3I 4B 16h 4H 4B B 32B B 64I B B " + "IH " * 4 + "2I B 2h")
 SST_HEADER_LENGTH:     int    = 2048
 SST_MAX_VARIANTS:      int    = 16
 SST_PITCH_OFFSET_UNIT: int    = 1 << 4
+SST_BEAT_LENGTH_UNIT:  int    = 1 << 16
+SST_LOUDNESS_UNIT:     int    = 1 << 8
+MAX_GROUP_LENGTH:      int    = 255
 
 def normalizeMetadata(metadata: Mapping[str, str], defaultTitle: str = ""):
 	# Depending on the input file's tag format, FFmpeg may return uppercase keys
@@ -68,7 +80,15 @@ def generateSSTHeader(
 	numChunks:      int,
 	waveformLength: int,
 	pitchOffsets:   Sequence[float],
-	key:            tuple[str | None, int] = ( None, 0 )
+	numChannels:    int                                = NUM_CHANNELS,
+	key:            tuple[str | None, int]             = ( None, 0 ),
+	flags:          SSTFlag                            = SSTFlag(0),
+	blockFormats:   Sequence[Sequence[SSTBlockFormat]] = (),
+	silentRuns:     Sequence[tuple[int, int]]          = (),
+	groupLength:    int                                = 1,
+	waveformLevels: Sequence[WaveformLevel]            = (),
+	beatgrid:       tuple[float, float, int] | None    = None,
+	loudness:       tuple[float, float] | None         = None
 ) -> bytearray:
 	blob: StringBlobBuilder = StringBlobBuilder()
 
@@ -92,14 +112,65 @@ def generateSSTHeader(
 	for i, pitch in enumerate(pitchOffsets):
 		pitchOffsetValues[i] = round(pitch * SST_PITCH_OFFSET_UNIT)
 
+	# Variants not listed default to 4-bit blocks for all channels.
+	blockFormatValues: list[int] = [ 0 ] * (SST_MAX_VARIANTS * NUM_CHANNELS)
+
+	for i, formats in enumerate(blockFormats):
+		for j, blockFormat in enumerate(formats):
+			blockFormatValues[i * NUM_CHANNELS + j] = blockFormat
+
+	if len(silentRuns) > SST_MAX_SILENT_RUNS:
+		raise RuntimeError("too many silent runs for header")
+
+	silentRunValues: list[int] = [ 0 ] * (SST_MAX_SILENT_RUNS * 2)
+
+	for i, ( start, length ) in enumerate(silentRuns):
+		silentRunValues[i * 2 + 0] = start
+		silentRunValues[i * 2 + 1] = length
+
+	if len(waveformLevels) > SST_MAX_WAVEFORM_LEVELS:
+		raise RuntimeError("too many waveform levels for header")
+
+	waveformLevelValues: list[int] = [ 0 ] * (SST_MAX_WAVEFORM_LEVELS * 2)
+
+	for i, ( rate, length, _ ) in enumerate(waveformLevels):
+		waveformLevelValues[i * 2 + 0] = length
+		waveformLevelValues[i * 2 + 1] = rate
+
+	# The beat length is stored as a 16.16 fixed point number of samples. Very
+	# slow tempos at high sample rates cannot be represented and are dropped.
+	firstBeat:   int = 0
+	beatLength:  int = 0
+	beatsPerBar: int = 0
+
+	if beatgrid is not None:
+		firstBeat, beatLength, beatsPerBar = beatgrid
+
+		firstBeat  = round(firstBeat)
+		beatLength = round(beatLength * SST_BEAT_LENGTH_UNIT)
+
+		if beatLength > 0xffffffff:
+			firstBeat, beatLength, beatsPerBar = 0, 0, 0
+
+	# Integrated loudness (in LUFS) and true peak (in dBTP) are stored as 8.8
+	# fixed point values. The flag distinguishes 0 LUFS from no measurement.
+	loudnessValues: list[int] = [ 0, 0 ]
+
+	if loudness is not None:
+		flags         |= SSTFlag.SST_FLAG_LOUDNESS
+		loudnessValues = [
+			max(-0x8000, min(round(value * SST_LOUDNESS_UNIT), 0x7fff))
+			for value in loudness
+		]
+
 	header: bytearray = bytearray()
 	header           += SST_HEADER_STRUCT.pack(
-		b"SST1",
+		b"SST2",
 		sampleRate,
 		numChunks,
 		waveformLength,
 		len(pitchOffsets),
-		NUM_CHANNELS,
+		numChannels,
 		keyScale,
 		keyNote,
 		*pitchOffsetValues,
@@ -110,7 +181,18 @@ def generateSSTHeader(
 		int(metadata.get("track",       "1")),
 		int(metadata.get("totaltracks", "1")),
 		int(metadata.get("disc",        "1")),
-		int(metadata.get("totaldiscs",  "1"))
+		int(metadata.get("totaldiscs",  "1")),
+		flags,
+		*blockFormatValues,
+		len(silentRuns),
+		*silentRunValues,
+		groupLength,
+		len(waveformLevels),
+		*waveformLevelValues,
+		firstBeat,
+		beatLength,
+		beatsPerBar,
+		*loudnessValues
 	)
 	header           += blob.data
 
@@ -119,10 +201,17 @@ def generateSSTHeader(
 ## .sst file encoding
 
 def encodeFile(
-	inputPath:    Path,
-	outputPath:   Path,
-	sampleRate:   int,
-	pitchOffsets: Sequence[float]
+	inputPath:     Path,
+	outputPath:    Path,
+	sampleRate:    int,
+	pitchOffsets:  Sequence[float],
+	quality:       SSTEncoderQuality = SSTEncoderQuality.SST_QUALITY_BEST,
+	midSide:       bool              = False,
+	variantFormat: SSTBlockFormat    = SSTBlockFormat.SST_FORMAT_4BIT,
+	sideFormat:    SSTBlockFormat    = SSTBlockFormat.SST_FORMAT_4BIT,
+	groupLength:   int               = 1,
+	waveformBands: bool              = True,
+	numThreads:    int               = 1
 ):
 	try:
 		inputFile: InputContainer = av.open(inputPath, "r")
@@ -144,7 +233,33 @@ def encodeFile(
 		inputPath.stem
 	)
 
-	pipeline: EncodingPipeline = EncodingPipeline(sampleRate, pitchOffsets)
+	# Mono input files are encoded as mono .sst files, halving their size.
+	if inputFile.streams.audio[0].channels == 1:
+		numChannels: int = 1
+		midSide          = False
+	else:
+		numChannels: int = NUM_CHANNELS
+
+	# If multiple threads are requested, each chunk is encoded independently
+	# (with the ADPCM predictor seeded from the source signal) on a thread pool.
+	# Otherwise the encoder's state is carried over from one chunk to the next.
+	if numThreads == 1:
+		executor: Executor | None = None
+	else:
+		executor: Executor | None = ThreadPoolExecutor(numThreads or None)
+
+	pipeline: EncodingPipeline = EncodingPipeline(
+		sampleRate,
+		pitchOffsets,
+		numChannels,
+		quality,
+		midSide,
+		variantFormat,
+		sideFormat,
+		groupLength,
+		waveformBands,
+		executor
+	)
 
 	startTime: float = time.time()
 	duration:  float = inputFile.duration / 1000000
@@ -159,23 +274,49 @@ def encodeFile(
 			pipeline.flush(outputFile)
 
 		pipeline.feed(None)
-		pipeline.flush(outputFile)
+		pipeline.flush(outputFile, True)
+
+		# Any additional waveform levels are stored right after the full
+		# resolution waveform, each padded to a whole byte.
+		waveform:       WaveformLevel       = pipeline.waveform
+		waveformLevels: list[WaveformLevel] = pipeline.waveformLevels
+		waveformData:   bytearray           = bytearray(waveform[2])
 
-		waveformLength: int = len(pipeline.waveformData)
-		paddedLength:   int = roundUpToMultiple(waveformLength, 512)
+		for _, _, data in waveformLevels:
+			waveformData += data
 
-		outputFile.write(pipeline.waveformData.ljust(paddedLength, b"\0"))
+		paddedLength: int = roundUpToMultiple(len(waveformData), 512)
+
+		outputFile.write(waveformData.ljust(paddedLength, b"\0"))
+
+		flags: SSTFlag = SSTFlag(0)
+
+		if midSide:
+			flags |= SSTFlag.SST_FLAG_MID_SIDE
+		if waveformBands:
+			flags |= SSTFlag.SST_FLAG_WAVEFORM_BANDS
 
 		outputFile.seek(0, SEEK_SET)
 		outputFile.write(generateSSTHeader(
 			metadata,
 			sampleRate,
 			pipeline.chunksEncoded,
-			waveformLength * 2,
+			waveform[1],
 			pitchOffsets,
-			pipeline.estimateKey()
+			numChannels,
+			pipeline.estimateKey(),
+			flags,
+			pipeline.blockFormats,
+			pipeline.silentRuns,
+			groupLength,
+			waveformLevels,
+			pipeline.estimateBeatgrid(),
+			pipeline.measureLoudness()
 		))
 
+	if executor is not None:
+		executor.shutdown()
+
 	encodeTime: float = time.time() - startTime
 
 	logging.info(
@@ -189,6 +330,18 @@ DEFAULT_EXTENSIONS:    list[str]   = [ "wav", "flac", "mp3", "m4a", "ogg" ]
 DEFAULT_PITCH_OFFSETS: list[float] = [ -2.0, -1.0, 0.0, 1.0, 2.0 ]
 DEFAULT_SAMPLE_RATE:   int         = 44100
 
+QUALITY_LEVELS: dict[str, SSTEncoderQuality] = {
+	"draft":  SSTEncoderQuality.SST_QUALITY_DRAFT,
+	"fast":   SSTEncoderQuality.SST_QUALITY_FAST,
+	"normal": SSTEncoderQuality.SST_QUALITY_NORMAL,
+	"best":   SSTEncoderQuality.SST_QUALITY_BEST
+}
+BIT_DEPTHS:     dict[str, SSTBlockFormat]    = {
+	"4": SSTBlockFormat.SST_FORMAT_4BIT,
+	"3": SSTBlockFormat.SST_FORMAT_3BIT,
+	"2": SSTBlockFormat.SST_FORMAT_2BIT
+}
+
 def createParser() -> ArgumentParser:
 	parser = ArgumentParser(
 		description = \
@@ -218,6 +371,16 @@ def createParser() -> ArgumentParser:
 			"multiple files at once (autodetected by default)",
 		metavar = "num"
 	)
+	group.add_argument(
+		"-t", "--threads",
+		type    = lambda value: int(value, 0),
+		default = 1,
+		help    = \
+			"Encode the chunks of each file independently of each other, on up "
+			"to the specified number of threads (0 to autodetect, default 1 to "
+			"encode serially)",
+		metavar = "num"
+	)
 
 	group = parser.add_argument_group("Input options")
 	group.add_argument(
@@ -255,6 +418,57 @@ def createParser() -> ArgumentParser:
 			f"{",".join(map(str, DEFAULT_PITCH_OFFSETS))})",
 		metavar = "value,value,..."
 	)
+	group.add_argument(
+		"-q", "--quality",
+		choices = QUALITY_LEVELS.keys(),
+		default = "best",
+		help    = \
+			"Trade ADPCM encoding quality for speed by only trying the most "
+			"promising prediction filters for each block (default best, which "
+			"performs an exhaustive search)"
+	)
+	group.add_argument(
+		"-m", "--mid-side",
+		action = "store_true",
+		help   = \
+			"Store mid and side channels rather than left and right, improving "
+			"quality for tracks with highly correlated channels"
+	)
+	group.add_argument(
+		"-b", "--variant-bits",
+		choices = BIT_DEPTHS.keys(),
+		default = "4",
+		help    = \
+			"Store pitch-shifted variants using the specified number of bits "
+			"per ADPCM sample to reduce file size (default 4, the original "
+			"variant is always stored at 4 bits)"
+	)
+	group.add_argument(
+		"-s", "--side-bits",
+		choices = BIT_DEPTHS.keys(),
+		default = "4",
+		help    = \
+			"Store the side channel using the specified number of bits per "
+			"ADPCM sample when in mid/side mode (default 4)"
+	)
+	group.add_argument(
+		"-g", "--group",
+		type    = lambda value: int(value, 0),
+		default = 1,
+		help    = \
+			"Store the sectors of each variant for the specified number of "
+			"consecutive chunks together, allowing the player to read them in "
+			"larger bursts (default 1, which interleaves variants chunk by "
+			"chunk)",
+		metavar = "num"
+	)
+	group.add_argument(
+		"-n", "--no-bands",
+		action = "store_true",
+		help   = \
+			"Do not store the low/mid/high band levels used to color the "
+			"waveform, reducing the amount of memory used by the player"
+	)
 
 	group = parser.add_argument_group("File paths")
 	group.add_argument(
@@ -286,15 +500,32 @@ def main():
 		parser.error("at least one pitch offset must be specified")
 	if len(args.pitch_offsets) > SST_MAX_VARIANTS:
 		parser.error("too many pitch offsets specified")
+	if (args.group < 1) or (args.group > MAX_GROUP_LENGTH):
+		parser.error(f"group length must be in 1-{MAX_GROUP_LENGTH} range")
 
 	args.pitch_offsets.sort()
 	logging.info(
-		f"output sample rate: {args.resample} Hz, pitch offsets: " +
+		f"output sample rate: {args.resample} Hz, quality: {args.quality}, "
+		f"pitch offsets: " +
 		", ".join(f"{pitch:.1f}" for pitch in args.pitch_offsets)
 	)
 
 	# Gather all paths before spawning the encoding pool.
-	calls: list[tuple[str, str, list[int], int]] = []
+	calls: list[
+		tuple[
+			str,
+			str,
+			int,
+			list[float],
+			SSTEncoderQuality,
+			bool,
+			SSTBlockFormat,
+			SSTBlockFormat,
+			int,
+			bool,
+			int
+		]
+	] = []
 
 	for path in args.input:
 		if path.is_dir():
@@ -318,7 +549,14 @@ def main():
 					inputPath,
 					outputPath,
 					args.resample,
-					args.pitch_offsets
+					args.pitch_offsets,
+					QUALITY_LEVELS[args.quality],
+					args.mid_side,
+					BIT_DEPTHS[args.variant_bits],
+					BIT_DEPTHS[args.side_bits],
+					args.group,
+					not args.no_bands,
+					args.threads
 				))
 
 	logging.info(f"converting {len(calls)} files")
@@ -7,6 +7,7 @@
 # cython:    language_level=3
 
 from cython.operator cimport dereference
+from libc.math       cimport M_PI, pow, tan
 from libc.stddef     cimport size_t
 from libc.stdint     cimport int16_t, uint8_t
 from libcpp          cimport bool
@@ -16,52 +17,82 @@ from numpy import ndarray
 
 cimport dsp, keyfinder
 from dsp        cimport \
-	SST_SAMPLES_PER_BLOCK, WAVEFORM_SAMPLE_RATE, SSTBlock, SSTChunkBase
+	SST_SAMPLES_PER_BLOCK, WAVEFORM_SAMPLE_RATE, NUM_WAVEFORM_BANDS, \
+	SST_QUALITY_BEST, SST_FORMAT_4BIT, SST_FORMAT_2BIT, SSTChunkBase, \
+	SSTEncoderQuality, SSTBlockFormat, getSSTBlockLength, getSSTChunkLength
 from keyfinder  cimport key_t
 from rubberband cimport Option, RubberBandStretcher
 
 ## .sst ADPCM encoder/decoder bindings
 
+cdef SSTBlockFormat _validateFormat(int format) except *:
+	if (format < 0) or (format > SST_FORMAT_2BIT):
+		raise ValueError("invalid block format")
+
+	return <SSTBlockFormat> format
+
 cdef class SSTEncoder:
-	cdef dsp.SSTEncoder _encoder
+	cdef dsp.SSTEncoder  _encoder
+	cdef SSTBlockFormat _format
 
-	def reset(self):
-		self._encoder.reset()
+	def __init__(
+		self,
+		int quality = SST_QUALITY_BEST,
+		int format  = SST_FORMAT_4BIT
+	):
+		if (quality < 0) or (quality > SST_QUALITY_BEST):
+			raise ValueError("invalid encoder quality level")
+
+		self._format = _validateFormat(format)
+		self._encoder.setQuality(<SSTEncoderQuality> quality)
+		self._encoder.setFormat(self._format)
+
+	def reset(self, int16_t s1 = 0, int16_t s2 = 0):
+		self._encoder.reset(s1, s2)
 
 	def encode(self, const int16_t[::1] samples not None) -> bytearray:
 		if not samples.shape[0]:
 			return bytearray()
 
-		cdef size_t numBlocks = samples.shape[0]
-		numBlocks            += SST_SAMPLES_PER_BLOCK - 1
-		numBlocks           //= SST_SAMPLES_PER_BLOCK
-		chunk                 = \
-			bytearray(sizeof(SSTChunkBase) + numBlocks * sizeof(SSTBlock))
+		cdef size_t numSamples = samples.shape[0]
+		cdef size_t numBlocks  = numSamples
+		numBlocks             += SST_SAMPLES_PER_BLOCK - 1
+		numBlocks            //= SST_SAMPLES_PER_BLOCK
+		chunk                  = \
+			bytearray(getSSTChunkLength(numBlocks, self._format))
 
 		cdef uint8_t[::1] chunkView = chunk
 
-		self._encoder.encode(
-			dereference(<SSTChunkBase *> &chunkView[0]),
-			&samples[0],
-			samples.shape[0],
-			1
-		)
+		# Release the GIL while encoding to allow multiple chunks to be encoded
+		# in parallel from different threads.
+		with nogil:
+			self._encoder.encode(
+				dereference(<SSTChunkBase *> &chunkView[0]),
+				&samples[0],
+				numSamples,
+				1
+			)
 
 		return chunk
 
-def decodeSST(const uint8_t[::1] chunk not None) -> ndarray:
-	cdef size_t dataLength = chunk.shape[0] - sizeof(SSTChunkBase)
+def decodeSST(
+	const uint8_t[::1] chunk not None,
+	int                format = SST_FORMAT_4BIT
+) -> ndarray:
+	cdef SSTBlockFormat blockFormat = _validateFormat(format)
+	cdef size_t         blockLength = getSSTBlockLength(blockFormat)
+	cdef size_t         dataLength  = chunk.shape[0] - sizeof(SSTChunkBase)
 
 	if dataLength < 0:
 		raise ValueError("invalid input chunk header")
 	if not dataLength:
 		return numpy.empty(0, numpy.int16)
-	if dataLength % sizeof(SSTBlock):
+	if dataLength % blockLength:
 		raise ValueError(
 			"input chunk must consist of a header and block aligned data"
 		)
 
-	cdef size_t numBlocks = dataLength // sizeof(SSTBlock)
+	cdef size_t numBlocks = dataLength // blockLength
 	samples               = \
 		numpy.empty(numBlocks * SST_SAMPLES_PER_BLOCK, numpy.int16)
 
@@ -71,15 +102,76 @@ def decodeSST(const uint8_t[::1] chunk not None) -> ndarray:
 		&samplesView[0],
 		dereference(<const SSTChunkBase *> &chunk[0]),
 		numBlocks,
-		1
+		1,
+		blockFormat
 	)
 
 	return samples[0:numDecoded]
 
+def decodeSSTBatch(
+	const uint8_t[:, :] chunks not None,
+	int                 format = SST_FORMAT_4BIT
+) -> ndarray:
+	# Chunks may be spaced arbitrarily apart (e.g. when decoding one channel out
+	# of a series of sectors), but each one must be contiguous.
+	cdef SSTBlockFormat blockFormat = _validateFormat(format)
+	cdef size_t         blockLength = getSSTBlockLength(blockFormat)
+	cdef size_t         numChunks   = chunks.shape[0]
+	cdef size_t         dataLength  = chunks.shape[1] - sizeof(SSTChunkBase)
+
+	if chunks.strides[1] != 1:
+		raise ValueError("input chunks must be contiguous")
+	if (numChunks > 1) and (chunks.strides[0] <= 0):
+		# The stride is passed to the decoder as a size_t.
+		raise ValueError("input chunks must be in ascending order in memory")
+	if chunks.shape[1] < sizeof(SSTChunkBase):
+		raise ValueError("invalid input chunk header")
+	if dataLength % blockLength:
+		raise ValueError(
+			"input chunks must consist of a header and block aligned data"
+		)
+
+	cdef size_t numBlocks  = dataLength // blockLength
+	cdef size_t numSamples = numBlocks * SST_SAMPLES_PER_BLOCK
+	samples                = numpy.empty(( numChunks, numSamples ), numpy.int16)
+
+	if not (numChunks and numSamples):
+		return samples
+
+	cdef int16_t[:, ::1] samplesView = samples
+	cdef size_t          inputStride = chunks.strides[0]
+
+	# Each chunk is decoded independently, so the GIL can be released for the
+	# entire batch.
+	with nogil:
+		dsp.decodeSSTBatch(
+			&samplesView[0, 0],
+			dereference(<const SSTChunkBase *> &chunks[0, 0]),
+			numChunks,
+			numBlocks,
+			inputStride,
+			numSamples,
+			blockFormat
+		)
+
+	return samples
+
 ## Waveform data generator bindings
 
 cdef class WaveformEncoder:
 	cdef dsp.WaveformEncoder _encoder
+	cdef int                 _outputRate
+
+	def __init__(self, int outputRate = WAVEFORM_SAMPLE_RATE):
+		if outputRate <= 0:
+			raise ValueError("invalid waveform sample rate")
+
+		self._outputRate = outputRate
+		self._encoder    = dsp.WaveformEncoder(outputRate)
+
+	@property
+	def outputRate(self) -> int:
+		return self._outputRate
 
 	def reset(self):
 		self._encoder.reset()
@@ -92,9 +184,9 @@ cdef class WaveformEncoder:
 		if not samples.shape[0]:
 			return bytearray()
 
-		cdef size_t numNibbles = samples.shape[0] * sampleRate
-		numNibbles            += WAVEFORM_SAMPLE_RATE - 1
-		numNibbles           //= WAVEFORM_SAMPLE_RATE
+		cdef size_t numNibbles = samples.shape[0] * self._outputRate
+		numNibbles            += sampleRate - 1
+		numNibbles           //= sampleRate
 		chunk                  = bytearray((numNibbles + 1) // 2)
 
 		cdef uint8_t[::1] chunkView = chunk
@@ -109,6 +201,60 @@ cdef class WaveformEncoder:
 
 		return chunk[0:length]
 
+	def encodeWithBands(
+		self,
+		const int16_t[::1] samples not None,
+		int                sampleRate
+	) -> tuple[bytearray, tuple[bytearray, ...]]:
+		if not samples.shape[0]:
+			return bytearray(), ( bytearray(), ) * NUM_WAVEFORM_BANDS
+
+		cdef size_t numNibbles = samples.shape[0] * self._outputRate
+		numNibbles            += sampleRate - 1
+		numNibbles           //= sampleRate
+		chunk                  = bytearray((numNibbles + 1) // 2)
+		bands                  = tuple(
+			bytearray((numNibbles + 1) // 2) for _ in range(NUM_WAVEFORM_BANDS)
+		)
+
+		cdef uint8_t[::1] chunkView = chunk
+		cdef uint8_t[::1] lowView   = bands[0]
+		cdef uint8_t[::1] midView   = bands[1]
+		cdef uint8_t[::1] highView  = bands[2]
+		cdef uint8_t      *bandPtrs[NUM_WAVEFORM_BANDS]
+
+		bandPtrs[0] = &lowView[0]
+		bandPtrs[1] = &midView[0]
+		bandPtrs[2] = &highView[0]
+
+		cdef size_t length = self._encoder.encode(
+			&chunkView[0],
+			&samples[0],
+			sampleRate,
+			samples.shape[0],
+			1,
+			bandPtrs
+		)
+
+		return chunk[0:length], tuple(band[0:length] for band in bands)
+
+def resampleWaveform(
+	const uint8_t[::1] data not None,
+	size_t             inputLength,
+	size_t             outputLength
+) -> bytearray:
+	if inputLength > (<size_t> data.shape[0] * 2):
+		raise ValueError("waveform data is shorter than specified length")
+	if not inputLength:
+		return bytearray((outputLength + 1) // 2)
+
+	output = bytearray((outputLength + 1) // 2)
+
+	cdef uint8_t[::1] outputView = output
+
+	dsp.resampleWaveform(&outputView[0], &data[0], inputLength, outputLength)
+	return output
+
 ## KeyFinder bindings
 
 cdef class KeyFinder:
@@ -151,6 +297,413 @@ cdef class KeyFinder:
 
 		return keyScale, (keyNote + 9) % 12
 
+## Beat and downbeat tracker
+
+# The onset envelope is computed from the spectral flux of overlapping frames,
+# both across the entire spectrum (used to find the tempo and beat phase) and
+# in the bass range only (used to pick the downbeat, as kicks and bass notes
+# tend to be emphasized at the start of each bar).
+cdef int    BEAT_FRAME_LENGTH = 2048
+cdef int    BEAT_HOP_LENGTH   = 512
+cdef double BEAT_LOW_CUTOFF   = 150.0
+cdef double BEAT_MIN_BPM      = 70.0
+cdef double BEAT_MAX_BPM      = 180.0
+cdef double BEAT_PRIOR_BPM    = 120.0
+
+# Onsets show up in the envelope about a third of a hop early, as frames start
+# overlapping them before they reach their center (measured on synthetic click
+# tracks).
+cdef double BEAT_ONSET_DELAY = 0.35
+
+# The tempo is first refined to 1/100 of an onset frame within one frame of the
+# autocorrelation peak (with the phase in 1/4 frame steps), then to 1/2000 of a
+# frame (with the phase in 1/32 frame steps), to minimize drift over long
+# tracks.
+cdef int BEAT_COARSE_STEPS = 100
+cdef int BEAT_FINE_STEPS   = 20
+
+cdef double _sampleEnvelope(const float[::1] envelope, double position) nogil:
+	cdef Py_ssize_t index    = <Py_ssize_t> position
+	cdef double     fraction = position - index
+
+	if (index < 0) or ((index + 1) >= envelope.shape[0]):
+		return 0.0
+
+	return envelope[index] * (1.0 - fraction) + envelope[index + 1] * fraction
+
+cdef double _combScore(
+	const float[::1] envelope,
+	double           period,
+	double           phase
+) nogil:
+	cdef double score    = 0.0
+	cdef double position = phase
+	cdef int    count    = 0
+
+	while position < (envelope.shape[0] - 1):
+		score    += _sampleEnvelope(envelope, position)
+		position += period
+		count    += 1
+
+	return (score / count) if count else 0.0
+
+cdef void _searchComb(
+	const float[::1] envelope,
+	double           *period,
+	double           *phase,
+	double           periodStep,
+	int              numPeriodSteps,
+	double           phaseStart,
+	double           phaseEnd,
+	double           phaseStep
+) nogil:
+	cdef double bestScore  = -1.0
+	cdef double bestPeriod = period[0]
+	cdef double bestPhase  = phase[0]
+	cdef double candidatePeriod, candidatePhase, score
+	cdef int    i
+
+	for i in range(-numPeriodSteps, numPeriodSteps + 1):
+		candidatePeriod = period[0] + periodStep * i
+		candidatePhase  = phaseStart
+
+		while candidatePhase < phaseEnd:
+			score = _combScore(envelope, candidatePeriod, candidatePhase)
+
+			if score > bestScore:
+				bestScore  = score
+				bestPeriod = candidatePeriod
+				bestPhase  = candidatePhase
+
+			candidatePhase += phaseStep
+
+	period[0] = bestPeriod
+	phase[0]  = bestPhase
+
+cdef class BeatTracker:
+	cdef int _sampleRate, _numChannels, _numLowBins
+
+	cdef object _window, _buffer, _lastSpectrum
+	cdef list   _onsets, _lowOnsets
+
+	def __init__(self, int sampleRate, int numChannels):
+		self._sampleRate  = sampleRate
+		self._numChannels = numChannels
+		self._numLowBins  = \
+			int(BEAT_LOW_CUTOFF * BEAT_FRAME_LENGTH / sampleRate) + 1
+
+		# Pad the beginning of the signal so that each frame is centered
+		# around a multiple of the hop length.
+		self._window       = numpy.hanning(BEAT_FRAME_LENGTH)
+		self._buffer       = numpy.zeros(BEAT_FRAME_LENGTH // 2, numpy.float32)
+		self._lastSpectrum = numpy.zeros(BEAT_FRAME_LENGTH // 2 + 1)
+		self._onsets       = []
+		self._lowOnsets    = []
+
+	def feed(self, const float[:, ::1] samples not None):
+		if samples.shape[0] != self._numChannels:
+			raise ValueError("invalid channel count")
+
+		self._buffer = numpy.concatenate((
+			self._buffer,
+			numpy.asarray(samples).mean(0, dtype = numpy.float32)
+		))
+
+		cdef Py_ssize_t numFrames = \
+			(self._buffer.shape[0] - BEAT_FRAME_LENGTH) // BEAT_HOP_LENGTH + 1
+
+		if numFrames <= 0:
+			return
+
+		frames: ndarray = numpy.lib.stride_tricks.sliding_window_view(
+			self._buffer,
+			BEAT_FRAME_LENGTH
+		)[0:numFrames * BEAT_HOP_LENGTH:BEAT_HOP_LENGTH]
+
+		spectra: ndarray = numpy.fft.rfft(frames * self._window, axis = 1)
+		spectra          = numpy.log1p(numpy.abs(spectra) * 100.0)
+		flux:    ndarray = numpy.diff(
+			numpy.vstack(( self._lastSpectrum, spectra )),
+			axis = 0
+		).clip(0.0, None)
+
+		self._onsets.append(flux.sum(1))
+		self._lowOnsets.append(flux[:, 0:self._numLowBins].sum(1))
+
+		self._buffer       = self._buffer[numFrames * BEAT_HOP_LENGTH:]
+		self._lastSpectrum = spectra[-1]
+
+	def estimateBeatgrid(
+		self,
+		int beatsPerBar = 4
+	) -> tuple[float, float, int] | None:
+		if not self._onsets:
+			return None
+
+		cdef double framesPerSecond = \
+			<double> self._sampleRate / BEAT_HOP_LENGTH
+
+		# Subtract the local average (over roughly one second) from the
+		# envelope, so that only actual onsets contribute to the comb filter.
+		onsets:  ndarray = numpy.concatenate(self._onsets)
+		average: ndarray = numpy.convolve(
+			onsets,
+			numpy.full(int(framesPerSecond), 1.0 / int(framesPerSecond)),
+			"same"
+		)
+		onsets = (onsets - average).clip(0.0, None).astype(numpy.float32)
+
+		cdef int minLag = int(framesPerSecond * 60.0 / BEAT_MAX_BPM)
+		cdef int maxLag = int(framesPerSecond * 60.0 / BEAT_MIN_BPM) + 1
+
+		if (onsets.shape[0] < (maxLag * beatsPerBar * 2)) or not onsets.any():
+			return None
+
+		# Find a rough tempo estimate through autocorrelation, favoring tempos
+		# close to the prior in order to resolve octave errors.
+		spectrum: ndarray = numpy.fft.rfft(
+			onsets - onsets.mean(),
+			onsets.shape[0] * 2
+		)
+		lags:     ndarray = numpy.arange(minLag, maxLag + 1)
+		weights:  ndarray = numpy.exp(-0.5 * numpy.log2(
+			(60.0 * framesPerSecond / lags) / BEAT_PRIOR_BPM
+		) ** 2)
+		autocorrelation: ndarray = \
+			numpy.fft.irfft(numpy.abs(spectrum) ** 2)[minLag:maxLag + 1]
+
+		cdef double bestPeriod = lags[numpy.argmax(autocorrelation * weights)]
+		cdef double bestPhase  = 0.0
+		cdef double score
+		cdef int    i
+
+		# Refine the period and find the phase by evaluating a comb filter over
+		# the entire track, which yields a much more accurate estimate than the
+		# autocorrelation's integer lags.
+		cdef const float[::1] envelope = onsets
+
+		with nogil:
+			_searchComb(
+				envelope,
+				&bestPeriod,
+				&bestPhase,
+				1.0 / BEAT_COARSE_STEPS,
+				BEAT_COARSE_STEPS,
+				0.0,
+				bestPeriod + 1.0,
+				1.0 / 4.0
+			)
+			_searchComb(
+				envelope,
+				&bestPeriod,
+				&bestPhase,
+				1.0 / (BEAT_COARSE_STEPS * BEAT_FINE_STEPS),
+				BEAT_FINE_STEPS,
+				bestPhase - 0.5,
+				bestPhase + 0.5,
+				1.0 / 32.0
+			)
+
+		# Pick the downbeat as the beat within each bar that has the strongest
+		# bass onsets on average.
+		lowOnsets: ndarray = \
+			numpy.concatenate(self._lowOnsets).astype(numpy.float32)
+
+		cdef const float[::1] lowEnvelope = lowOnsets
+
+		cdef double bestBarScore = -1.0
+		cdef int    bestOffset   = 0
+
+		for i in range(beatsPerBar):
+			score = _combScore(
+				lowEnvelope,
+				bestPeriod * beatsPerBar,
+				bestPhase + bestPeriod * i
+			)
+
+			if score > bestBarScore:
+				bestBarScore = score
+				bestOffset   = i
+
+		firstBeat: float = (
+			bestPhase + bestPeriod * bestOffset + BEAT_ONSET_DELAY
+		) * BEAT_HOP_LENGTH
+		barLength: float = bestPeriod * beatsPerBar * BEAT_HOP_LENGTH
+
+		return firstBeat % barLength, bestPeriod * BEAT_HOP_LENGTH, beatsPerBar
+
+## Loudness meter
+
+# Integrated loudness is measured as per ITU-R BS.1770-4 (K-weighted, gated
+# 400 ms blocks with 75% overlap), while the true peak is estimated by
+# oversampling the signal 4 times.
+cdef double LOUDNESS_BLOCK_LENGTH    = 0.4
+cdef int    LOUDNESS_STEPS_PER_BLOCK = 4
+cdef double LOUDNESS_ABSOLUTE_GATE   = -70.0
+cdef double LOUDNESS_RELATIVE_GATE   = -10.0
+cdef int    TRUE_PEAK_OVERSAMPLING   = 4
+cdef int    TRUE_PEAK_FILTER_LENGTH  = 48
+
+cdef void _configureKWeighting(double *shelf, double *highpass, int sampleRate):
+	# Coefficients are derived from the analog prototypes specified by the
+	# standard, so that any sample rate can be used.
+	cdef double k  = tan(M_PI * 1681.974450955533 / sampleRate)
+	cdef double q  = 0.7071752369554196
+	cdef double vh = pow(10.0, 3.999843853973347 / 20.0)
+	cdef double vb = pow(vh, 0.4996667741545416)
+	cdef double a0 = 1.0 + k / q + k * k
+
+	shelf[0] = (vh + vb * k / q + k * k) / a0
+	shelf[1] = 2.0 * (k * k - vh)        / a0
+	shelf[2] = (vh - vb * k / q + k * k) / a0
+	shelf[3] = 2.0 * (k * k - 1.0)       / a0
+	shelf[4] = (1.0 - k / q + k * k)     / a0
+
+	k  = tan(M_PI * 38.13547087602444 / sampleRate)
+	q  = 0.5003270373238773
+	a0 = 1.0 + k / q + k * k
+
+	highpass[0] = 1.0
+	highpass[1] = -2.0
+	highpass[2] = 1.0
+	highpass[3] = 2.0 * (k * k - 1.0)   / a0
+	highpass[4] = (1.0 - k / q + k * k) / a0
+
+cdef double _processBiquad(
+	const double *coeffs,
+	double       *state,
+	double       value
+) noexcept nogil:
+	cdef double filtered = coeffs[0] * value + state[0]
+
+	state[0] = coeffs[1] * value - coeffs[3] * filtered + state[1]
+	state[1] = coeffs[2] * value - coeffs[4] * filtered
+
+	return filtered
+
+cdef class LoudnessMeter:
+	cdef int    _numChannels, _stepLength, _stepPosition
+	cdef double _shelf[5]
+	cdef double _highpass[5]
+	cdef double _channelWeight, _stepEnergy, _truePeak
+
+	cdef double[:, ::1] _filterStates
+	cdef object         _peakFilter, _peakHistory
+	cdef list           _steps
+
+	def __init__(self, int sampleRate, int numChannels):
+		self._numChannels  = numChannels
+		self._stepLength   = \
+			int(sampleRate * LOUDNESS_BLOCK_LENGTH / LOUDNESS_STEPS_PER_BLOCK)
+		self._stepPosition = 0
+		self._stepEnergy   = 0.0
+		self._truePeak     = 0.0
+		self._filterStates = numpy.zeros(( numChannels, 4 ))
+		self._steps        = []
+
+		# Mono tracks are played back on both output channels, so they are
+		# measured as if they were dual mono.
+		self._channelWeight = 2.0 if (numChannels == 1) else 1.0
+
+		_configureKWeighting(self._shelf, self._highpass, sampleRate)
+
+		# Windowed sinc interpolation filter, split into one phase per output
+		# sample.
+		taps: ndarray = numpy.arange(TRUE_PEAK_FILTER_LENGTH)
+		taps          = taps - (TRUE_PEAK_FILTER_LENGTH - 1) / 2.0
+
+		self._peakFilter  = numpy.sinc(taps / TRUE_PEAK_OVERSAMPLING) * \
+			numpy.kaiser(TRUE_PEAK_FILTER_LENGTH, 8.0)
+		self._peakHistory = numpy.zeros((
+			numChannels,
+			TRUE_PEAK_FILTER_LENGTH // TRUE_PEAK_OVERSAMPLING - 1
+		), numpy.float32)
+
+	def feed(self, const float[:, ::1] samples not None):
+		if samples.shape[0] != self._numChannels:
+			raise ValueError("invalid channel count")
+
+		cdef double[:, ::1] states = self._filterStates
+		cdef list           steps  = self._steps
+		cdef double         value
+		cdef Py_ssize_t     i, j
+
+		for i in range(samples.shape[1]):
+			for j in range(self._numChannels):
+				value = _processBiquad(
+					self._shelf,
+					&states[j, 0],
+					samples[j, i]
+				)
+				value = _processBiquad(
+					self._highpass,
+					&states[j, 2],
+					value
+				)
+
+				self._stepEnergy += value * value
+
+			self._stepPosition += 1
+
+			if self._stepPosition >= self._stepLength:
+				steps.append(self._stepEnergy * self._channelWeight)
+
+				self._stepPosition = 0
+				self._stepEnergy   = 0.0
+
+		# Interpolate each phase separately, carrying over the last few samples
+		# from the previous call.
+		buffer: ndarray = \
+			numpy.concatenate(( self._peakHistory, samples ), axis = 1)
+
+		for channel in buffer:
+			for phase in range(TRUE_PEAK_OVERSAMPLING):
+				interpolated: ndarray = numpy.convolve(
+					channel,
+					self._peakFilter[phase::TRUE_PEAK_OVERSAMPLING],
+					"valid"
+				)
+
+				if interpolated.shape[0]:
+					self._truePeak = \
+						max(self._truePeak, numpy.abs(interpolated).max())
+
+		self._peakHistory = \
+			buffer[:, buffer.shape[1] - self._peakHistory.shape[1]:]
+
+	def measure(self) -> tuple[float, float] | None:
+		if (len(self._steps) < LOUDNESS_STEPS_PER_BLOCK) or not self._truePeak:
+			return None
+
+		# Compute the mean square of each block (in LUFS) and apply both gates.
+		steps:    ndarray = numpy.array(self._steps)
+		energies: ndarray = numpy.convolve(
+			steps,
+			numpy.ones(LOUDNESS_STEPS_PER_BLOCK),
+			"valid"
+		) / (self._stepLength * LOUDNESS_STEPS_PER_BLOCK)
+
+		with numpy.errstate(divide = "ignore"):
+			loudness: ndarray = -0.691 + 10.0 * numpy.log10(energies)
+
+		energies = energies[loudness > LOUDNESS_ABSOLUTE_GATE]
+
+		if not energies.shape[0]:
+			return None
+
+		gate: float = -0.691 + 10.0 * numpy.log10(energies.mean())
+		gate       += LOUDNESS_RELATIVE_GATE
+
+		with numpy.errstate(divide = "ignore"):
+			energies = energies[
+				(-0.691 + 10.0 * numpy.log10(energies)) > gate
+			]
+
+		return (
+			float(-0.691 + 10.0 * numpy.log10(energies.mean())),
+			float(20.0 * numpy.log10(self._truePeak))
+		)
+
 ## Rubber Band pitch shifter bindings
 
 cdef class PitchShifter: